@@ -73,7 +73,7 @@ void list::listEmpty()
     while(len--) {
         next = current->listNextNode();
         if (m_free) m_free(current->m_value);
-        zfree(current);
+        zfree_with_size(current,sizeof(*current));
         current = next;
     }
     m_head = m_tail = NULL;
@@ -188,7 +188,7 @@ void list::listDelNode(listNode *node)
     else
         m_tail = node->m_prev;
     if (m_free) m_free(node->m_value);
-    zfree(node);
+    zfree_with_size(node,sizeof(*node));
     m_len--;
 }
 
@@ -61,6 +61,14 @@
     #endif
 #endif
 
+/* Return the UNIX time in microseconds. */
+static long long aeUstime(void) {
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return ((long long)tv.tv_sec)*1000000+tv.tv_usec;
+}
+
 static void aeAddMillisecondsToNow(long long milliseconds, long *sec, long *ms);
 
 aeFileEvent::aeFileEvent()
@@ -96,6 +104,7 @@ aeEventLoop::aeEventLoop(int in_setsize)
     m_maxfd = -1;
     m_beforesleep = NULL;
     m_aftersleep = NULL;
+    m_phaseproc = NULL;
     aeApiCreate();
     /* Events with m_mask == AE_NONE are not set. So let's initialize the
      * vector with it. */
@@ -385,6 +394,7 @@ int aeEventLoop::processTimeEvents()
 int aeEventLoop::aeProcessEvents(int flags)
 {
     int processed = 0, numevents;
+    long long phase_start = 0;
 
     /* Nothing to do? return ASAP */
     if (!(flags & AE_TIME_EVENTS) && !(flags & AE_FILE_EVENTS)) return 0;
@@ -435,11 +445,15 @@ int aeEventLoop::aeProcessEvents(int flags)
 
         /* Call the multiplexing API, will return only on timeout or when
          * some event fires. */
+        if (m_phaseproc) phase_start = aeUstime();
         numevents = aeApiPoll(tvp);
+        if (m_phaseproc) aePhaseEnd(AE_PHASE_POLL,&phase_start);
 
         /* After sleep callback. */
-        if (m_aftersleep != NULL && flags & AE_CALL_AFTER_SLEEP)
+        if (m_aftersleep != NULL && flags & AE_CALL_AFTER_SLEEP) {
             m_aftersleep(this);
+            if (m_phaseproc) aePhaseEnd(AE_PHASE_AFTER_SLEEP,&phase_start);
+        }
 
         for (j = 0; j < numevents; j++) {
             aeFileEvent *fe = &m_events[m_fired[j].m_fd];
@@ -460,10 +474,14 @@ int aeEventLoop::aeProcessEvents(int flags)
             }
             processed++;
         }
+        if (m_phaseproc) aePhaseEnd(AE_PHASE_FILE_EVENTS,&phase_start);
     }
     /* Check time events */
-    if (flags & AE_TIME_EVENTS)
+    if (flags & AE_TIME_EVENTS) {
+        if (m_phaseproc) phase_start = aeUstime();
         processed += processTimeEvents();
+        if (m_phaseproc) aePhaseEnd(AE_PHASE_TIME_EVENTS,&phase_start);
+    }
 
     return processed; /* return the number of processed file/time events */
 }
@@ -493,8 +511,11 @@ int aeWait(int fd, int mask, long long milliseconds) {
 void aeEventLoop::aeMain() {
     m_stop = 0;
     while (!m_stop) {
-        if (m_beforesleep != NULL)
+        if (m_beforesleep != NULL) {
+            long long phase_start = m_phaseproc ? aeUstime() : 0;
             m_beforesleep(this);
+            if (m_phaseproc) aePhaseEnd(AE_PHASE_BEFORE_SLEEP,&phase_start);
+        }
         aeProcessEvents(AE_ALL_EVENTS|AE_CALL_AFTER_SLEEP);
     }
 }
@@ -506,3 +527,19 @@ void aeEventLoop::aeSetBeforeSleepProc(aeBeforeSleepProc *in_beforesleep) {
 void aeEventLoop::aeSetAfterSleepProc(aeBeforeSleepProc *in_aftersleep) {
     m_aftersleep = in_aftersleep;
 }
+
+/* Set a callback that is called at the end of every phase of the event
+ * loop iterations with the phase duration in microseconds, so that the
+ * caller can profile where the time of each iteration goes. */
+void aeEventLoop::aeSetPhaseProc(aePhaseProc *in_phaseproc) {
+    m_phaseproc = in_phaseproc;
+}
+
+/* Report the phase that started at '*start' as ended now, and set '*start'
+ * to the current time so that it can be used for the next phase. */
+void aeEventLoop::aePhaseEnd(int phase, long long *start) {
+    long long now = aeUstime();
+
+    m_phaseproc(this,phase,now-*start);
+    *start = now;
+}
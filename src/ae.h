@@ -51,6 +51,14 @@
 #define AE_NOMORE -1
 #define AE_DELETED_EVENT_ID -1
 
+/* Phases of an event loop iteration, reported to the phase callback. */
+#define AE_PHASE_BEFORE_SLEEP 0
+#define AE_PHASE_POLL 1
+#define AE_PHASE_AFTER_SLEEP 2
+#define AE_PHASE_FILE_EVENTS 3
+#define AE_PHASE_TIME_EVENTS 4
+#define AE_PHASES 5
+
 /* Macros */
 #define AE_NOTUSED(V) ((void) V)
 
@@ -61,6 +69,7 @@ typedef void aeFileProc(aeEventLoop*, int fd, void *clientData, int mask);
 typedef int aeTimeProc(aeEventLoop*, long long id, void *clientData);
 typedef void aeEventFinalizerProc(aeEventLoop*, void *clientData);
 typedef void aeBeforeSleepProc(aeEventLoop*);
+typedef void aePhaseProc(aeEventLoop*, int phase, long long usec);
 
 /* File event structure */
 class aeFileEvent
@@ -120,6 +129,7 @@ public:
     void aeMain();
     void aeSetBeforeSleepProc(aeBeforeSleepProc *beforesleep);
     void aeSetAfterSleepProc(aeBeforeSleepProc *aftersleep);
+    void aeSetPhaseProc(aePhaseProc *phaseproc);
     int aeGetSetSize();
     int aeResizeSetSize(int in_setsize);
     char *aeApiName();
@@ -136,7 +146,9 @@ private:
     void *m_apidata; /* This is used for polling API specific data */
     aeBeforeSleepProc *m_beforesleep;
     aeBeforeSleepProc *m_aftersleep;
+    aePhaseProc *m_phaseproc;
 
+    void aePhaseEnd(int phase, long long *start);
     aeTimeEvent* aeSearchNearestTimer();
     int processTimeEvents();
 
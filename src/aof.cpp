@@ -738,7 +738,10 @@ int loadAppendOnlyFile(char *filename) {
 
         /* Run the command in the context of a fake client */
         fakeClient->m_cmd = cmd;
+        memAcctFrame maf;
+        memAcctBegin(&maf,fakeClient);
         cmd->proc(fakeClient);
+        memAcctEnd(&maf);
 
         /* The fake client should not have a reply */
         serverAssert(fakeClient->m_response_buff_pos == 0 && fakeClient->m_reply->listLength() == 0);
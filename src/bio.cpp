@@ -84,7 +84,7 @@ struct bio_job {
 };
 
 void *bioProcessBackgroundJobs(void *arg);
-void lazyfreeFreeObjectFromBioThread(robj *o);
+void lazyfreeFreeObjectFromBioThread(robj *o, memAcctCounters *mc);
 void lazyfreeFreeDatabaseFromBioThread(dict *ht1, dict *ht2);
 void lazyfreeFreeSlotsMapFromBioThread(rax *sl);
 
@@ -190,11 +190,13 @@ void *bioProcessBackgroundJobs(void *arg) {
             aof_fsync((long)job->arg1);
         } else if (type == BIO_LAZY_FREE) {
             /* What we free changes depending on what arguments are set:
-             * arg1 -> free the object at pointer.
+             * arg1 -> free the object at pointer, arg2 are its memory
+             *         accounting counters, if any.
              * arg2 & arg3 -> free two dictionaries (a Redis DB).
              * only arg3 -> free the skiplist. */
             if (job->arg1)
-                lazyfreeFreeObjectFromBioThread((robj *)job->arg1);
+                lazyfreeFreeObjectFromBioThread((robj *)job->arg1,
+                                                (memAcctCounters *)job->arg2);
             else if (job->arg2 && job->arg3)
                 lazyfreeFreeDatabaseFromBioThread((dict *)job->arg2, (dict *)job->arg3);
             else if (job->arg3)
@@ -70,6 +70,15 @@ void clusterDelNode(clusterNode *delnode);
 sds representClusterNodeFlags(sds ci, uint16_t flags);
 uint64_t clusterGetMaxEpoch();
 int clusterBumpConfigEpochWithoutConsensus();
+void clusterMigrateSlotsCommand(client *c);
+void clusterImportSlotsCommand(client *c);
+void clusterSlotMigrationBeforeSleep();
+void clusterSlotMigrationCron();
+void clusterSlotMigrationCheckClaim(clusterNode *sender, unsigned char *slots);
+void clusterSlotMigrationPongReceived(clusterNode *node);
+int clusterSlotMigrationBlocksSlot(int slot);
+void clusterAbortSlotMigration(const char *reason);
+void clusterAbortSlotImport();
 
 /* -----------------------------------------------------------------------------
  * Initialization
@@ -139,6 +148,15 @@ int clusterLoadConfig(char *filename) {
                 } else if (strcasecmp(argv[j],"lastVoteEpoch") == 0) {
                     server.cluster->m_lastVoteEpoch =
                             strtoull(argv[j+1],NULL,10);
+                } else if (strcasecmp(argv[j],"slotsImport") == 0) {
+                    /* Discarded by verifyClusterConfigWithData(). */
+                    int start, stop;
+
+                    if (sscanf(argv[j+1],"%d-%d",&start,&stop) != 2 ||
+                        start < 0 || stop >= CLUSTER_SLOTS || start > stop)
+                        goto fmterr;
+                    server.cluster->m_slot_import_start = start;
+                    server.cluster->m_slot_import_end = stop;
                 } else {
                     serverLog(LL_WARNING,
                         "Skipping unknown cluster config variable '%s'",
@@ -310,11 +328,18 @@ int clusterSaveConfig(int do_fsync) {
     server.cluster->m_todo_before_sleep &= ~CLUSTER_TODO_SAVE_CONFIG;
 
     /* Get the nodes description and concatenate our "vars" directive to
-     * save currentEpoch and lastVoteEpoch. */
+     * save currentEpoch and lastVoteEpoch, and the slots we are importing
+     * with CLUSTER IMPORTSLOTS if any. */
     ci = clusterGenNodesDescription(CLUSTER_NODE_HANDSHAKE);
-    ci = sdscatprintf(ci,"vars currentEpoch %llu lastVoteEpoch %llu\n",
+    ci = sdscatprintf(ci,"vars currentEpoch %llu lastVoteEpoch %llu",
         (unsigned long long) server.cluster->m_currentEpoch,
         (unsigned long long) server.cluster->m_lastVoteEpoch);
+    if (server.cluster->m_slot_import_client) {
+        ci = sdscatprintf(ci," slotsImport %d-%d",
+            server.cluster->m_slot_import_start,
+            server.cluster->m_slot_import_end);
+    }
+    ci = sdscatlen(ci,"\n",1);
     content_size = sdslen(ci);
 
     if ((fd = open(server.cluster_configfile,O_WRONLY|O_CREAT,0644))
@@ -425,6 +450,11 @@ void clusterInit() {
         server.cluster->m_stats_bus_messages_received[i] = 0;
     }
     server.cluster->m_stats_pfail_nodes = 0;
+    server.cluster->m_slot_migration = NULL;
+    server.cluster->m_slot_import_client = NULL;
+    server.cluster->m_slot_import_start = 0;
+    server.cluster->m_slot_import_end = -1;
+    server.cluster->m_slot_import_failures = 0;
     memset(server.cluster->m_slots,0, sizeof(server.cluster->m_slots));
     clusterCloseAllSlots();
 
@@ -654,24 +684,22 @@ void clusterAcceptHandler(aeEventLoop *el, int fd, void *privdata, int mask) {
  * { and } is hashed. This may be useful in the future to force certain
  * keys to be in the same node (assuming no resharding is in progress). */
 unsigned int keyHashSlot(char *key, int keylen) {
-    int s, e; /* start-end indexes of { and } */
+    char *s, *e; /* Pointers to { and } */
 
-    for (s = 0; s < keylen; s++)
-        if (key[s] == '{') break;
+    s = (char*)memchr(key,'{',keylen);
 
     /* No '{' ? Hash the whole key. This is the base case. */
-    if (s == keylen) return crc16(key,keylen) & 0x3FFF;
+    if (s == NULL) return crc16(key,keylen) & 0x3FFF;
 
     /* '{' found? Check if we have the corresponding '}'. */
-    for (e = s+1; e < keylen; e++)
-        if (key[e] == '}') break;
+    e = (char*)memchr(s+1,'}',keylen-(s-key)-1);
 
     /* No '}' or nothing betweeen {} ? Hash the whole key. */
-    if (e == keylen || e == s+1) return crc16(key,keylen) & 0x3FFF;
+    if (e == NULL || e == s+1) return crc16(key,keylen) & 0x3FFF;
 
     /* If we are here there is both a { and a } on its right. Hash
      * what is in the middle between { and }. */
-    return crc16(key+s+1,e-s-1) & 0x3FFF;
+    return crc16(s+1,e-s-1) & 0x3FFF;
 }
 
 /* -----------------------------------------------------------------------------
@@ -902,6 +930,10 @@ void clusterDelNode(clusterNode *delnode) {
     int j;
     dictEntry *de;
 
+    if (server.cluster->m_slot_migration &&
+        server.cluster->m_slot_migration->m_target == delnode)
+        clusterAbortSlotMigration("the target node was removed");
+
     /* 1) Mark slots as unassigned. */
     for (j = 0; j < CLUSTER_SLOTS; j++) {
         if (server.cluster->m_importing_slots_from[j] == delnode)
@@ -1541,6 +1573,10 @@ void clusterUpdateSlotsConfigWith(clusterNode *sender, uint64_t senderConfigEpoc
         return;
     }
 
+    /* Complete our slots migration first if this is the target claiming
+     * the slots, so that the keys deletion is propagated. */
+    clusterSlotMigrationCheckClaim(sender,slots);
+
     for (j = 0; j < CLUSTER_SLOTS; j++) {
         if (bitmapTestBit(slots,j)) {
             /* The slot is already bound to the sender of this message. */
@@ -1829,6 +1865,7 @@ int clusterProcessPacket(clusterLink *link) {
 
         /* Update our info about the node */
         if (link->m_node && type == CLUSTERMSG_TYPE_PONG) {
+            clusterSlotMigrationPongReceived(link->m_node);
             link->m_node->m_pong_received = mstime();
             link->m_node->m_ping_sent = 0;
 
@@ -3465,6 +3502,9 @@ void clusterCron() {
             clusterHandleSlaveMigration(max_slaves);
     }
 
+    /* Check the health of the outgoing slots migration, if any. */
+    clusterSlotMigrationCron();
+
     if (update_state || server.cluster->m_state == CLUSTER_FAIL)
         clusterUpdateState();
 }
@@ -3475,6 +3515,10 @@ void clusterCron() {
  * handlers, or to perform potentially expansive tasks that we need to do
  * a single time before replying to clients. */
 void clusterBeforeSleep() {
+    /* Make progress with the slots migration. This may change the slots
+     * configuration, so it is done before updating and saving it. */
+    clusterSlotMigrationBeforeSleep();
+
     /* Handle failover, this is needed when it is likely that there is already
      * the quorum from masters in order to react fast. */
     if (server.cluster->m_todo_before_sleep & CLUSTER_TODO_HANDLE_FAILOVER)
@@ -3769,6 +3813,14 @@ int verifyClusterConfigWithData() {
         if (server.db[j].m_dict->dictSize()) return C_ERR;
     }
 
+    /* An import of slots performed with CLUSTER IMPORTSLOTS was in progress:
+     * the link with the source was lost, so it can't be resumed. Remove
+     * the keys received so far and the importing state of the slots. */
+    if (server.cluster->m_slot_import_end != -1) {
+        clusterAbortSlotImport();
+        update_config++;
+    }
+
     /* Check that all the slots we see populated memory have a corresponding
      * entry in the cluster table. Otherwise fix the table. */
     for (j = 0; j < CLUSTER_SLOTS; j++) {
@@ -4356,6 +4408,12 @@ void clusterCommand(client *c) {
         else
             c->addReplyErrorFormat("error saving the cluster node config: %s",
                 strerror(errno));
+    } else if (!strcasecmp((const char*)c->m_argv[1]->ptr,"migrateslots") && c->m_argc >= 3) {
+        /* CLUSTER MIGRATESLOTS <node ID> <start> <end> [timeout] | STATUS | ABORT */
+        clusterMigrateSlotsCommand(c);
+    } else if (!strcasecmp((const char*)c->m_argv[1]->ptr,"importslots") && c->m_argc >= 4) {
+        /* CLUSTER IMPORTSLOTS <node ID> <start> <end> | FINISH <keys> */
+        clusterImportSlotsCommand(c);
     } else if (!strcasecmp((const char*)c->m_argv[1]->ptr,"keyslot") && c->m_argc == 3) {
         /* CLUSTER KEYSLOT <key> */
         sds key = (sds)c->m_argv[2]->ptr;
@@ -5147,6 +5205,949 @@ socket_err:
     return;
 }
 
+/* -----------------------------------------------------------------------------
+ * Atomic slots migration
+ *
+ * CLUSTER MIGRATESLOTS moves a whole range of hash slots to another master
+ * without the per-key MIGRATING / IMPORTING dance, so clients never see
+ * ASK redirections and multi-key operations keep working for the whole
+ * duration of the migration. It works like a scoped replication link:
+ *
+ * 1) The source connects to the target and sends CLUSTER IMPORTSLOTS, that
+ *    flags the connection as CLIENT_SLOT_IMPORT: it is only allowed to write
+ *    the slots it imports, and its replies are not sent but checked for
+ *    errors. The target doesn't expire the imported keys by itself: like
+ *    a slave, it waits for the DEL of the source.
+ * 2) The keys of the range are serialized incrementally from
+ *    clusterBeforeSleep() as RESTORE ... REPLACE commands, following the
+ *    slots_to_keys radix tree order. The last key sent is remembered as
+ *    a cursor.
+ * 3) Meanwhile every write propagated by the source that touches a key
+ *    already sent (before the cursor) is streamed to the target as well.
+ *    Writes about keys not yet sent are ignored, since the snapshot will
+ *    transfer the updated value later.
+ * 4) Once the snapshot is complete and the backlog is small, the source
+ *    pauses its clients, like CLUSTER FAILOVER does, flushes the backlog and
+ *    sends CLUSTER IMPORTSLOTS FINISH. No write can happen on the source
+ *    meanwhile, so if all the commands of the import succeeded the target
+ *    has exactly the same data: it takes ownership of the slots (bumping
+ *    its epoch) and replies +OK, then the source drops its local copy and
+ *    unpauses the clients. Otherwise the target discards the import and
+ *    replies with an error.
+ *
+ * Any failure before the final step just closes the connection: the target
+ * removes the keys it imported so far (at startup if it was restarted) and
+ * the source keeps serving the slots as if nothing happened.
+ *
+ * Once FINISH is written instead, a timeout or a broken link doesn't tell
+ * us if the target took the slots, and resuming the writes could lose the
+ * ones acknowledged after the target announces the new configuration. So
+ * the source unpauses the clients but replies -TRYAGAIN to the commands
+ * about the slots until the outcome is known: the target claims the slots
+ * (the migration completes), replies with an error, or closes the link and
+ * later answers one of our PINGs without claiming them. Only in the last
+ * two cases the source resumes serving the slots.
+ * -------------------------------------------------------------------------- */
+
+#define SLOT_MIGRATION_DEFAULT_TIMEOUT 10000 /* Milliseconds. */
+#define SLOT_MIGRATION_STEP_TIME 1000 /* Microseconds of snapshot per cycle. */
+#define SLOT_MIGRATION_MAX_PENDING (1024*1024*4) /* Snapshot backpressure. */
+#define SLOT_MIGRATION_HANDOFF_PENDING (1024*64) /* Max backlog at handoff. */
+
+void clusterSlotMigrationWriteHandler(aeEventLoop *el, int fd, void *privdata, int mask);
+void clusterSlotMigrationReadHandler(aeEventLoop *el, int fd, void *privdata, int mask);
+
+/* Return true if 'key', hashing to 'slot', was already transferred by the
+ * snapshot, so that writes against it must be streamed to the target. */
+int clusterSlotMigrationKeySent(clusterSlotMigration *mig, unsigned int slot,
+                                robj *key)
+{
+    size_t curlen = sdslen(mig->m_cursor), keylen, minlen;
+    unsigned char indexed[2];
+    int cmp;
+
+    if (mig->m_snapshot_done) return 1;
+    if (curlen == 0) return 0;
+
+    /* Compare with the same ordering of the radix tree: two bytes of slot
+     * followed by the key name. */
+    indexed[0] = (slot >> 8) & 0xff;
+    indexed[1] = slot & 0xff;
+    cmp = memcmp(indexed,mig->m_cursor,2);
+    if (cmp != 0) return cmp < 0;
+    keylen = sdslen((sds)key->ptr);
+    minlen = (keylen < curlen-2) ? keylen : curlen-2;
+    cmp = memcmp(key->ptr,mig->m_cursor+2,minlen);
+    if (cmp != 0) return cmp < 0;
+    return keylen <= curlen-2;
+}
+
+/* Append to the migration buffer the command needed to recreate the
+ * current state of 'key' on the target: a RESTORE REPLACE, or a DEL if the
+ * key no longer exists. */
+void clusterSlotMigrationAppendKey(clusterSlotMigration *mig, robj *key) {
+    rioBufferIO cmd(mig->m_buf);
+    dictEntry *de = server.db[0].m_dict->dictFind(key->ptr);
+
+    if (de == NULL) {
+        serverAssert(cmd.rioWriteBulkCount('*',2));
+        serverAssert(cmd.rioWriteBulkString("DEL",3));
+        serverAssert(cmd.rioWriteBulkString((char*)key->ptr,
+                                            sdslen((sds)key->ptr)));
+    } else {
+        long long ttl = 0;
+        long long expireat = getExpire(&server.db[0],key);
+
+        if (expireat != -1) {
+            ttl = expireat-mstime();
+            if (ttl < 1) ttl = 1;
+        }
+        serverAssert(cmd.rioWriteBulkCount('*',5));
+        serverAssert(cmd.rioWriteBulkString("RESTORE",7));
+        serverAssert(cmd.rioWriteBulkString((char*)key->ptr,
+                                            sdslen((sds)key->ptr)));
+        serverAssert(cmd.rioWriteBulkLongLong(ttl));
+
+        rioBufferIO payload(sdsempty());
+        createDumpPayload(&payload,(robj*)de->dictGetVal());
+        serverAssert(cmd.rioWriteBulkString(payload.m_ptr,
+                                            sdslen(payload.m_ptr)));
+        sdsfree(payload.m_ptr);
+        serverAssert(cmd.rioWriteBulkString("REPLACE",7));
+    }
+    mig->m_buf = cmd.m_ptr;
+}
+
+/* Make sure the pending buffer will be flushed to the target as soon as
+ * the socket is writable. */
+void clusterSlotMigrationInstallWriteHandler(clusterSlotMigration *mig) {
+    if (mig->m_write_handler || mig->m_fd == -1 || sdslen(mig->m_buf) == 0)
+        return;
+    if (server.el->aeCreateFileEvent(mig->m_fd,AE_WRITABLE,
+            clusterSlotMigrationWriteHandler,NULL) == AE_ERR) return;
+    mig->m_write_handler = 1;
+}
+
+/* Close the connection with the target, if still open. */
+void clusterSlotMigrationCloseLink(clusterSlotMigration *mig) {
+    if (mig->m_fd == -1) return;
+    if (mig->m_write_handler)
+        server.el->aeDeleteFileEvent(mig->m_fd,AE_WRITABLE);
+    if (mig->m_handoff_time)
+        server.el->aeDeleteFileEvent(mig->m_fd,AE_READABLE);
+    close(mig->m_fd);
+    mig->m_fd = -1;
+    mig->m_write_handler = 0;
+}
+
+void clusterFreeSlotMigration(clusterSlotMigration *mig) {
+    clusterSlotMigrationCloseLink(mig);
+    sdsfree(mig->m_buf);
+    sdsfree(mig->m_cursor);
+    zfree(mig);
+}
+
+/* Return true if IMPORTSLOTS FINISH was entirely written to the target, so
+ * that it may take the ownership of the slots at any time. */
+int clusterSlotMigrationFinishSent(clusterSlotMigration *mig) {
+    return mig->m_handoff_time && mig->m_bytes_sent >= mig->m_finish_offset;
+}
+
+/* Resume the clients paused by the final step of the migration. If the
+ * outcome of the handoff was unknown they were already resumed. */
+void clusterSlotMigrationUnpauseClients(clusterSlotMigration *mig) {
+    if (mig->m_handoff_time && !mig->m_doubt_time && clientsArePaused()) {
+        server.clients_pause_end_time = 0;
+        clientsArePaused(); /* Just use the side effect of the function. */
+    }
+}
+
+/* Abort the outgoing migration, if any. Closing the link is enough for the
+ * target to discard what it imported so far. */
+void clusterAbortSlotMigration(const char *reason) {
+    clusterSlotMigration *mig = server.cluster->m_slot_migration;
+
+    if (mig == NULL) return;
+    serverLog(LL_WARNING,"Migration of slots %d-%d to %.40s aborted: %s",
+        mig->m_start_slot, mig->m_end_slot, mig->m_target->m_name, reason);
+    server.cluster->m_slot_migration = NULL;
+    clusterSlotMigrationUnpauseClients(mig);
+    clusterFreeSlotMigration(mig);
+}
+
+/* We don't know if the target processed IMPORTSLOTS FINISH: resume the
+ * clients, but keep refusing the commands about the slots, see
+ * clusterSlotMigrationBlocksSlot(), until the outcome is known. */
+void clusterSlotMigrationHandoffInDoubt(clusterSlotMigration *mig,
+                                        const char *reason)
+{
+    serverLog(LL_WARNING,"Migration of slots %d-%d to %.40s: %s after the "
+        "final step, the slots are blocked until the target configuration "
+        "is known", mig->m_start_slot, mig->m_end_slot,
+        mig->m_target->m_name, reason);
+    clusterSlotMigrationUnpauseClients(mig);
+    mig->m_doubt_time = mstime();
+}
+
+/* The connection with the target failed. Before IMPORTSLOTS FINISH is
+ * written the target just discards the import, otherwise it may have
+ * taken the slots and we must wait for its configuration. */
+void clusterSlotMigrationLinkError(clusterSlotMigration *mig,
+                                   const char *reason)
+{
+    if (!clusterSlotMigrationFinishSent(mig)) {
+        clusterAbortSlotMigration(reason);
+        return;
+    }
+    clusterSlotMigrationCloseLink(mig);
+    mig->m_target_pong = 0;
+    clusterSlotMigrationHandoffInDoubt(mig,reason);
+}
+
+void clusterSlotMigrationWriteHandler(aeEventLoop *el, int fd, void *privdata, int mask) {
+    clusterSlotMigration *mig = server.cluster->m_slot_migration;
+    ssize_t nwritten;
+    UNUSED(el);
+    UNUSED(privdata);
+    UNUSED(mask);
+
+    if (mig == NULL || mig->m_fd != fd) return;
+    nwritten = write(fd,mig->m_buf,sdslen(mig->m_buf));
+    if (nwritten <= 0) {
+        if (nwritten == -1 && errno == EAGAIN) return;
+        clusterSlotMigrationLinkError(mig,
+            "I/O error writing to the target node");
+        return;
+    }
+    sdsrange(mig->m_buf,nwritten,-1);
+    mig->m_bytes_sent += nwritten;
+    mig->m_last_io_time = mstime();
+    if (sdslen(mig->m_buf) == 0) {
+        server.el->aeDeleteFileEvent(fd,AE_WRITABLE);
+        mig->m_write_handler = 0;
+    }
+}
+
+/* Delete all the keys in the slots range, propagating the deletions to
+ * our slaves and AOF so that they stay consistent with us. Return the
+ * number of deleted keys. */
+unsigned int clusterDelKeysInSlotRange(int start, int end) {
+    raxIterator iter;
+    unsigned int deleted = 0;
+    unsigned char indexed[2];
+
+    raxStart(&iter,server.cluster->m_slots_to_keys);
+    for (int slot = start; slot <= end; slot++) {
+        indexed[0] = (slot >> 8) & 0xff;
+        indexed[1] = slot & 0xff;
+        while(server.cluster->m_slots_keys_count[slot]) {
+            robj *argv[2];
+
+            raxSeek(&iter,">=",indexed,2);
+            raxNext(&iter);
+            argv[0] = shared.del;
+            argv[1] = createStringObject((char*)iter.key+2,iter.key_len-2);
+            dbDelete(&server.db[0],argv[1]);
+            signalModifiedKey(&server.db[0],argv[1]);
+            propagate(server.delCommand,0,argv,2,
+                      PROPAGATE_AOF|PROPAGATE_REPL);
+            decrRefCount(argv[1]);
+            server.dirty++;
+            deleted++;
+        }
+    }
+    raxStop(&iter);
+    return deleted;
+}
+
+/* Serialize the next batch of keys of the snapshot, stopping when the time
+ * budget is over or the target is not consuming fast enough. */
+void clusterSlotMigrationSnapshotStep(clusterSlotMigration *mig) {
+    raxIterator iter;
+    long long start = ustime();
+    int done = 0, count = 0;
+
+    raxStart(&iter,server.cluster->m_slots_to_keys);
+    if (sdslen(mig->m_cursor)) {
+        raxSeek(&iter,">",(unsigned char*)mig->m_cursor,
+                sdslen(mig->m_cursor));
+    } else {
+        unsigned char indexed[2];
+
+        indexed[0] = (mig->m_start_slot >> 8) & 0xff;
+        indexed[1] = mig->m_start_slot & 0xff;
+        raxSeek(&iter,">=",indexed,2);
+    }
+    while(sdslen(mig->m_buf) < SLOT_MIGRATION_MAX_PENDING) {
+        if ((++count & 15) == 0 && ustime()-start > SLOT_MIGRATION_STEP_TIME)
+            break;
+        if (!raxNext(&iter)) {
+            done = 1;
+            break;
+        }
+        int slot = (iter.key[0] << 8) | iter.key[1];
+        if (slot > mig->m_end_slot) {
+            done = 1;
+            break;
+        }
+
+        robj *key = createStringObject((char*)iter.key+2,iter.key_len-2);
+        clusterSlotMigrationAppendKey(mig,key);
+        decrRefCount(key);
+        mig->m_cursor = sdscpylen(mig->m_cursor,(char*)iter.key,iter.key_len);
+        mig->m_keys_sent++;
+    }
+    raxStop(&iter);
+    if (done) mig->m_snapshot_done = 1;
+}
+
+/* Final step of the migration: pause the clients so that no write can
+ * happen in the middle, then flush the backlog and ask the target to take
+ * the ownership of the slots. The reply is handled asynchronously by
+ * clusterSlotMigrationReadHandler(). */
+void clusterSlotMigrationStartHandoff(clusterSlotMigration *mig) {
+    long long keys = 0;
+
+    for (int j = mig->m_start_slot; j <= mig->m_end_slot; j++)
+        keys += countKeysInSlot(j);
+
+    rioBufferIO cmd(mig->m_buf);
+    serverAssert(cmd.rioWriteBulkCount('*',4));
+    serverAssert(cmd.rioWriteBulkString("CLUSTER",7));
+    serverAssert(cmd.rioWriteBulkString("IMPORTSLOTS",11));
+    serverAssert(cmd.rioWriteBulkString("FINISH",6));
+    serverAssert(cmd.rioWriteBulkLongLong(keys));
+    mig->m_buf = cmd.m_ptr;
+    mig->m_finish_offset = mig->m_bytes_sent+sdslen(mig->m_buf);
+
+    if (server.el->aeCreateFileEvent(mig->m_fd,AE_READABLE,
+            clusterSlotMigrationReadHandler,NULL) == AE_ERR)
+    {
+        clusterAbortSlotMigration("can't read the reply of the target node");
+        return;
+    }
+    /* The pause lasts longer than the timeout, so that clusterCron()
+     * blocks the slots before the clients are resumed. */
+    mig->m_handoff_time = mstime();
+    mig->m_ack_len = 0;
+    pauseClients(mig->m_handoff_time+mig->m_timeout*2);
+    clusterSlotMigrationInstallWriteHandler(mig);
+}
+
+/* The target took the ownership of the slots: drop our copy of the keys
+ * and resume the clients. */
+void clusterSlotMigrationCompleteHandoff(clusterSlotMigration *mig) {
+    int start = mig->m_start_slot, end = mig->m_end_slot, j;
+    clusterNode *target = mig->m_target;
+
+    serverLog(LL_NOTICE,"Slots %d-%d migrated to %.40s: "
+        "%lld keys, %lld streamed writes, %lld bytes in %lld ms",
+        start, end, target->m_name, mig->m_keys_sent, mig->m_cmds_streamed,
+        mig->m_bytes_sent, (long long)(mstime()-mig->m_start_time));
+    server.cluster->m_slot_migration = NULL;
+
+    /* The target already bumped its epoch and is broadcasting the new
+     * configuration, we just align our view before it reaches us. */
+    for (j = start; j <= end; j++) {
+        clusterDelSlot(j);
+        target->clusterAddSlot(j);
+    }
+    clusterDelKeysInSlotRange(start,end);
+    clusterDoBeforeSleep(CLUSTER_TODO_UPDATE_STATE|
+                         CLUSTER_TODO_SAVE_CONFIG);
+    clusterSlotMigrationUnpauseClients(mig);
+    clusterFreeSlotMigration(mig);
+}
+
+/* Called when 'sender' claims the 'slots': if it is the target of our
+ * migration, that in the final step may announce the new configuration
+ * before its reply to IMPORTSLOTS FINISH reaches us (or instead of it, if
+ * the link was lost), the handoff is done. */
+void clusterSlotMigrationCheckClaim(clusterNode *sender, unsigned char *slots) {
+    clusterSlotMigration *mig = server.cluster->m_slot_migration;
+
+    if (mig && mig->m_handoff_time && sender == mig->m_target &&
+        bitmapTestBit(slots,mig->m_start_slot))
+    {
+        clusterSlotMigrationCompleteHandoff(mig);
+    }
+}
+
+/* Called when 'node' replies to our PING, before its configuration is
+ * processed. If it is the target and it closed the link in the final step,
+ * the PING was sent after it dropped the import: if the configuration it
+ * carries doesn't claim the slots, it never will. */
+void clusterSlotMigrationPongReceived(clusterNode *node) {
+    clusterSlotMigration *mig = server.cluster->m_slot_migration;
+
+    if (mig && mig->m_fd == -1 && node == mig->m_target &&
+        node->m_ping_sent > mig->m_doubt_time)
+    {
+        mig->m_target_pong = 1;
+    }
+}
+
+/* Return true if the commands about 'slot' must be refused since it is
+ * part of the final step of our migration: the target may already own it,
+ * or do so as soon as it gets IMPORTSLOTS FINISH. */
+int clusterSlotMigrationBlocksSlot(int slot) {
+    clusterSlotMigration *mig = server.cluster->m_slot_migration;
+
+    return mig && mig->m_handoff_time &&
+           slot >= mig->m_start_slot && slot <= mig->m_end_slot;
+}
+
+/* Read the reply of the target to IMPORTSLOTS FINISH. Since the replies to
+ * the import commands are never sent, it is the only line we can get. */
+void clusterSlotMigrationReadHandler(aeEventLoop *el, int fd, void *privdata, int mask) {
+    clusterSlotMigration *mig = server.cluster->m_slot_migration;
+    ssize_t nread;
+    char *nl;
+    UNUSED(el);
+    UNUSED(privdata);
+    UNUSED(mask);
+
+    if (mig == NULL || mig->m_fd != fd) return;
+    nread = read(fd,mig->m_ack+mig->m_ack_len,
+                 sizeof(mig->m_ack)-1-mig->m_ack_len);
+    if (nread <= 0) {
+        if (nread == -1 && errno == EAGAIN) return;
+        clusterSlotMigrationLinkError(mig,"I/O error reading the final ACK");
+        return;
+    }
+    mig->m_ack_len += nread;
+    mig->m_ack[mig->m_ack_len] = '\0';
+    if ((nl = strchr(mig->m_ack,'\n')) == NULL) {
+        if (mig->m_ack_len == sizeof(mig->m_ack)-1)
+            clusterSlotMigrationLinkError(mig,
+                "protocol error reading the final ACK");
+        return;
+    }
+    *nl = '\0';
+    if (nl != mig->m_ack && nl[-1] == '\r') nl[-1] = '\0';
+    if (mig->m_ack[0] == '-') {
+        /* The target refused the slots: we are still the owner. */
+        clusterAbortSlotMigration(mig->m_ack+1);
+        return;
+    } else if (mig->m_ack[0] != '+') {
+        clusterSlotMigrationLinkError(mig,
+            "protocol error reading the final ACK");
+        return;
+    }
+    clusterSlotMigrationCompleteHandoff(mig);
+}
+
+/* Called by clusterBeforeSleep() to make progress with the outgoing
+ * migration. */
+void clusterSlotMigrationBeforeSleep() {
+    clusterSlotMigration *mig = server.cluster->m_slot_migration;
+
+    if (mig == NULL) return;
+    if (!mig->m_snapshot_done) clusterSlotMigrationSnapshotStep(mig);
+    if (mig->m_snapshot_done && !mig->m_handoff_time &&
+        sdslen(mig->m_buf) <= SLOT_MIGRATION_HANDOFF_PENDING)
+    {
+        clusterSlotMigrationStartHandoff(mig);
+    } else {
+        clusterSlotMigrationInstallWriteHandler(mig);
+    }
+}
+
+/* Called by clusterCron(): abort the migration when the configuration
+ * changed under our feet or the target stopped reading, and resolve the
+ * final step when its outcome is unknown. */
+void clusterSlotMigrationCron() {
+    clusterSlotMigration *mig = server.cluster->m_slot_migration;
+    clusterNode *target;
+
+    if (mig == NULL) return;
+    if (myself->nodeIsSlave()) {
+        clusterAbortSlotMigration("this node is now a slave");
+        return;
+    }
+    for (int j = mig->m_start_slot; j <= mig->m_end_slot; j++) {
+        if (server.cluster->m_slots[j] != myself) {
+            clusterAbortSlotMigration("slots owner changed");
+            return;
+        }
+    }
+
+    /* The link was lost after FINISH: we still own the slots, so once the
+     * target replies to a PING sent after that, it didn't take them. */
+    if (mig->m_fd == -1) {
+        target = mig->m_target;
+        if (mig->m_target_pong) {
+            clusterAbortSlotMigration("the target node didn't take the slots");
+        } else if (target->m_link && target->m_ping_sent == 0 &&
+                   mstime() > mig->m_doubt_time)
+        {
+            clusterSendPing(target->m_link,CLUSTERMSG_TYPE_PING);
+        }
+        return;
+    }
+
+    if (!clusterSlotMigrationFinishSent(mig)) {
+        if (sdslen(mig->m_buf) &&
+            mstime()-mig->m_last_io_time > mig->m_timeout)
+        {
+            clusterAbortSlotMigration("timeout writing to the target node");
+        } else if (mig->m_handoff_time &&
+                   mstime()-mig->m_handoff_time > mig->m_timeout)
+        {
+            clusterAbortSlotMigration("timeout flushing the final step");
+        }
+    } else if (!mig->m_doubt_time &&
+               mstime()-mig->m_handoff_time > mig->m_timeout)
+    {
+        /* Keep the link: the reply may still arrive. */
+        clusterSlotMigrationHandoffInDoubt(mig,
+            "timeout waiting for the final ACK");
+    }
+}
+
+/* Called by propagate() for every write that reaches our slaves: forward
+ * it to the migration target if it touches keys already transferred. */
+void clusterFeedSlotMigration(struct redisCommand *cmd, int dbid, robj **argv, int argc) {
+    clusterSlotMigration *mig;
+    int *keys, numkeys, inrange = 0, verbatim = 1, j;
+
+    if (!server.cluster_enabled ||
+        (mig = server.cluster->m_slot_migration) == NULL ||
+        dbid != 0) return;
+
+    /* The target may already own the slots: nothing can be forwarded
+     * anymore, and the final step can't be aborted. */
+    if (clusterSlotMigrationFinishSent(mig)) return;
+
+    if (cmd->proc == flushallCommand || cmd->proc == flushdbCommand) {
+        clusterAbortSlotMigration("the dataset was flushed");
+        return;
+    }
+
+    /* Transactions are forwarded as a whole so that the target applies
+     * them atomically as well. An empty MULTI/EXEC is harmless. */
+    if (cmd->proc == multiCommand || cmd->proc == execCommand) {
+        mig->m_buf = catAppendOnlyGenericCommand(mig->m_buf,argc,argv);
+        clusterSlotMigrationInstallWriteHandler(mig);
+        return;
+    }
+
+    keys = getKeysFromCommand(cmd,argv,argc,&numkeys);
+    for (j = 0; j < numkeys; j++) {
+        robj *key = argv[keys[j]];
+        unsigned int slot = keyHashSlot((char*)key->ptr,sdslen((sds)key->ptr));
+
+        if ((int)slot < mig->m_start_slot || (int)slot > mig->m_end_slot)
+            continue;
+        inrange++;
+        if (!clusterSlotMigrationKeySent(mig,slot,key)) verbatim = 0;
+    }
+
+    /* The effects of scripts depend on the script cache of the target, so
+     * we always transfer their results instead. */
+    if (cmd->proc == evalCommand || cmd->proc == evalShaCommand) verbatim = 0;
+
+    if (inrange == 0) {
+        /* Nothing to do. */
+    } else if (verbatim) {
+        mig->m_buf = catAppendOnlyGenericCommand(mig->m_buf,argc,argv);
+        mig->m_cmds_streamed++;
+    } else {
+        /* Some key is yet to be sent: replaying the command on the target
+         * would not produce the same result, so send the new value of the
+         * keys already transferred. The other ones will be transferred
+         * later by the snapshot. */
+        for (j = 0; j < numkeys; j++) {
+            robj *key = argv[keys[j]];
+            unsigned int slot = keyHashSlot((char*)key->ptr,
+                                            sdslen((sds)key->ptr));
+
+            if ((int)slot < mig->m_start_slot || (int)slot > mig->m_end_slot)
+                continue;
+            if (clusterSlotMigrationKeySent(mig,slot,key)) {
+                clusterSlotMigrationAppendKey(mig,key);
+                mig->m_cmds_streamed++;
+            }
+        }
+    }
+    getKeysFreeResult(keys);
+    clusterSlotMigrationInstallWriteHandler(mig);
+}
+
+/* CLUSTER MIGRATESLOTS <node-id> <start-slot> <end-slot> [timeout-ms]
+ * CLUSTER MIGRATESLOTS STATUS
+ * CLUSTER MIGRATESLOTS ABORT */
+void clusterMigrateSlotsCommand(client *c) {
+    clusterSlotMigration *mig = server.cluster->m_slot_migration;
+    clusterNode *n;
+    int start, end, fd, j;
+    long long timeout = SLOT_MIGRATION_DEFAULT_TIMEOUT;
+    char buf[1024] = "";
+
+    if (c->m_argc == 3 && !strcasecmp((const char*)c->m_argv[2]->ptr,"status")) {
+        if (mig == NULL) {
+            c->addReply(shared.nullmultibulk);
+            return;
+        }
+        c->addReplyMultiBulkLen(18);
+        c->addReplyBulkCString("target");
+        c->addReplyBulkCBuffer(mig->m_target->m_name,CLUSTER_NAMELEN);
+        c->addReplyBulkCString("start-slot");
+        c->addReplyLongLong(mig->m_start_slot);
+        c->addReplyBulkCString("end-slot");
+        c->addReplyLongLong(mig->m_end_slot);
+        c->addReplyBulkCString("state");
+        c->addReplyBulkCString(mig->m_doubt_time ? "handoff-unknown" :
+                               mig->m_handoff_time ? "handoff" :
+                               mig->m_snapshot_done ? "streaming" : "snapshot");
+        c->addReplyBulkCString("keys-sent");
+        c->addReplyLongLong(mig->m_keys_sent);
+        c->addReplyBulkCString("writes-streamed");
+        c->addReplyLongLong(mig->m_cmds_streamed);
+        c->addReplyBulkCString("bytes-sent");
+        c->addReplyLongLong(mig->m_bytes_sent);
+        c->addReplyBulkCString("bytes-pending");
+        c->addReplyLongLong(sdslen(mig->m_buf));
+        c->addReplyBulkCString("elapsed-ms");
+        c->addReplyLongLong(mstime()-mig->m_start_time);
+        return;
+    } else if (c->m_argc == 3 && !strcasecmp((const char*)c->m_argv[2]->ptr,"abort")) {
+        if (mig == NULL) {
+            c->addReplyError("No slots migration in progress");
+            return;
+        }
+        if (clusterSlotMigrationFinishSent(mig)) {
+            c->addReplyError("The target may already own the slots, "
+                             "the final step can't be aborted");
+            return;
+        }
+        clusterAbortSlotMigration("aborted by the user");
+        c->addReply(shared.ok);
+        return;
+    } else if (c->m_argc != 5 && c->m_argc != 6) {
+        c->addReply(shared.syntaxerr);
+        return;
+    }
+
+    if (myself->nodeIsSlave()) {
+        c->addReplyError("Please use MIGRATESLOTS only with masters.");
+        return;
+    }
+    if (mig != NULL) {
+        c->addReplyError("A slots migration is already in progress");
+        return;
+    }
+    if ((n = clusterLookupNode((const char*)c->m_argv[2]->ptr)) == NULL) {
+        c->addReplyErrorFormat("I don't know about node %s",
+            (char*)c->m_argv[2]->ptr);
+        return;
+    }
+    if (n == myself || !n->nodeIsMaster() || n->nodeInHandshake() ||
+        n->nodeFailed() || n->nodeTimedOut())
+    {
+        c->addReplyError("The target must be a different, reachable master");
+        return;
+    }
+    if ((start = getSlotOrReply(c,c->m_argv[3])) == -1 ||
+        (end = getSlotOrReply(c,c->m_argv[4])) == -1) return;
+    if (start > end) {
+        c->addReplyError("Invalid slots range");
+        return;
+    }
+    if (c->m_argc == 6) {
+        if (getLongLongFromObjectOrReply(c,c->m_argv[5],&timeout,NULL) != C_OK)
+            return;
+        if (timeout <= 0) timeout = SLOT_MIGRATION_DEFAULT_TIMEOUT;
+    }
+    for (j = start; j <= end; j++) {
+        if (server.cluster->m_slots[j] != myself) {
+            c->addReplyErrorFormat("I'm not the owner of hash slot %d",j);
+            return;
+        }
+        if (server.cluster->m_migrating_slots_to[j] ||
+            server.cluster->m_importing_slots_from[j])
+        {
+            c->addReplyErrorFormat("Hash slot %d is already migrating",j);
+            return;
+        }
+    }
+
+    /* Connect and perform the handshake synchronously: it is a single
+     * round trip and lets us report errors directly to the caller. */
+    fd = anetTcpNonBlockConnect(server.neterr,n->m_ip,n->m_port);
+    if (fd == -1) {
+        c->addReplyErrorFormat("Can't connect to target node: %s",
+            server.neterr);
+        return;
+    }
+    anetEnableTcpNoDelay(server.neterr,fd);
+    if ((aeWait(fd,AE_WRITABLE,timeout) & AE_WRITABLE) == 0) {
+        close(fd);
+        c->addReplySds(
+            sdsnew("-IOERR error or timeout connecting to the target node\r\n"));
+        return;
+    }
+
+    rioBufferIO cmd(sdsempty());
+    if (server.masterauth) {
+        serverAssert(cmd.rioWriteBulkCount('*',2));
+        serverAssert(cmd.rioWriteBulkString("AUTH",4));
+        serverAssert(cmd.rioWriteBulkString(server.masterauth,
+                                            strlen(server.masterauth)));
+    }
+    serverAssert(cmd.rioWriteBulkCount('*',5));
+    serverAssert(cmd.rioWriteBulkString("CLUSTER",7));
+    serverAssert(cmd.rioWriteBulkString("IMPORTSLOTS",11));
+    serverAssert(cmd.rioWriteBulkString(myself->m_name,CLUSTER_NAMELEN));
+    serverAssert(cmd.rioWriteBulkLongLong(start));
+    serverAssert(cmd.rioWriteBulkLongLong(end));
+    if (syncWrite(fd,cmd.m_ptr,sdslen(cmd.m_ptr),timeout) !=
+        (ssize_t)sdslen(cmd.m_ptr) ||
+        (server.masterauth &&
+         (syncReadLine(fd,buf,sizeof(buf),timeout) <= 0 || buf[0] == '-')) ||
+        syncReadLine(fd,buf,sizeof(buf),timeout) <= 0 || buf[0] != '+')
+    {
+        sdsfree(cmd.m_ptr);
+        close(fd);
+        if (buf[0] == '-')
+            c->addReplyErrorFormat("Target instance replied with error: %s",
+                buf+1);
+        else
+            c->addReplySds(
+                sdsnew("-IOERR error or timeout talking to the target node\r\n"));
+        return;
+    }
+    sdsfree(cmd.m_ptr);
+
+    mig = (clusterSlotMigration *)zmalloc(sizeof(*mig));
+    mig->m_target = n;
+    mig->m_start_slot = start;
+    mig->m_end_slot = end;
+    mig->m_fd = fd;
+    mig->m_write_handler = 0;
+    mig->m_buf = sdsempty();
+    mig->m_cursor = sdsempty();
+    mig->m_snapshot_done = 0;
+    mig->m_timeout = timeout;
+    mig->m_start_time = mig->m_last_io_time = mstime();
+    mig->m_keys_sent = 0;
+    mig->m_cmds_streamed = 0;
+    mig->m_bytes_sent = 0;
+    mig->m_handoff_time = 0;
+    mig->m_finish_offset = 0;
+    mig->m_doubt_time = 0;
+    mig->m_target_pong = 0;
+    mig->m_ack_len = 0;
+    server.cluster->m_slot_migration = mig;
+    serverLog(LL_NOTICE,"Migrating slots %d-%d to %.40s",start,end,n->m_name);
+    c->addReply(shared.ok);
+}
+
+/* Stop importing slots, removing what was received so far. */
+void clusterAbortSlotImport() {
+    int start = server.cluster->m_slot_import_start;
+    int end = server.cluster->m_slot_import_end;
+    unsigned int deleted;
+
+    for (int j = start; j <= end; j++)
+        server.cluster->m_importing_slots_from[j] = NULL;
+    server.cluster->m_slot_import_client = NULL;
+    server.cluster->m_slot_import_start = 0;
+    server.cluster->m_slot_import_end = -1;
+    deleted = clusterDelKeysInSlotRange(start,end);
+    serverLog(LL_WARNING,"Import of slots %d-%d aborted, %u keys removed",
+        start, end, deleted);
+    clusterDoBeforeSleep(CLUSTER_TODO_SAVE_CONFIG);
+}
+
+/* Called when a client is freed: if it is the importing link the source
+ * gave up, so the partial import is discarded. */
+void clusterSlotImportClientFreed(client *c) {
+    if (server.cluster_enabled && server.cluster->m_slot_import_client == c)
+        clusterAbortSlotImport();
+}
+
+/* Return true if 'key' belongs to the slots a node is migrating to us. */
+int clusterSlotImportHasKey(sds key) {
+    int slot;
+
+    if (server.cluster->m_slot_import_client == NULL) return 0;
+    slot = keyHashSlot(key,sdslen(key));
+    return slot >= server.cluster->m_slot_import_start &&
+           slot <= server.cluster->m_slot_import_end;
+}
+
+/* Return true if all the keys of the command sent by the node migrating
+ * slots to us belong to the imported slots. */
+int clusterSlotImportAllowsCommand(client *c) {
+    int *keys, numkeys, allowed = 1;
+
+    keys = getKeysFromCommand(c->m_cmd,c->m_argv,c->m_argc,&numkeys);
+    for (int j = 0; j < numkeys && allowed; j++)
+        allowed = clusterSlotImportHasKey((sds)c->m_argv[keys[j]]->ptr);
+    getKeysFreeResult(keys);
+    return allowed;
+}
+
+/* Return the number of error replies, at any nesting level, in the
+ * protocol 'p' of 'len' bytes, setting '*first' to the first one. */
+static long long clusterCountErrorReplies(const char *p, size_t len,
+                                          const char **first)
+{
+    const char *end = p+len, *nl;
+    long long errors = 0;
+
+    while(p < end && (nl = (const char*)memchr(p,'\n',end-p)) != NULL) {
+        if (*p == '-') {
+            if (errors++ == 0) *first = p+1;
+        } else if (*p == '$') {
+            long long bulklen = strtoll(p+1,NULL,10);
+
+            if (bulklen >= 0) nl += bulklen+2;
+        }
+        p = nl+1;
+    }
+    return errors;
+}
+
+/* Called after every command sent by the node migrating slots to us. The
+ * replies are not sent, but an error means we failed to apply a write the
+ * source applied, for instance because of maxmemory, so we count them in
+ * order to fail the import on FINISH. The replies are then discarded. */
+void clusterSlotImportCheckReplies(client *c) {
+    sds reply = sdsnewlen(c->m_response_buff,c->m_response_buff_pos);
+    const char *err = NULL;
+    listNode *ln;
+    long long errors;
+
+    while((ln = c->m_reply->listFirst()) != NULL) {
+        sds node = (sds)ln->listNodeValue();
+
+        if (node) reply = sdscatsds(reply,node);
+        c->m_reply->listDelNode(ln);
+    }
+    c->m_response_buff_pos = 0;
+    c->m_already_sent_len = 0;
+    c->m_reply_bytes = 0;
+
+    errors = clusterCountErrorReplies(reply,sdslen(reply),&err);
+    if (errors) {
+        if (server.cluster->m_slot_import_failures == 0) {
+            serverLog(LL_WARNING,"Slots import: a command failed: %.*s",
+                (int)strcspn(err,"\r\n"), err);
+        }
+        server.cluster->m_slot_import_failures += errors;
+    }
+    sdsfree(reply);
+}
+
+/* CLUSTER IMPORTSLOTS <source-node-id> <start-slot> <end-slot>
+ * CLUSTER IMPORTSLOTS FINISH <keys-count>
+ *
+ * Internal command sent by a node performing CLUSTER MIGRATESLOTS. */
+void clusterImportSlotsCommand(client *c) {
+    int start, end, j;
+
+    if (c->m_argc == 4 && !strcasecmp((const char*)c->m_argv[2]->ptr,"finish")) {
+        long long expected, keys = 0;
+
+        if (c != server.cluster->m_slot_import_client) {
+            c->addReplyError("This connection is not importing slots");
+            return;
+        }
+        /* From now on the replies are sent again. */
+        c->m_flags &= ~CLIENT_SLOT_IMPORT;
+        if (getLongLongFromObject(c->m_argv[3],&expected) != C_OK)
+            expected = -1;
+
+        /* Since we don't expire the imported keys by ourselves, we must
+         * have exactly the keys of the source unless something failed. */
+        start = server.cluster->m_slot_import_start;
+        end = server.cluster->m_slot_import_end;
+        for (j = start; j <= end; j++) keys += countKeysInSlot(j);
+        if (server.cluster->m_slot_import_failures || keys != expected) {
+            long long failures = server.cluster->m_slot_import_failures;
+
+            clusterAbortSlotImport();
+            c->addReplyErrorFormat("Import failed: %lld failed commands, "
+                "%lld keys imported but %lld expected",
+                failures, keys, expected);
+            return;
+        }
+
+        for (j = start; j <= end; j++) {
+            server.cluster->m_importing_slots_from[j] = NULL;
+            clusterDelSlot(j);
+            myself->clusterAddSlot(j);
+        }
+        server.cluster->m_slot_import_client = NULL;
+        server.cluster->m_slot_import_start = 0;
+        server.cluster->m_slot_import_end = -1;
+        clusterBumpConfigEpochWithoutConsensus();
+        clusterSaveConfigOrDie(1);
+        clusterDoBeforeSleep(CLUSTER_TODO_UPDATE_STATE);
+        clusterBroadcastPong(CLUSTER_BROADCAST_ALL);
+        serverLog(LL_NOTICE,"Imported slots %d-%d (%lld keys)",
+            start, end, keys);
+        c->addReply(shared.ok);
+        return;
+    } else if (c->m_argc != 5) {
+        c->addReply(shared.syntaxerr);
+        return;
+    }
+
+    clusterNode *n;
+
+    if (myself->nodeIsSlave()) {
+        c->addReplyError("Only masters can import slots");
+        return;
+    }
+    if (server.cluster->m_slot_import_client) {
+        c->addReplyError("A slots import is already in progress");
+        return;
+    }
+    if ((n = clusterLookupNode((const char*)c->m_argv[2]->ptr)) == NULL) {
+        c->addReplyErrorFormat("I don't know about node %s",
+            (char*)c->m_argv[2]->ptr);
+        return;
+    }
+    if ((start = getSlotOrReply(c,c->m_argv[3])) == -1 ||
+        (end = getSlotOrReply(c,c->m_argv[4])) == -1) return;
+    if (start > end) {
+        c->addReplyError("Invalid slots range");
+        return;
+    }
+    for (j = start; j <= end; j++) {
+        if (server.cluster->m_slots[j] != n) {
+            c->addReplyErrorFormat("Hash slot %d is not served by %.40s",
+                j, n->m_name);
+            return;
+        }
+        if (server.cluster->m_importing_slots_from[j] ||
+            server.cluster->m_migrating_slots_to[j] ||
+            countKeysInSlot(j) != 0)
+        {
+            c->addReplyErrorFormat("Hash slot %d is not empty or stable",j);
+            return;
+        }
+    }
+
+    for (j = start; j <= end; j++)
+        server.cluster->m_importing_slots_from[j] = n;
+    server.cluster->m_slot_import_client = c;
+    server.cluster->m_slot_import_start = start;
+    server.cluster->m_slot_import_end = end;
+    server.cluster->m_slot_import_failures = 0;
+    clusterDoBeforeSleep(CLUSTER_TODO_SAVE_CONFIG);
+    serverLog(LL_NOTICE,"Importing slots %d-%d from %.40s",
+        start, end, n->m_name);
+
+    /* From now on this link streams writes: the replies are not sent but
+     * checked by clusterSlotImportCheckReplies(). */
+    c->addReply(shared.ok);
+    c->m_flags |= CLIENT_SLOT_IMPORT;
+}
+
 /* -----------------------------------------------------------------------------
  * Cluster functions related to serving / redirecting clients
  * -------------------------------------------------------------------------- */
@@ -5207,6 +6208,9 @@ void readwriteCommand(client *c) {
  * belonging to the same slot, but the slot is not stable (in migration or
  * importing state, likely because a resharding is in progress).
  *
+ * CLUSTER_REDIR_HANDOFF if the slot is in the final step of a
+ * CLUSTER MIGRATESLOTS, so we may no longer be its owner.
+ *
  * CLUSTER_REDIR_DOWN_UNBOUND if the request addresses a slot which is
  * not bound to any node. In this case the cluster global state should be
  * already "down" but it is fragile to rely on the update of the global state,
@@ -5332,6 +6336,13 @@ clusterNode *getNodeByQuery(client *c, struct redisCommand *cmd, robj **argv, in
     /* Return the hashslot by reference. */
     if (hashslot) *hashslot = slot;
 
+    /* We are handing the slot off with CLUSTER MIGRATESLOTS and the target
+     * may already own it: the client has to retry later. */
+    if (n == myself && clusterSlotMigrationBlocksSlot(slot)) {
+        if (error_code) *error_code = CLUSTER_REDIR_HANDOFF;
+        return NULL;
+    }
+
     /* MIGRATE always works in the context of the local node if the slot
      * is open (migrating or importing state). We need to be able to freely
      * move keys among instances in this case. */
@@ -5392,6 +6403,8 @@ void clusterRedirectClient(client *c, clusterNode *n, int hashslot, int error_co
          * but the slot is not "stable" currently as there is
          * a migration or import in progress. */
         c->addReplySds(sdsnew("-TRYAGAIN Multiple keys request during rehashing of slot\r\n"));
+    } else if (error_code == CLUSTER_REDIR_HANDOFF) {
+        c->addReplySds(sdsnew("-TRYAGAIN Hash slot ownership is being transferred\r\n"));
     } else if (error_code == CLUSTER_REDIR_DOWN_STATE) {
         c->addReplySds(sdsnew("-CLUSTERDOWN The cluster is down\r\n"));
     } else if (error_code == CLUSTER_REDIR_DOWN_UNBOUND) {
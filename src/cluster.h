@@ -33,6 +33,7 @@
 #define CLUSTER_REDIR_MOVED 4         /* -MOVED redirection required. */
 #define CLUSTER_REDIR_DOWN_STATE 5    /* -CLUSTERDOWN, global state. */
 #define CLUSTER_REDIR_DOWN_UNBOUND 6  /* -CLUSTERDOWN, unbound slot. */
+#define CLUSTER_REDIR_HANDOFF 7       /* -TRYAGAIN, slot being handed off. */
 
 struct clusterNode;
 
@@ -151,6 +152,35 @@ public:
     list *m_fail_reports;         /* List of nodes signaling this as failing */
 };
 
+/* State of an atomic slot migration started with CLUSTER MIGRATESLOTS on the
+ * node that currently owns the slots. See the "Atomic slots migration"
+ * section in cluster.c for the details of the protocol. */
+struct clusterSlotMigration {
+    clusterNode *m_target;      /* Node receiving the slots. */
+    int m_start_slot;           /* First slot of the migrated range. */
+    int m_end_slot;             /* Last slot of the migrated range. */
+    int m_fd;                   /* Connection with the target node. */
+    int m_write_handler;        /* True if the writable handler is installed. */
+    sds m_buf;                  /* Protocol still to send to the target. */
+    sds m_cursor;               /* Last slot-prefixed key of the snapshot
+                                   already sent, empty if nothing was sent. */
+    int m_snapshot_done;        /* All the keys were queued as RESTORE. */
+    mstime_t m_timeout;         /* I/O and final pause timeout. */
+    mstime_t m_start_time;      /* Migration start time. */
+    mstime_t m_last_io_time;    /* Last time we could write to the target. */
+    long long m_keys_sent;      /* Keys serialized by the snapshot. */
+    long long m_cmds_streamed;  /* Writes forwarded while migrating. */
+    long long m_bytes_sent;     /* Total bytes transferred. */
+    mstime_t m_handoff_time;    /* Start of the final step, 0 before it. */
+    long long m_finish_offset;  /* 'm_bytes_sent' once FINISH is written. */
+    mstime_t m_doubt_time;      /* When the outcome of FINISH became unknown
+                                   (or the link was lost), 0 if it is not. */
+    int m_target_pong;          /* The target answered a PING sent after the
+                                   link was lost without taking the slots. */
+    char m_ack[256];            /* Reply to IMPORTSLOTS FINISH read so far. */
+    int m_ack_len;              /* Bytes used in 'm_ack'. */
+};
+
 struct clusterState {
     clusterNode *m_myself;  /* This node */
     uint64_t m_currentEpoch;
@@ -163,6 +193,13 @@ struct clusterState {
     clusterNode *m_slots[CLUSTER_SLOTS];
     uint64_t m_slots_keys_count[CLUSTER_SLOTS];
     rax *m_slots_to_keys;
+    /* Atomic slots migration: outgoing migration state, and incoming import
+     * connection with the range of slots it is allowed to write. */
+    clusterSlotMigration *m_slot_migration;
+    client *m_slot_import_client;
+    int m_slot_import_start;
+    int m_slot_import_end;
+    long long m_slot_import_failures; /* Commands of the import that failed. */
     /* The following fields are used to take the slave state on elections. */
     mstime_t m_failover_auth_time; /* Time of previous or next election. */
     int m_failover_auth_count;    /* Number of votes received so far. */
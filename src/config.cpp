@@ -340,6 +340,25 @@ void loadServerConfigFromString(char *config) {
                 err = "lfu-decay-time must be 0 or greater";
                 goto loaderr;
             }
+        } else if (!strcasecmp(argv[0],"hotkeys-sample-ratio") && argc == 2) {
+            server.hotkeys_sample_ratio = atoi(argv[1]);
+            if (server.hotkeys_sample_ratio < 0) {
+                err = "hotkeys-sample-ratio must be 0 or greater";
+                goto loaderr;
+            }
+        } else if (!strcasecmp(argv[0],"memory-prefix-delimiters") && argc == 2) {
+            if (argv[1][0] == '\0') {
+                err = "memory-prefix-delimiters can't be empty";
+                goto loaderr;
+            }
+            zfree(server.memory_prefix_delimiters);
+            server.memory_prefix_delimiters = zstrdup(argv[1]);
+        } else if (!strcasecmp(argv[0],"memory-prefix-budget") && argc == 2) {
+            server.memory_prefix_budget = strtoll(argv[1],NULL,10);
+            if (server.memory_prefix_budget <= 0) {
+                err = "memory-prefix-budget must be 1 or greater";
+                goto loaderr;
+            }
         } else if (!strcasecmp(argv[0],"slaveof") && argc == 3) {
             slaveof_linenum = linenum;
             server.masterhost = sdsnew(argv[1]);
@@ -403,6 +422,10 @@ void loadServerConfigFromString(char *config) {
             if ((server.rdb_checksum = yesnotoi(argv[1])) == -1) {
                 err = "argument must be 'yes' or 'no'"; goto loaderr;
             }
+        } else if (!strcasecmp(argv[0],"memory-accounting") && argc == 2) {
+            if ((server.memory_accounting = yesnotoi(argv[1])) == -1) {
+                err = "argument must be 'yes' or 'no'"; goto loaderr;
+            }
         } else if (!strcasecmp(argv[0],"activerehashing") && argc == 2) {
             if ((server.activerehashing = yesnotoi(argv[1])) == -1) {
                 err = "argument must be 'yes' or 'no'"; goto loaderr;
@@ -844,6 +867,10 @@ void configSetCommand(client *c) {
         if (sdslen((sds)o->ptr) > CONFIG_AUTHPASS_MAX_LEN) goto badfmt;
         zfree(server.requirepass);
         server.requirepass = ((char*)o->ptr)[0] ? zstrdup((const char *)o->ptr) : NULL;
+    } config_set_special_field("memory-prefix-delimiters") {
+        if (((char*)o->ptr)[0] == '\0') goto badfmt;
+        zfree(server.memory_prefix_delimiters);
+        server.memory_prefix_delimiters = zstrdup((const char *)o->ptr);
     } config_set_special_field("masterauth") {
         zfree(server.masterauth);
         server.masterauth = ((char*)o->ptr)[0] ? zstrdup((const char *)o->ptr) : NULL;
@@ -1042,6 +1069,10 @@ void configSetCommand(client *c) {
       "lfu-log-factor",server.lfu_log_factor,0,LLONG_MAX) {
     } config_set_numerical_field(
       "lfu-decay-time",server.lfu_decay_time,0,LLONG_MAX) {
+    } config_set_numerical_field(
+      "hotkeys-sample-ratio",server.hotkeys_sample_ratio,0,INT_MAX) {
+    } config_set_numerical_field(
+      "memory-prefix-budget",server.memory_prefix_budget,1,LLONG_MAX) {
     } config_set_numerical_field(
       "timeout",server.maxidletime,0,LONG_MAX) {
     } config_set_numerical_field(
@@ -1212,6 +1243,7 @@ void configGetCommand(client *c) {
     config_get_string_field("dbfilename",server.rdb_filename);
     config_get_string_field("requirepass",server.requirepass);
     config_get_string_field("masterauth",server.masterauth);
+    config_get_string_field("memory-prefix-delimiters",server.memory_prefix_delimiters);
     config_get_string_field("cluster-announce-ip",server.cluster_announce_ip);
     config_get_string_field("unixsocket",server.unixsocket);
     config_get_string_field("logfile",server.logfile);
@@ -1223,6 +1255,8 @@ void configGetCommand(client *c) {
     config_get_numerical_field("maxmemory-samples",server.maxmemory_samples);
     config_get_numerical_field("lfu-log-factor",server.lfu_log_factor);
     config_get_numerical_field("lfu-decay-time",server.lfu_decay_time);
+    config_get_numerical_field("hotkeys-sample-ratio",server.hotkeys_sample_ratio);
+    config_get_numerical_field("memory-prefix-budget",server.memory_prefix_budget);
     config_get_numerical_field("timeout",server.maxidletime);
     config_get_numerical_field("active-defrag-threshold-lower",server.active_defrag_threshold_lower);
     config_get_numerical_field("active-defrag-threshold-upper",server.active_defrag_threshold_upper);
@@ -1293,6 +1327,7 @@ void configGetCommand(client *c) {
     config_get_bool_field("rdbcompression", server.rdb_compression);
     config_get_bool_field("rdbchecksum", server.rdb_checksum);
     config_get_bool_field("activerehashing", server.activerehashing);
+    config_get_bool_field("memory-accounting", server.memory_accounting);
     config_get_bool_field("activedefrag", server.active_defrag_enabled);
     config_get_bool_field("protected-mode", server.protected_mode);
     config_get_bool_field("repl-disable-tcp-nodelay",
@@ -1995,6 +2030,9 @@ int rewriteConfig(char *path) {
     rewriteConfigNumericalOption(state,"maxmemory-samples",server.maxmemory_samples,CONFIG_DEFAULT_MAXMEMORY_SAMPLES);
     rewriteConfigNumericalOption(state,"lfu-log-factor",server.lfu_log_factor,CONFIG_DEFAULT_LFU_LOG_FACTOR);
     rewriteConfigNumericalOption(state,"lfu-decay-time",server.lfu_decay_time,CONFIG_DEFAULT_LFU_DECAY_TIME);
+    rewriteConfigNumericalOption(state,"hotkeys-sample-ratio",server.hotkeys_sample_ratio,CONFIG_DEFAULT_HOTKEYS_SAMPLE_RATIO);
+    rewriteConfigStringOption(state,"memory-prefix-delimiters",server.memory_prefix_delimiters,CONFIG_DEFAULT_MEMORY_PREFIX_DELIMITERS);
+    rewriteConfigNumericalOption(state,"memory-prefix-budget",server.memory_prefix_budget,CONFIG_DEFAULT_MEMORY_PREFIX_BUDGET);
     rewriteConfigNumericalOption(state,"active-defrag-threshold-lower",server.active_defrag_threshold_lower,CONFIG_DEFAULT_DEFRAG_THRESHOLD_LOWER);
     rewriteConfigNumericalOption(state,"active-defrag-threshold-upper",server.active_defrag_threshold_upper,CONFIG_DEFAULT_DEFRAG_THRESHOLD_UPPER);
     rewriteConfigBytesOption(state,"active-defrag-ignore-bytes",server.active_defrag_ignore_bytes,CONFIG_DEFAULT_DEFRAG_IGNORE_BYTES);
@@ -2026,6 +2064,7 @@ int rewriteConfig(char *path) {
     rewriteConfigNumericalOption(state,"zset-max-ziplist-value",server.zset_max_ziplist_value,OBJ_ZSET_MAX_ZIPLIST_VALUE);
     rewriteConfigNumericalOption(state,"hll-sparse-max-bytes",server.hll_sparse_max_bytes,CONFIG_DEFAULT_HLL_SPARSE_MAX_BYTES);
     rewriteConfigYesNoOption(state,"activerehashing",server.activerehashing,CONFIG_DEFAULT_ACTIVE_REHASHING);
+    rewriteConfigYesNoOption(state,"memory-accounting",server.memory_accounting,CONFIG_DEFAULT_MEMORY_ACCOUNTING);
     rewriteConfigYesNoOption(state,"activedefrag",server.active_defrag_enabled,CONFIG_DEFAULT_ACTIVE_DEFRAG);
     rewriteConfigYesNoOption(state,"protected-mode",server.protected_mode,CONFIG_DEFAULT_PROTECTED_MODE);
     rewriteConfigClientoutputbufferlimitOption(state);
@@ -2078,6 +2117,8 @@ void configCommand(client *c) {
         if (c->m_argc != 2) goto badarity;
         resetServerStats();
         resetCommandTableStats();
+        latencyResetPhases();
+        luaResetScriptsStats();
         c->addReply(shared.ok);
     } else if (!strcasecmp((const char*)c->m_argv[1]->ptr,"rewrite")) {
         if (c->m_argc != 2) goto badarity;
@@ -55,6 +55,19 @@ robj *lookupKey(redisDb *db, robj *key, int flags) {
     if (de) {
         robj *val = (robj *)de->dictGetVal();
 
+        memAcctLookup(db,val->type);
+
+        /* Sample the access for the hot keys tracking. Lookups that don't
+         * touch the key are not real accesses, and may run in module
+         * threads holding the read lock. */
+        if (server.hotkeys_sample_ratio && !(flags & LOOKUP_NOTOUCH)) {
+            memAcctFrame maf;
+
+            memAcctBeginNested(&maf);
+            hotkeysSample(db,key);
+            memAcctEnd(&maf);
+        }
+
         /* Update the access time for the ageing algorithm.
          * Don't do it if we have a saving child, as this will trigger
          * a copy on write madness. */
@@ -144,8 +157,13 @@ robj *lookupKeyRead(redisDb *db, robj *key) {
  * Returns the linked value object if the key exists or NULL if the key
  * does not exist in the specified DB. */
 robj *lookupKeyWrite(redisDb *db, robj *key) {
+    robj *val;
+
     expireIfNeeded(db,key);
-    return lookupKey(db,key,LOOKUP_NONE);
+    val = lookupKey(db,key,LOOKUP_NONE);
+    /* The key may be created: account what follows to its DB. */
+    if (val == NULL) memAcctLookup(db,MEMACCT_PENDING);
+    return val;
 }
 
 robj *lookupKeyReadOrReply(client *c, robj *key, robj *reply) {
@@ -167,11 +185,20 @@ robj *lookupKeyWriteOrReply(client *c, robj *key, robj *reply) {
  *
  * The program is aborted if the key already exists. */
 void dbAdd(redisDb *db, robj *key, robj *val) {
+    memAcctTouch(db,val->type);
+    memAcctStoreValue(db,val);
+
     sds copy = sdsdup((sds)key->ptr);
     int retval = db->m_dict->dictAdd(copy, val);
 
     serverAssertWithInfo(NULL,key,retval == DICT_OK);
-    if (val->type == OBJ_LIST) signalListAsReady(db, key);
+    if (val->type == OBJ_LIST) {
+        memAcctFrame maf;
+
+        memAcctBeginNested(&maf);
+        signalListAsReady(db, key);
+        memAcctEnd(&maf);
+    }
     if (server.cluster_enabled) slotToKeyAdd(key);
  }
 
@@ -184,6 +211,8 @@ void dbOverwrite(redisDb *db, robj *key, robj *val) {
     dictEntry *de = db->m_dict->dictFind(key->ptr);
 
     serverAssertWithInfo(NULL,key,de != NULL);
+    /* Release the old value as its type, then account the new one. */
+    memAcctTouch(db,((robj*)de->dictGetVal())->type);
     if (server.maxmemory_policy & MAXMEMORY_FLAG_LFU) {
         robj* old = (robj*)de->dictGetVal();
         int saved_lru = old->lru;
@@ -195,6 +224,8 @@ void dbOverwrite(redisDb *db, robj *key, robj *val) {
     } else {
         db->m_dict->dictReplace(key->ptr, val);
     }
+    memAcctTouch(db,val->type);
+    memAcctStoreValue(db,val);
 }
 
 /* High level Set operation. This function can be used in order to set
@@ -248,15 +279,25 @@ robj *dbRandomKey(redisDb *db) {
 
 /* Delete a key, value, and associated expiration entry if any, from the DB */
 int dbSyncDelete(redisDb *db, robj *key) {
+    memAcctFrame maf;
+    int deleted = 0;
+
+    /* Keys may be deleted outside commands, by expires and evictions. */
+    memAcctBegin(&maf,NULL);
+    if (maf.open) {
+        dictEntry *de = db->m_dict->dictFind(key->ptr);
+        if (de) memAcctTouch(db,((robj*)de->dictGetVal())->type);
+    }
+
     /* Deleting an entry from the expires dict will not free the sds of
      * the key, because it is shared with the main dictionary. */
     if (db->m_expires->dictSize() > 0) db->m_expires->dictDelete(key->ptr);
     if (db->m_dict->dictDelete(key->ptr) == DICT_OK) {
         if (server.cluster_enabled) slotToKeyDel(key);
-        return 1;
-    } else {
-        return 0;
+        deleted = 1;
     }
+    memAcctEnd(&maf);
+    return deleted;
 }
 
 /* This is a wrapper whose behavior depends on the Redis lazy free
@@ -327,6 +368,7 @@ long long emptyDb(int dbnum, int flags, void(callback)(void*)) {
         return -1;
     }
 
+    memAcctDetach();
     for (j = 0; j < server.dbnum; j++) {
         if (dbnum != -1 && dbnum != j) continue;
         removed += server.db[j].m_dict->dictSize();
@@ -336,6 +378,7 @@ long long emptyDb(int dbnum, int flags, void(callback)(void*)) {
             server.db[j].m_dict->dictEmpty(callback);
             server.db[j].m_expires->dictEmpty(callback);
         }
+        memAcctResetCounters(&server.db[j]);
     }
     if (server.cluster_enabled) {
         if (async) {
@@ -366,6 +409,7 @@ int client::selectDb(int id) {
 
 void signalModifiedKey(redisDb *db, robj *key) {
     touchWatchedKey(db,key);
+    memAcctDetach();
 }
 
 void signalFlushedDb(int dbid) {
@@ -937,6 +981,14 @@ void moveCommand(client *c) {
     if (expire != -1) setExpire(c,dst,c->m_argv[1],expire);
     incrRefCount(o);
 
+    /* The value is not allocated again, so we can only move its estimated
+     * size from a DB to the other. */
+    if (server.memory_accounting) {
+        long long usage = objectComputeSize(o,OBJ_COMPUTE_SIZE_DEF_SAMPLES);
+        memAcctCharge(src,o->type,-usage);
+        memAcctCharge(dst,o->type,usage);
+    }
+
     /* OK! key moved, free the entry in the source DB */
     dbDelete(src,c->m_argv[1]);
     server.dirty++;
@@ -976,13 +1028,18 @@ int dbSwapDatabases(int id1, int id2) {
     /* Swap hash tables. Note that we don't swap blocking_keys,
      * ready_keys and watched_keys, since we want clients to
      * remain in the same DB they were. */
+    memAcctDetach();
     db1->m_dict = db2->m_dict;
     db1->m_expires = db2->m_expires;
     db1->m_avg_ttl = db2->m_avg_ttl;
+    db1->m_hotkeys = db2->m_hotkeys;
+    db1->m_memacct = db2->m_memacct;
 
     db2->m_dict = aux.m_dict;
     db2->m_expires = aux.m_expires;
     db2->m_avg_ttl = aux.m_avg_ttl;
+    db2->m_hotkeys = aux.m_hotkeys;
+    db2->m_memacct = aux.m_memacct;
 
     /* Now we need to handle clients blocked on lists: as an effect
      * of swapping the two DBs, a client that was waiting for list
@@ -1048,6 +1105,7 @@ void setExpire(client *c, redisDb *db, robj *key, long long when) {
     /* Reuse the sds from the main dict in the expire dict */
     kde = db->m_dict->dictFind(key->ptr);
     serverAssertWithInfo(NULL,key,kde != NULL);
+    memAcctTouch(db,((robj*)kde->dictGetVal())->type);
     de = db->m_expires->dictAddOrFind(kde->dictGetKey());
     de->dictSetSignedIntegerVal(when);
 
@@ -1081,7 +1139,9 @@ long long getExpire(redisDb *db, robj *key) {
  * keys. */
 void propagateExpire(redisDb *db, robj *key, int lazy) {
     robj *argv[2];
+    memAcctFrame maf;
 
+    memAcctBeginNested(&maf);
     argv[0] = lazy ? shared.unlink : shared.del;
     argv[1] = key;
     incrRefCount(argv[0]);
@@ -1090,9 +1150,12 @@ void propagateExpire(redisDb *db, robj *key, int lazy) {
     if (server.aof_state != AOF_OFF)
         feedAppendOnlyFile(server.delCommand,db->m_id,argv,2);
     replicationFeedSlaves(server.slaves,db->m_id,argv,2);
+    if (server.cluster_enabled)
+        clusterFeedSlotMigration(server.delCommand,db->m_id,argv,2);
 
     decrRefCount(argv[0]);
     decrRefCount(argv[1]);
+    memAcctEnd(&maf);
 }
 
 int expireIfNeeded(redisDb *db, robj *key) {
@@ -1120,6 +1183,11 @@ int expireIfNeeded(redisDb *db, robj *key) {
      * we think the key is expired at this time. */
     if (server.masterhost != NULL) return now > when;
 
+    /* The same applies to the keys a node is migrating to us with CLUSTER
+     * MIGRATESLOTS: the source sends a DEL when they expire. */
+    if (server.cluster_enabled && clusterSlotImportHasKey((sds)key->ptr))
+        return now > when;
+
     /* Return when this key has not expired */
     if (now <= when) return 0;
 
@@ -1368,7 +1436,9 @@ int *georadiusGetKeys(struct redisCommand *cmd, robj **argv, int argc, int *numk
  * while rehashing the cluster and in other conditions when we need to
  * understand if we have keys for a given hash slot. */
 void slotToKeyUpdateKey(robj *key, int add) {
-    unsigned int hashslot = keyHashSlot((char*)key->ptr,sdslen((sds)key->ptr));
+    unsigned int hashslot = (server.executing_slot != -1) ?
+        server.executing_slot :
+        keyHashSlot((char*)key->ptr,sdslen((sds)key->ptr));
     unsigned char buf[64];
     unsigned char *indexed = buf;
     size_t keylen = sdslen((sds)key->ptr);
@@ -65,6 +65,13 @@ std::ofstream outer("/Users/shai/Desktop/redispp.out.txt", std::ios::app);
 static int dict_can_resize = 1;
 static unsigned int dict_force_resize_ratio = 5;
 
+/* Using dictPauseRehashing() / dictResumeRehashing() a thread that only
+ * performs lookups, while other threads are guaranteed to not touch the
+ * dictionaries, can stop the lookups from performing incremental rehashing
+ * steps, so that concurrent readers never modify the dictionaries. The
+ * setting is per thread. */
+static __thread int dict_rehash_paused = 0;
+
 /* -------------------------- private prototypes ---------------------------- */
 
 static int _dictExpandIfNeeded(dict *ht);
@@ -106,7 +113,7 @@ static dictEntry* dictEntryCreate(dictEntry *next_entry)
 static void dictEntryRelease(dictEntry* in_to_release)
 {
     in_to_release->~dictEntry();
-    zfree(in_to_release);
+    zfree_with_size(in_to_release,sizeof(dictEntry));
 }
 
 dictEntry::dictEntry(dictEntry *next_entry)
@@ -320,7 +327,7 @@ int dictRehashMilliseconds(dict *d, int ms) {
  * while it is actively used. */
 void dict::_dictRehashStep()
 {
-    if (m_iterators == 0)
+    if (m_iterators == 0 && !dict_rehash_paused)
         dictRehash(1);
 }
 
@@ -641,7 +648,7 @@ dictEntry* dictIterator::dictNext()
 void dictReleaseIterator(dictIterator *iter)
 {
     iter->~dictIterator();
-    zfree(iter);
+    zfree_with_size(iter,sizeof(dictIterator));
 }
 
 /* Return a random entry from the hash table. Useful to
@@ -1030,6 +1037,14 @@ void dictDisableResize() {
     dict_can_resize = 0;
 }
 
+void dictPauseRehashing() {
+    dict_rehash_paused++;
+}
+
+void dictResumeRehashing() {
+    dict_rehash_paused--;
+}
+
 unsigned int dict::dictGetHash(const void *key) {
     return dictHashKey(key);
 }
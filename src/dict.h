@@ -279,6 +279,8 @@ uint64_t dictGenHashFunction(const void *key, int len);
 uint64_t dictGenCaseHashFunction(const unsigned char *buf, int len);
 void dictEnableResize();
 void dictDisableResize();
+void dictPauseRehashing();
+void dictResumeRehashing();
 
 int dictRehashMilliseconds(dict *d, int ms);
 void dictSetHashFunctionSeed(uint8_t *seed);
@@ -496,10 +496,15 @@ int freeMemoryIfNeeded() {
              * we only care about memory used by the key space. */
             delta = (long long) zmalloc_used_memory();
             latencyStartMonitor(eviction_latency);
+            /* We may be called from a script: the evicted key is not one
+             * of the keys of the command in execution. */
+            int prev_executing_slot = server.executing_slot;
+            server.executing_slot = -1;
             if (server.lazyfree_lazy_eviction)
                 dbAsyncDelete(db,keyobj);
             else
                 dbSyncDelete(db,keyobj);
+            server.executing_slot = prev_executing_slot;
             latencyEndMonitor(eviction_latency);
             latencyAddSampleIfNeeded("eviction-del",eviction_latency);
             latencyRemoveNestedEvent(latency,eviction_latency);
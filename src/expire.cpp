@@ -55,6 +55,10 @@ int activeExpireCycleTryExpire(redisDb *db, dictEntry *de, long long now) {
     long long t = de->dictGetSignedIntegerVal();
     if (now > t) {
         sds key = (sds)de->dictGetKey();
+
+        /* Keys being imported are expired by the node migrating them. */
+        if (server.cluster_enabled && clusterSlotImportHasKey(key)) return 0;
+
         robj *keyobj = createStringObject(key,sdslen(key));
 
         propagateExpire(db,keyobj,server.lazyfree_lazy_expire);
@@ -0,0 +1,218 @@
+/* Hot keys tracking.
+ *
+ * When hotkeys-sample-ratio is set to N > 0, one key lookup every N is
+ * sampled and counted in a count-min sketch of the database the key belongs
+ * to. The sketch estimates the number of accesses of any key using a fixed
+ * amount of memory, and may only overestimate it. The HOTKEYS_TOP_K keys
+ * with the highest estimates are kept in a small min-heap, so that the
+ * hottest keys can be reported at any time without scanning the keyspace.
+ *
+ * Every HOTKEYS_DECAY_PERIOD seconds all the counters are halved, so that
+ * the estimates follow the current traffic: a key accessed R times per
+ * second converges to a counter of R*2*HOTKEYS_DECAY_PERIOD/N, that is
+ * what we use to report access rates.
+ */
+
+#include "server.h"
+
+#define HOTKEYS_CMS_DEPTH 4
+#define HOTKEYS_CMS_WIDTH 2048 /* Must be a power of two. */
+#define HOTKEYS_TOP_K 32
+
+struct hotkeysEntry {
+    sds key;
+    uint32_t count;
+};
+
+struct hotkeysTracker {
+    uint32_t cms[HOTKEYS_CMS_DEPTH][HOTKEYS_CMS_WIDTH];
+    hotkeysEntry top[HOTKEYS_TOP_K];  /* Min-heap by count. */
+    int topcount;                     /* Used entries in 'top'. */
+};
+
+/* Number of lookups since the last sampled one. */
+static long long hotkeysSkipped = 0;
+
+static void hotkeysHeapSwap(hotkeysTracker *ht, int a, int b) {
+    hotkeysEntry aux = ht->top[a];
+    ht->top[a] = ht->top[b];
+    ht->top[b] = aux;
+}
+
+/* Restore the heap property after the count of the entry 'j' grew. */
+static void hotkeysHeapDown(hotkeysTracker *ht, int j) {
+    while(1) {
+        int min = j, l = 2*j+1, r = 2*j+2;
+
+        if (l < ht->topcount && ht->top[l].count < ht->top[min].count) min = l;
+        if (r < ht->topcount && ht->top[r].count < ht->top[min].count) min = r;
+        if (min == j) break;
+        hotkeysHeapSwap(ht,j,min);
+        j = min;
+    }
+}
+
+/* Restore the heap property after the entry 'j' was appended. */
+static void hotkeysHeapUp(hotkeysTracker *ht, int j) {
+    while(j > 0) {
+        int parent = (j-1)/2;
+
+        if (ht->top[parent].count <= ht->top[j].count) break;
+        hotkeysHeapSwap(ht,j,parent);
+        j = parent;
+    }
+}
+
+/* Count an access to 'key' in the sketch, and update the top keys with the
+ * new estimate of its accesses. */
+static void hotkeysCount(hotkeysTracker *ht, sds key) {
+    size_t len = sdslen(key);
+    uint64_t hash = dictGenHashFunction(key,len);
+    uint32_t h1 = (uint32_t)hash, h2 = (uint32_t)(hash>>32) | 1;
+    uint32_t estimate = UINT32_MAX;
+    int j;
+
+    for (j = 0; j < HOTKEYS_CMS_DEPTH; j++) {
+        uint32_t *counter = &ht->cms[j][(h1+j*h2) & (HOTKEYS_CMS_WIDTH-1)];
+
+        if (*counter != UINT32_MAX) (*counter)++;
+        if (*counter < estimate) estimate = *counter;
+    }
+
+    for (j = 0; j < ht->topcount; j++) {
+        if (sdslen(ht->top[j].key) == len &&
+            memcmp(ht->top[j].key,key,len) == 0)
+        {
+            ht->top[j].count = estimate;
+            hotkeysHeapDown(ht,j);
+            return;
+        }
+    }
+    if (ht->topcount < HOTKEYS_TOP_K) {
+        ht->top[ht->topcount].key = sdsdup(key);
+        ht->top[ht->topcount].count = estimate;
+        hotkeysHeapUp(ht,ht->topcount++);
+    } else if (estimate > ht->top[0].count) {
+        sdsfree(ht->top[0].key);
+        ht->top[0].key = sdsdup(key);
+        ht->top[0].count = estimate;
+        hotkeysHeapDown(ht,0);
+    }
+}
+
+/* Called by lookupKey() for every key found when hot keys tracking is
+ * enabled: only one lookup every hotkeys-sample-ratio is counted. */
+void hotkeysSample(redisDb *db, robj *key) {
+    if (++hotkeysSkipped < server.hotkeys_sample_ratio) return;
+    hotkeysSkipped = 0;
+    if (db->m_hotkeys == NULL)
+        db->m_hotkeys = (hotkeysTracker*)zcalloc(sizeof(hotkeysTracker));
+    hotkeysCount(db->m_hotkeys,(sds)key->ptr);
+}
+
+void hotkeysRelease(redisDb *db) {
+    hotkeysTracker *ht = db->m_hotkeys;
+    int j;
+
+    if (ht == NULL) return;
+    for (j = 0; j < ht->topcount; j++) sdsfree(ht->top[j].key);
+    zfree(ht);
+    db->m_hotkeys = NULL;
+}
+
+/* Halve all the counters. Called by serverCron() every
+ * HOTKEYS_DECAY_PERIOD seconds. Halving preserves the heap property. */
+void hotkeysDecay(void) {
+    int dbid, j, k;
+
+    for (dbid = 0; dbid < server.dbnum; dbid++) {
+        hotkeysTracker *ht = server.db[dbid].m_hotkeys;
+
+        if (ht == NULL) continue;
+        for (j = 0; j < HOTKEYS_CMS_DEPTH; j++)
+            for (k = 0; k < HOTKEYS_CMS_WIDTH; k++)
+                ht->cms[j][k] >>= 1;
+        for (j = 0; j < ht->topcount; j++)
+            ht->top[j].count >>= 1;
+    }
+}
+
+/* Estimated accesses per second of a key with the specified counter. */
+static double hotkeysRate(uint32_t count) {
+    return (double)count*server.hotkeys_sample_ratio/(2*HOTKEYS_DECAY_PERIOD);
+}
+
+static int hotkeysEntryCompare(const void *a, const void *b) {
+    const hotkeysEntry *ea = (const hotkeysEntry*)a;
+    const hotkeysEntry *eb = (const hotkeysEntry*)b;
+
+    if (ea->count == eb->count) return 0;
+    return (ea->count > eb->count) ? -1 : 1;
+}
+
+/* Fill 'entries' with the top keys of the db sorted by count, hottest
+ * first, and return how many they are. */
+static int hotkeysGetSorted(redisDb *db, hotkeysEntry *entries) {
+    hotkeysTracker *ht = db->m_hotkeys;
+    int count = 0, j;
+
+    if (ht == NULL) return 0;
+    for (j = 0; j < ht->topcount; j++)
+        if (ht->top[j].count) entries[count++] = ht->top[j];
+    qsort(entries,count,sizeof(hotkeysEntry),hotkeysEntryCompare);
+    return count;
+}
+
+/* HOTKEYS [COUNT <count>]
+ * HOTKEYS RESET
+ *
+ * Report the hottest keys of the selected database, as an array of key
+ * names and estimated accesses per second, or reset the tracking of the
+ * selected database. */
+void hotkeysCommand(client *c) {
+    hotkeysEntry entries[HOTKEYS_TOP_K];
+    long count = HOTKEYS_TOP_K;
+    int j, numkeys;
+
+    if (c->m_argc == 2 && !strcasecmp((const char*)c->m_argv[1]->ptr,"reset")) {
+        hotkeysRelease(c->m_cur_selected_db);
+        c->addReply(shared.ok);
+        return;
+    } else if (c->m_argc == 3 &&
+               !strcasecmp((const char*)c->m_argv[1]->ptr,"count"))
+    {
+        if (getLongFromObjectOrReply(c,c->m_argv[2],&count,NULL) != C_OK)
+            return;
+        if (count < 0) count = 0;
+    } else if (c->m_argc != 1) {
+        c->addReply(shared.syntaxerr);
+        return;
+    }
+
+    numkeys = hotkeysGetSorted(c->m_cur_selected_db,entries);
+    if (numkeys > count) numkeys = count;
+    c->addReplyMultiBulkLen(numkeys*2);
+    for (j = 0; j < numkeys; j++) {
+        c->addReplyBulkCBuffer(entries[j].key,sdslen(entries[j].key));
+        c->addReplyDouble(hotkeysRate(entries[j].count));
+    }
+}
+
+/* Append the hot keys INFO section fields to 'info'. */
+sds genHotkeysInfoString(sds info) {
+    hotkeysEntry entries[HOTKEYS_TOP_K];
+    int dbid;
+
+    info = sdscatprintf(info,"hotkeys_sample_ratio:%d\r\n",
+        server.hotkeys_sample_ratio);
+    for (dbid = 0; dbid < server.dbnum; dbid++) {
+        int numkeys = hotkeysGetSorted(server.db+dbid,entries);
+
+        if (numkeys == 0) continue;
+        info = sdscatprintf(info,"db%d:tracked=%d,hottest=",dbid,numkeys);
+        info = sdscatrepr(info,entries[0].key,sdslen(entries[0].key));
+        info = sdscatprintf(info,",hottest_ops_per_sec=%.2f\r\n",
+            hotkeysRate(entries[0].count));
+    }
+    return info;
+}
@@ -551,12 +551,232 @@ sds latencyCommandGenSparkeline(char *event, latencyTimeSeries *ts) {
     return graph;
 }
 
+/* ---------------------- Per command latency histograms -------------------- */
+
+/* Return the highest duration, in microseconds, counted in the bucket
+ * 'idx' of a latency histogram. */
+long long latencyHistogramBucketMax(int idx) {
+    int exp, sub;
+
+    if (idx < LATENCY_HIST_SUB_BUCKETS) return idx;
+    exp = idx/LATENCY_HIST_SUB_BUCKETS + LATENCY_HIST_SUB_BITS - 1;
+    sub = idx % LATENCY_HIST_SUB_BUCKETS;
+    return ((long long)(LATENCY_HIST_SUB_BUCKETS+sub+1) <<
+            (exp-LATENCY_HIST_SUB_BITS)) - 1;
+}
+
+/* Return the duration, in microseconds, below which the percentage 'perc'
+ * of the samples in the histogram fall. Since the histogram does not store
+ * exact values, the upper bound of the bucket reaching 'perc' is returned,
+ * that overestimates the real value by at most 1/LATENCY_HIST_SUB_BUCKETS. */
+long long latencyHistogramPercentile(uint64_t *hist, double perc) {
+    uint64_t total = 0, seen = 0, target;
+    int j;
+
+    for (j = 0; j < LATENCY_HIST_BUCKETS; j++) total += hist[j];
+    if (total == 0) return 0;
+    target = (uint64_t)((double)total*perc/100);
+    if (target == 0) target = 1;
+    for (j = 0; j < LATENCY_HIST_BUCKETS; j++) {
+        seen += hist[j];
+        if (seen >= target) break;
+    }
+    return latencyHistogramBucketMax(j < LATENCY_HIST_BUCKETS ? j :
+                                     LATENCY_HIST_BUCKETS-1);
+}
+
+/* Reply with the histogram of a command, as the name of the command
+ * followed by an array with the number of calls and the non empty buckets,
+ * every bucket being reported as the pair of the highest duration in
+ * microseconds it counts and the number of calls it counted. */
+void latencyCommandReplyWithHistogram(client *c, struct redisCommand *cmd) {
+    int j, buckets = 0;
+
+    c->addReplyBulkCString(cmd->name);
+    c->addReplyMultiBulkLen(4);
+    c->addReplyBulkCString("calls");
+    c->addReplyLongLong(cmd->calls);
+    c->addReplyBulkCString("histogram_usec");
+    if (cmd->latency_histogram == NULL) {
+        c->addReplyMultiBulkLen(0);
+        return;
+    }
+    for (j = 0; j < LATENCY_HIST_BUCKETS; j++)
+        if (cmd->latency_histogram[j]) buckets++;
+    c->addReplyMultiBulkLen(buckets*2);
+    for (j = 0; j < LATENCY_HIST_BUCKETS; j++) {
+        if (cmd->latency_histogram[j] == 0) continue;
+        c->addReplyLongLong(latencyHistogramBucketMax(j));
+        c->addReplyLongLong(cmd->latency_histogram[j]);
+    }
+}
+
+/* LATENCY HISTOGRAM [command ...]: without arguments all the commands
+ * called at least once since the last CONFIG RESETSTAT are reported,
+ * otherwise only the specified commands, ignoring unknown names. */
+void latencyCommandHistogram(client *c) {
+    struct redisCommand *cmd;
+    int j, count = 0;
+
+    if (c->m_argc == 2) {
+        dictEntry *de;
+        void *replylen = c->addDeferredMultiBulkLength();
+        dictIterator di(server.commands, 1);
+        while((de = di.dictNext()) != NULL) {
+            cmd = (struct redisCommand *) de->dictGetVal();
+            if (!cmd->calls) continue;
+            latencyCommandReplyWithHistogram(c,cmd);
+            count++;
+        }
+        c->setDeferredMultiBulkLength(replylen,count*2);
+        return;
+    }
+
+    void *replylen = c->addDeferredMultiBulkLength();
+    for (j = 2; j < c->m_argc; j++) {
+        cmd = lookupCommand((sds)c->m_argv[j]->ptr);
+        if (cmd == NULL) continue;
+        latencyCommandReplyWithHistogram(c,cmd);
+        count++;
+    }
+    c->setDeferredMultiBulkLength(replylen,count*2);
+}
+
+/* -------------------------- Event loop phases ----------------------------- */
+
+struct latencyPhase {
+    const char *name;           /* Name used in INFO and LATENCY PHASES. */
+    const char *event;          /* Latency monitor event, NULL if none. */
+    long long calls;            /* Number of samples. */
+    long long usec;             /* Total time spent in the phase. */
+    long long max_usec;         /* Max duration since the last reset. */
+    long long window_max_usec;  /* Max duration in the current window. */
+    long long prev_window_max_usec; /* Max duration in the previous window. */
+    time_t window_start;        /* Unix time the current window started. */
+    uint64_t hist[LATENCY_HIST_BUCKETS]; /* Durations histogram. */
+};
+
+/* The time spent polling is mostly idle time, so it is profiled but not
+ * reported to the latency monitor. */
+static struct latencyPhase latencyPhases[LATENCY_PHASES] = {
+    {"before_sleep","eventloop-before-sleep"},
+    {"poll",NULL},
+    {"after_sleep","eventloop-after-sleep"},
+    {"file_events","eventloop-file-events"},
+    {"time_events","eventloop-time-events"},
+    {"expire_fast","eventloop-expire-fast"},
+    {"aof_flush","eventloop-aof-flush"},
+    {"pending_writes","eventloop-pending-writes"}
+};
+
+/* Account 'usec' microseconds to the specified event loop phase. */
+void latencyAddPhaseSample(int phase, long long usec) {
+    struct latencyPhase *lp = latencyPhases+phase;
+
+    if (server.unixtime - lp->window_start >= LATENCY_PHASE_WINDOW) {
+        lp->prev_window_max_usec = lp->window_max_usec;
+        lp->window_max_usec = 0;
+        lp->window_start = server.unixtime;
+    }
+    lp->calls++;
+    lp->usec += usec;
+    if (usec > lp->max_usec) lp->max_usec = usec;
+    if (usec > lp->window_max_usec) lp->window_max_usec = usec;
+    lp->hist[latencyHistogramIndex(usec)]++;
+    if (lp->event) latencyAddSampleIfNeeded(lp->event,usec/1000);
+}
+
+/* Phase callback of the server event loop. */
+void latencyEventLoopPhaseProc(aeEventLoop *el, int phase, long long usec) {
+    UNUSED(el);
+    latencyAddPhaseSample(phase,usec);
+}
+
+void latencyResetPhases(void) {
+    int j;
+
+    for (j = 0; j < LATENCY_PHASES; j++) {
+        struct latencyPhase *lp = latencyPhases+j;
+
+        lp->calls = lp->usec = lp->max_usec = 0;
+        lp->window_max_usec = lp->prev_window_max_usec = 0;
+        lp->window_start = server.unixtime;
+        memset(lp->hist,0,sizeof(lp->hist));
+    }
+}
+
+/* The max duration of the last complete window, or of the current one if
+ * it is bigger, so that a spike is visible as soon as it happens. */
+static long long latencyPhaseWindowMax(struct latencyPhase *lp) {
+    if (server.unixtime - lp->window_start >= 2*LATENCY_PHASE_WINDOW)
+        return 0;
+    if (server.unixtime - lp->window_start >= LATENCY_PHASE_WINDOW)
+        return lp->window_max_usec;
+    return lp->window_max_usec > lp->prev_window_max_usec ?
+           lp->window_max_usec : lp->prev_window_max_usec;
+}
+
+/* Append the phases statistics to the INFO output 'info'. */
+sds genLatencyPhasesInfoString(sds info) {
+    int j;
+
+    for (j = 0; j < LATENCY_PHASES; j++) {
+        struct latencyPhase *lp = latencyPhases+j;
+
+        info = sdscatprintf(info,
+            "eventloop_phase_%s:calls=%lld,usec=%lld,usec_per_call=%.2f,"
+            "max_usec=%lld,window_max_usec=%lld,"
+            "p50=%lld,p99=%lld,p99.9=%lld\r\n",
+            lp->name, lp->calls, lp->usec,
+            (lp->calls == 0) ? 0 : ((float)lp->usec/lp->calls),
+            lp->max_usec, latencyPhaseWindowMax(lp),
+            latencyHistogramPercentile(lp->hist,50),
+            latencyHistogramPercentile(lp->hist,99),
+            latencyHistogramPercentile(lp->hist,99.9));
+    }
+    return info;
+}
+
+/* LATENCY PHASES: reply with the statistics and the non empty histogram
+ * buckets of every event loop phase. */
+void latencyCommandPhases(client *c) {
+    int j, k;
+
+    c->addReplyMultiBulkLen(LATENCY_PHASES*2);
+    for (j = 0; j < LATENCY_PHASES; j++) {
+        struct latencyPhase *lp = latencyPhases+j;
+        int buckets = 0;
+
+        c->addReplyBulkCString(lp->name);
+        c->addReplyMultiBulkLen(10);
+        c->addReplyBulkCString("calls");
+        c->addReplyLongLong(lp->calls);
+        c->addReplyBulkCString("usec");
+        c->addReplyLongLong(lp->usec);
+        c->addReplyBulkCString("max_usec");
+        c->addReplyLongLong(lp->max_usec);
+        c->addReplyBulkCString("window_max_usec");
+        c->addReplyLongLong(latencyPhaseWindowMax(lp));
+        c->addReplyBulkCString("histogram_usec");
+        for (k = 0; k < LATENCY_HIST_BUCKETS; k++)
+            if (lp->hist[k]) buckets++;
+        c->addReplyMultiBulkLen(buckets*2);
+        for (k = 0; k < LATENCY_HIST_BUCKETS; k++) {
+            if (lp->hist[k] == 0) continue;
+            c->addReplyLongLong(latencyHistogramBucketMax(k));
+            c->addReplyLongLong(lp->hist[k]);
+        }
+    }
+}
+
 /* LATENCY command implementations.
  *
  * LATENCY SAMPLES: return time-latency samples for the specified event.
  * LATENCY LATEST: return the latest latency for all the events classes.
  * LATENCY DOCTOR: returns an human readable analysis of instance latency.
  * LATENCY GRAPH: provide an ASCII graph of the latency of the specified event.
+ * LATENCY HISTOGRAM: per command latency histograms.
+ * LATENCY PHASES: event loop phases statistics.
  */
 void latencyCommand(client *c) {
     latencyTimeSeries *ts;
@@ -589,6 +809,12 @@ void latencyCommand(client *c) {
 
         c->addReplyBulkCBuffer(report,sdslen(report));
         sdsfree(report);
+    } else if (!strcasecmp((const char*)c->m_argv[1]->ptr,"phases") && c->m_argc == 2) {
+        /* LATENCY PHASES */
+        latencyCommandPhases(c);
+    } else if (!strcasecmp((const char*)c->m_argv[1]->ptr,"histogram")) {
+        /* LATENCY HISTOGRAM [command ...] */
+        latencyCommandHistogram(c);
     } else if (!strcasecmp((const char*)c->m_argv[1]->ptr,"reset") && c->m_argc >= 2) {
         /* LATENCY RESET */
         if (c->m_argc == 2) {
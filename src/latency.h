@@ -65,6 +65,56 @@ void latencyMonitorInit();
 void latencyAddSample(char *event, mstime_t latency);
 int THPIsEnabled();
 
+/* Per command latency histograms.
+ *
+ * Histograms are log-linear: durations below LATENCY_HIST_SUB_BUCKETS
+ * microseconds get a bucket each, then every power of two range is split
+ * into LATENCY_HIST_SUB_BUCKETS linear buckets, so the relative error is
+ * at most 1/LATENCY_HIST_SUB_BUCKETS. Durations of 2^(MAX_EXP+1)
+ * microseconds (about 19 hours) or more are counted in the last bucket. */
+#define LATENCY_HIST_SUB_BITS 3
+#define LATENCY_HIST_SUB_BUCKETS (1<<LATENCY_HIST_SUB_BITS)
+#define LATENCY_HIST_MAX_EXP 35
+#define LATENCY_HIST_BUCKETS \
+    ((LATENCY_HIST_MAX_EXP-LATENCY_HIST_SUB_BITS+2)*LATENCY_HIST_SUB_BUCKETS)
+
+static inline int latencyHistogramIndex(long long usec) {
+    int exp;
+
+    if (usec < LATENCY_HIST_SUB_BUCKETS)
+        return usec < 0 ? 0 : (int)usec;
+    exp = 63 - __builtin_clzll((unsigned long long)usec);
+    if (exp > LATENCY_HIST_MAX_EXP) return LATENCY_HIST_BUCKETS-1;
+    return (exp-LATENCY_HIST_SUB_BITS+1)*LATENCY_HIST_SUB_BUCKETS +
+           (int)((usec >> (exp-LATENCY_HIST_SUB_BITS)) &
+                 (LATENCY_HIST_SUB_BUCKETS-1));
+}
+
+/* Count a sample in the histogram '*hist', that is allocated on first use
+ * so that commands never called don't use memory. */
+static inline void latencyHistogramAdd(uint64_t **hist, long long usec) {
+    if (*hist == NULL)
+        *hist = (uint64_t*)zcalloc(sizeof(uint64_t)*LATENCY_HIST_BUCKETS);
+    (*hist)[latencyHistogramIndex(usec)]++;
+}
+
+long long latencyHistogramBucketMax(int idx);
+long long latencyHistogramPercentile(uint64_t *hist, double perc);
+
+/* Event loop phases profiling. The first AE_PHASES phases are the ones
+ * reported by the event loop itself, the others are the most expensive
+ * steps of beforeSleep(), timed by the server. */
+#define LATENCY_PHASE_EXPIRE_FAST (AE_PHASES+0)
+#define LATENCY_PHASE_AOF_FLUSH (AE_PHASES+1)
+#define LATENCY_PHASE_PENDING_WRITES (AE_PHASES+2)
+#define LATENCY_PHASES (AE_PHASES+3)
+#define LATENCY_PHASE_WINDOW 10 /* Seconds of the max duration window. */
+
+void latencyAddPhaseSample(int phase, long long usec);
+void latencyEventLoopPhaseProc(aeEventLoop *el, int phase, long long usec);
+void latencyResetPhases(void);
+sds genLatencyPhasesInfoString(sds info);
+
 /* Latency monitoring macros. */
 
 /* Start monitoring an event. We just set the current time. */
@@ -53,6 +53,16 @@ size_t lazyfreeGetFreeEffort(robj *obj)
  * will be reclaimed in a different bio.c thread. */
 #define LAZYFREE_THRESHOLD 64
 int dbAsyncDelete(redisDb *db, robj *key) {
+    memAcctFrame maf;
+    int deleted = 0;
+
+    /* Keys may be deleted outside commands, by expires and evictions. */
+    memAcctBegin(&maf,NULL);
+    if (maf.open) {
+        dictEntry *de = db->m_dict->dictFind(key->ptr);
+        if (de) memAcctTouch(db,((robj*)de->dictGetVal())->type);
+    }
+
     /* Deleting an entry from the expires dict will not free the sds of
      * the key, because it is shared with the main dictionary. */
     if (db->m_expires->dictSize() > 0) db->m_expires->dictDelete(key->ptr);
@@ -66,10 +76,12 @@ int dbAsyncDelete(redisDb *db, robj *key) {
         size_t free_effort = lazyfreeGetFreeEffort(val);
 
         /* If releasing the object is too much work, let's put it into the
-         * lazy free list. */
+         * lazy free list. The lazy free thread will account the released
+         * memory in the DB counters. */
         if (free_effort > LAZYFREE_THRESHOLD) {
             atomicIncr(lazyfree_objects,1);
-            bioCreateBackgroundJob(BIO_LAZY_FREE,val,NULL,NULL);
+            bioCreateBackgroundJob(BIO_LAZY_FREE,val,
+                                   memAcctRetainCounters(db),NULL);
             db->m_dict->dictSetVal(de,NULL);
         }
     }
@@ -79,10 +91,10 @@ int dbAsyncDelete(redisDb *db, robj *key) {
     if (de) {
         db->m_dict->dictFreeUnlinkedEntry(de);
         if (server.cluster_enabled) slotToKeyDel(key);
-        return 1;
-    } else {
-        return 0;
+        deleted = 1;
     }
+    memAcctEnd(&maf);
+    return deleted;
 }
 
 /* Empty a Redis DB asynchronously. What the function does actually is to
@@ -109,9 +121,14 @@ void slotToKeyFlushAsync() {
 }
 
 /* Release objects from the lazyfree thread. It's just decrRefCount()
- * updating the count of objects to release. */
-void lazyfreeFreeObjectFromBioThread(robj *o) {
+ * updating the count of objects to release, and charging the released
+ * memory to the memory accounting counters 'mc' if not NULL. */
+void lazyfreeFreeObjectFromBioThread(robj *o, memAcctCounters *mc) {
+    long long used = zmalloc_thread_used_memory();
+    int type = o->type;
+
     decrRefCount(o);
+    memAcctLazyfreed(mc,type,zmalloc_thread_used_memory()-used);
     atomicDecr(lazyfree_objects,1);
 }
 
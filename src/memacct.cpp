@@ -0,0 +1,308 @@
+/* Exact memory accounting by data type and database.
+ *
+ * When memory-accounting is enabled, every database keeps the number of
+ * bytes used by the values of each type, including the key names and the
+ * dictionary entries referencing them. Unlike MEMORY USAGE, that samples
+ * aggregated values, these counters are exact.
+ *
+ * The counters are updated by measuring the memory allocated and freed by
+ * the main thread (see zmalloc_thread_used_memory()) inside "accounting
+ * frames". A frame is opened around the execution of every command, the
+ * deletion of every key (so that expires and evictions are accounted), the
+ * loading of every key from the RDB file and the serving of the clients
+ * blocked on lists. Inside a frame the memory is charged to the type and DB
+ * of the last key looked up or created, starting a new segment of the frame
+ * every time the target changes. Memory allocated before any key is
+ * touched, or after signalModifiedKey() declared the key done, is not
+ * charged. Commands that build a value of one type out of keys of other
+ * types, like ZUNIONSTORE with sets or SORT ... STORE, pin the target to the
+ * type they create, so that the keys they read are not charged.
+ *
+ * Frames nest: what is charged by an inner frame is not charged again by
+ * the outer one. So opening a nested frame without a target excludes
+ * allocations from the accounting, which is what we do for replies,
+ * propagation, keyspace notifications and the hot keys tracking.
+ *
+ * Two special cases:
+ *
+ * 1) The growth of the main hash tables of a DB is not part of the values,
+ *    and is reported as overhead by MEMORY STATS, so it is subtracted.
+ * 2) The string objects of the client argv were allocated outside frames:
+ *    when dbAdd() or dbOverwrite() store one of them, its size is charged
+ *    explicitly.
+ *
+ * Values released by the lazy free thread are charged by that thread once
+ * released. Since FLUSHDB may replace the counters of a DB meanwhile, the
+ * counters are reference counted, and charges for flushed data just go to
+ * counters nobody reads anymore. Keys moved by MOVE are charged with the
+ * MEMORY USAGE estimation, as their memory is not allocated again: only the
+ * per DB split is approximated in this case, the per type totals are not.
+ */
+
+#include "server.h"
+
+struct memAcctCounters {
+    long long bytes[MEMACCT_TYPES];     /* Charged by the main thread. */
+    long long lazyfreed[MEMACCT_TYPES]; /* Charged by the lazy free thread. */
+    int refcount;                       /* The DB plus pending lazy frees. */
+};
+
+/* Protects 'lazyfreed' and 'refcount' of all the counters. */
+static pthread_mutex_t memacct_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Frames are per thread: module threads may run commands too. */
+static __thread memAcctFrame *CurrentFrame = NULL;
+static __thread long long Charged = 0; /* Memory consumed by all segments. */
+
+static const char *memAcctTypeNames[MEMACCT_TYPES] =
+    {"string","list","set","zset","hash","module"};
+
+memAcctCounters *memAcctCreateCounters(void) {
+    memAcctCounters *mc = (memAcctCounters*)zcalloc(sizeof(*mc));
+    mc->refcount = 1;
+    return mc;
+}
+
+void memAcctReleaseCounters(memAcctCounters *mc) {
+    int refcount;
+
+    if (mc == NULL) return;
+    pthread_mutex_lock(&memacct_mutex);
+    refcount = --mc->refcount;
+    pthread_mutex_unlock(&memacct_mutex);
+    if (refcount == 0) zfree(mc);
+}
+
+/* Return the counters of 'db' with an additional reference, to be passed to
+ * memAcctLazyfreed() when the value is released. */
+memAcctCounters *memAcctRetainCounters(redisDb *db) {
+    memAcctCounters *mc = db->m_memacct;
+
+    if (mc == NULL) return NULL;
+    pthread_mutex_lock(&memacct_mutex);
+    mc->refcount++;
+    pthread_mutex_unlock(&memacct_mutex);
+    return mc;
+}
+
+/* Called by the lazy free thread once a value of the specified type was
+ * released, with the (negative) memory it allocated meanwhile. */
+void memAcctLazyfreed(memAcctCounters *mc, int type, long long bytes) {
+    if (mc == NULL) return;
+    pthread_mutex_lock(&memacct_mutex);
+    if (type < MEMACCT_TYPES) mc->lazyfreed[type] += bytes;
+    pthread_mutex_unlock(&memacct_mutex);
+    memAcctReleaseCounters(mc);
+}
+
+/* Reset the counters of a DB that was emptied. */
+void memAcctResetCounters(redisDb *db) {
+    if (db->m_memacct == NULL) return;
+    memAcctDetach();
+    memAcctReleaseCounters(db->m_memacct);
+    db->m_memacct = memAcctCreateCounters();
+}
+
+/* Fill 'bytes' with the memory used by every type in the DB. */
+void memAcctGetBytes(redisDb *db, long long *bytes) {
+    memAcctCounters *mc = db->m_memacct;
+    int j;
+
+    if (mc == NULL) {
+        memset(bytes,0,sizeof(long long)*MEMACCT_TYPES);
+        return;
+    }
+    pthread_mutex_lock(&memacct_mutex);
+    for (j = 0; j < MEMACCT_TYPES; j++) {
+        mc->bytes[j] += mc->lazyfreed[j];
+        mc->lazyfreed[j] = 0;
+        bytes[j] = mc->bytes[j];
+    }
+    pthread_mutex_unlock(&memacct_mutex);
+}
+
+const char *memAcctTypeName(int type) {
+    return memAcctTypeNames[type];
+}
+
+/* Size of the main hash tables of the DB, that is not part of the values. */
+static long long memAcctTablesSize(redisDb *db) {
+    return (long long)(db->m_dict->dictSlots()+db->m_expires->dictSlots())*
+           sizeof(dictEntry*);
+}
+
+static void memAcctStartSegment(memAcctFrame *f, redisDb *db, int type) {
+    f->db = db;
+    f->type = type;
+    f->used = zmalloc_thread_used_memory();
+    f->charged = Charged;
+    f->tables = db ? memAcctTablesSize(db) : 0;
+}
+
+/* Charge the memory allocated in the current segment of the frame, but not
+ * charged by nested frames, to the segment target. */
+static void memAcctEndSegment(memAcctFrame *f) {
+    long long delta = zmalloc_thread_used_memory() - f->used -
+                      (Charged - f->charged);
+
+    if (f->db) {
+        delta -= memAcctTablesSize(f->db) - f->tables;
+        if (f->type >= 0 && f->db->m_memacct)
+            f->db->m_memacct->bytes[f->type] += delta;
+    }
+    Charged += delta;
+}
+
+static void memAcctOpen(memAcctFrame *f, client *c) {
+    f->open = 1;
+    f->pinned = 0;
+    f->c = c;
+    f->prev = CurrentFrame;
+    CurrentFrame = f;
+    memAcctStartSegment(f,NULL,MEMACCT_NONE);
+}
+
+/* Open a frame if memory accounting is enabled. 'c' is the client whose
+ * command runs inside the frame, if any. */
+void memAcctBegin(memAcctFrame *f, client *c) {
+    f->open = 0;
+    if (server.memory_accounting) memAcctOpen(f,c);
+}
+
+/* Open a frame only if we are already inside one: used to exclude from the
+ * accounting memory that doesn't belong to the keyspace. */
+void memAcctBeginNested(memAcctFrame *f) {
+    f->open = 0;
+    if (CurrentFrame) memAcctOpen(f,NULL);
+}
+
+void memAcctEnd(memAcctFrame *f) {
+    if (!f->open) return;
+    serverAssert(CurrentFrame == f);
+    memAcctEndSegment(f);
+    CurrentFrame = f->prev;
+    f->open = 0;
+}
+
+/* Charge the following allocations to 'type' in 'db'. The type can be
+ * MEMACCT_PENDING when a key is going to be created but its type is not
+ * known yet: the segment is then charged to the type passed by the next
+ * call for the same DB. */
+void memAcctTouch(redisDb *db, int type) {
+    memAcctFrame *f = CurrentFrame;
+
+    if (f == NULL || (f->db == db && f->type == type)) return;
+    if (f->db == db && f->type == MEMACCT_PENDING) {
+        f->type = type;
+        return;
+    }
+    memAcctEndSegment(f);
+    memAcctStartSegment(f,db,type);
+}
+
+/* Called by key lookups: like memAcctTouch(), unless the target of the
+ * frame is pinned. */
+void memAcctLookup(redisDb *db, int type) {
+    memAcctFrame *f = CurrentFrame;
+
+    if (f == NULL || f->pinned) return;
+    memAcctTouch(db,type);
+}
+
+/* Charge the following allocations to 'type' in 'db' until the end of the
+ * frame, whatever keys are looked up. Used by commands that only create
+ * values of 'type' and release everything else they allocate, so that
+ * nothing is charged to the keys they read. Adding or overwriting keys
+ * still moves the target as usual, and leaves it to the type of the new
+ * value. */
+void memAcctPin(redisDb *db, int type) {
+    memAcctFrame *f = CurrentFrame;
+
+    if (f == NULL) return;
+    memAcctTouch(db,type);
+    f->pinned = 1;
+}
+
+/* Stop charging the following allocations to the last key touched. Pinned
+ * targets are kept, since the temporary allocations still need to be
+ * released in the same segment. */
+void memAcctDetach(void) {
+    memAcctFrame *f = CurrentFrame;
+
+    if (f == NULL || f->db == NULL || f->pinned) return;
+    memAcctEndSegment(f);
+    memAcctStartSegment(f,NULL,MEMACCT_NONE);
+}
+
+/* Charge 'bytes' to 'type' in 'db' without any allocation happening. */
+void memAcctCharge(redisDb *db, int type, long long bytes) {
+    if (db->m_memacct && type < MEMACCT_TYPES)
+        db->m_memacct->bytes[type] += bytes;
+}
+
+/* Called when memory allocated inside the current frame is handed to
+ * something that is not part of the keyspace, like the client replies, so
+ * that the frame doesn't charge it. */
+void memAcctForget(long long bytes) {
+    if (CurrentFrame) Charged += bytes;
+}
+
+/* Exact memory used by a string object, as accounted by zmalloc when it
+ * gets freed. */
+static long long memAcctStringSize(robj *o) {
+    if (o->refcount == OBJ_SHARED_REFCOUNT) return 0;
+    if (o->encoding == OBJ_ENCODING_RAW)
+        return zmalloc_size(o)+zmalloc_size(sdsAllocPtr((sds)o->ptr));
+    return zmalloc_size(o);
+}
+
+/* Called by dbAdd() and dbOverwrite() with the value being stored. If it
+ * is one of the arguments of the command, it was allocated outside the
+ * frame, so we charge it now. */
+void memAcctStoreValue(redisDb *db, robj *val) {
+    client *c;
+    int j;
+
+    if (CurrentFrame == NULL || (c = CurrentFrame->c) == NULL ||
+        val->type != OBJ_STRING) return;
+    for (j = 0; j < c->m_argc; j++) {
+        if (c->m_argv[j] == val) {
+            memAcctCharge(db,OBJ_STRING,memAcctStringSize(val));
+            break;
+        }
+    }
+}
+
+/* Append the memory accounting fields of the INFO memory section. */
+sds genMemAcctInfoString(sds info) {
+    long long bytes[MEMACCT_TYPES], total[MEMACCT_TYPES] = {0};
+    sds perdb = sdsempty();
+    int dbid, j;
+
+    info = sdscatprintf(info,"memory_accounting:%d\r\n",
+        server.memory_accounting);
+    if (!server.memory_accounting) return info;
+    for (dbid = 0; dbid < server.dbnum; dbid++) {
+        long long dbtotal = 0;
+
+        memAcctGetBytes(server.db+dbid,bytes);
+        for (j = 0; j < MEMACCT_TYPES; j++) {
+            total[j] += bytes[j];
+            dbtotal += bytes[j];
+        }
+        if (dbtotal == 0) continue;
+        perdb = sdscatprintf(perdb,"used_memory_dataset_db%d:",dbid);
+        for (j = 0; j < MEMACCT_TYPES; j++) {
+            perdb = sdscatprintf(perdb,"%s=%lld,",
+                memAcctTypeNames[j],bytes[j]);
+        }
+        perdb = sdscatprintf(perdb,"total=%lld\r\n",dbtotal);
+    }
+    for (j = 0; j < MEMACCT_TYPES; j++) {
+        info = sdscatprintf(info,"used_memory_dataset_%s:%lld\r\n",
+            memAcctTypeNames[j],total[j]);
+    }
+    info = sdscatsds(info,perdb);
+    sdsfree(perdb);
+    return info;
+}
@@ -126,6 +126,7 @@ struct RedisModuleCtx {
 #define REDISMODULE_CTX_BLOCKED_REPLY (1<<3)
 #define REDISMODULE_CTX_BLOCKED_TIMEOUT (1<<4)
 #define REDISMODULE_CTX_THREAD_SAFE (1<<5)
+#define REDISMODULE_CTX_READ_LOCKED (1<<6)
 
 /* This represents a Redis key opened with RM_OpenKey(). */
 struct RedisModuleKey {
@@ -145,6 +146,10 @@ struct RedisModuleKey {
     void *zcurrent;         /* Zset iterator current node. */
     int zer;                /* Zset iterator end reached flag
                                (true if end was reached). */
+
+    /* List views taken with the read lock. */
+    unsigned char *listbuf; /* Private copy of a compressed list node. */
+    size_t listbuf_size;    /* Allocated size of 'listbuf'. */
 };
 typedef struct RedisModuleKey RedisModuleKey;
 
@@ -211,9 +216,12 @@ struct RedisModuleBlockedClient {
 static pthread_mutex_t moduleUnblockedClientsMutex = PTHREAD_MUTEX_INITIALIZER;
 static list *moduleUnblockedClients;
 
-/* We need a mutex that is unlocked / relocked in beforeSleep() in order to
- * allow thread safe contexts to execute commands at a safe moment. */
-static pthread_mutex_t moduleGIL = PTHREAD_MUTEX_INITIALIZER;
+/* We need a lock that is unlocked / relocked in beforeSleep() in order to
+ * allow thread safe contexts to execute commands at a safe moment. The main
+ * thread and the thread safe contexts calling RM_ThreadSafeContextLock()
+ * take it for writing, while contexts that only read the dataset can take it
+ * for reading with RM_ThreadSafeContextReadLock(), and run concurrently. */
+static pthread_rwlock_t moduleGIL;
 
 /* --------------------------------------------------------------------------
  * Prototypes
@@ -223,9 +231,16 @@ void RM_FreeCallReply(RedisModuleCallReply *reply);
 void RM_CloseKey(RedisModuleKey *key);
 void autoMemoryCollect(RedisModuleCtx *ctx);
 robj **moduleCreateArgvFromUserFormat(const char *cmdname, const char *fmt, int *argcp, int *flags, va_list ap);
+typedef struct moduleCallClient moduleCallClient;
+static robj **moduleCreateCallArgv(moduleCallClient *mc, const char *cmdname, const char *fmt, int *argcp, int *flags, va_list ap);
 void moduleReplicateMultiIfNeeded(RedisModuleCtx *ctx);
 void RM_ZsetRangeStop(RedisModuleKey *kp);
 static void zsetKeyReset(RedisModuleKey *key);
+static void moduleInitKey(RedisModuleKey *kp, RedisModuleCtx *ctx,
+                          robj *keyname, robj *value, int mode);
+static void moduleCloseKey(RedisModuleKey *key);
+void moduleUnsubscribeNotifications(RedisModule *module);
+void moduleStopTimers(RedisModule *module);
 
 /* --------------------------------------------------------------------------
  * Heap allocation raw functions
@@ -638,6 +653,7 @@ int RM_CreateCommand(RedisModuleCtx *ctx, const char *name, RedisModuleCmdFunc c
     cp->rediscmd->keystep = keystep;
     cp->rediscmd->microseconds = 0;
     cp->rediscmd->calls = 0;
+    cp->rediscmd->latency_histogram = NULL;
     server.commands->dictAdd(sdsdup(cmdname),cp->rediscmd);
     server.orig_commands->dictAdd(sdsdup(cmdname),cp->rediscmd);
     return REDISMODULE_OK;
@@ -1374,7 +1390,16 @@ void *RM_OpenKey(RedisModuleCtx *ctx, robj *keyname, int mode) {
     RedisModuleKey *kp;
     robj *value;
 
-    if (mode & REDISMODULE_WRITE) {
+    if (ctx->flags & REDISMODULE_CTX_READ_LOCKED) {
+        /* Other threads may be reading the dataset at the same time: don't
+         * expire the key nor update its access time or the stats. */
+        if (mode & REDISMODULE_WRITE) return NULL;
+        value = lookupKey(ctx->_client->m_cur_selected_db,keyname,
+                          LOOKUP_NOTOUCH);
+        if (value == NULL) return NULL;
+        mstime_t when = getExpire(ctx->_client->m_cur_selected_db,keyname);
+        if (when >= 0 && !server.loading && mstime() > when) return NULL;
+    } else if (mode & REDISMODULE_WRITE) {
         value = lookupKeyWrite(ctx->_client->m_cur_selected_db,keyname);
     } else {
         value = lookupKeyRead(ctx->_client->m_cur_selected_db,keyname);
@@ -1385,6 +1410,16 @@ void *RM_OpenKey(RedisModuleCtx *ctx, robj *keyname, int mode) {
 
     /* Setup the key handle. */
     kp = (RedisModuleKey *)zmalloc(sizeof(*kp));
+    moduleInitKey(kp,ctx,keyname,value,mode);
+    autoMemoryAdd(ctx,REDISMODULE_AM_KEY,kp);
+    return (void*)kp;
+}
+
+/* Initialize a key handle, used by RM_OpenKey() and by the scanning API
+ * that passes modules handles not allocated on the heap. */
+static void moduleInitKey(RedisModuleKey *kp, RedisModuleCtx *ctx,
+                          robj *keyname, robj *value, int mode)
+{
     kp->ctx = ctx;
     kp->db = ctx->_client->m_cur_selected_db;
     kp->key = keyname;
@@ -1392,18 +1427,24 @@ void *RM_OpenKey(RedisModuleCtx *ctx, robj *keyname, int mode) {
     kp->value = value;
     kp->iter = NULL;
     kp->mode = mode;
+    kp->listbuf = NULL;
+    kp->listbuf_size = 0;
     zsetKeyReset(kp);
-    autoMemoryAdd(ctx,REDISMODULE_AM_KEY,kp);
-    return (void*)kp;
 }
 
-/* Close a key handle. */
-void RM_CloseKey(RedisModuleKey *key) {
-    if (key == NULL) return;
+/* Release the resources of a key handle without freeing the handle. */
+static void moduleCloseKey(RedisModuleKey *key) {
     if (key->mode & REDISMODULE_WRITE) signalModifiedKey(key->db,key->key);
     /* TODO: if (key->iter) RM_KeyIteratorStop(kp); */
     RM_ZsetRangeStop(key);
+    zfree(key->listbuf);
     decrRefCount(key->key);
+}
+
+/* Close a key handle. */
+void RM_CloseKey(RedisModuleKey *key) {
+    if (key == NULL) return;
+    moduleCloseKey(key);
     autoMemoryFreed(key->ctx,REDISMODULE_AM_KEY,key);
     zfree(key);
 }
@@ -1545,9 +1586,17 @@ char *RM_StringDMA(RedisModuleKey *key, size_t *len, int mode) {
     if (key->value->type != OBJ_STRING) return NULL;
 
     /* For write access, and even for read access if the object is encoded,
-     * we unshare the string (that has the side effect of decoding it). */
-    if ((mode & REDISMODULE_WRITE) || key->value->encoding != OBJ_ENCODING_RAW)
+     * we unshare the string (that has the side effect of decoding it).
+     * This is not possible when holding the read lock: in that case only
+     * the SDS encoded strings can be accessed. */
+    if (key->ctx->flags & REDISMODULE_CTX_READ_LOCKED) {
+        if ((mode & REDISMODULE_WRITE) || !sdsEncodedObject(key->value))
+            return NULL;
+    } else if ((mode & REDISMODULE_WRITE) ||
+               key->value->encoding != OBJ_ENCODING_RAW)
+    {
         key->value = dbUnshareStringValue(key->db, key->key, key->value);
+    }
 
     *len = sdslen((sds)key->value->ptr);
     return (char *)key->value->ptr;
@@ -1633,6 +1682,45 @@ RedisModuleString *RM_ListPop(RedisModuleKey *key, int where) {
     return decoded;
 }
 
+/* Access the list element at 'index' without copying it. Like in LINDEX
+ * 'index' is zero based, and negative indexes count from the tail, so -1 is
+ * the last element.
+ *
+ * On success REDISMODULE_OK is returned and the element is returned by
+ * reference: if it is stored as a string, '*ptr' and '*len' are set to
+ * point directly to the list storage, otherwise the element is stored as
+ * an integer, '*ptr' is set to NULL and its value is stored in '*ll'.
+ *
+ * The returned pointer is read only, and is only valid as long as the key
+ * is open and not modified. When the context holds the read lock, elements
+ * of compressed list nodes are decompressed into a buffer owned by the key
+ * instead of in place, so the view is also invalidated by the next call to
+ * this function with the same key.
+ *
+ * REDISMODULE_ERR is returned if the key is empty, is not a list, or the
+ * index is out of range. */
+int RM_ListGetView(RedisModuleKey *key, long index, const char **ptr, size_t *len, long long *ll) {
+    quicklistEntry entry;
+    int found;
+
+    if (key->value == NULL || key->value->type != OBJ_LIST)
+        return REDISMODULE_ERR;
+    if (key->value->encoding != OBJ_ENCODING_QUICKLIST)
+        serverPanic("Unknown list encoding");
+    /* Other threads may be reading the same list with the read lock, so
+     * compressed nodes must not be decompressed in place. */
+    if (key->ctx->flags & REDISMODULE_CTX_READ_LOCKED)
+        found = entry.quicklistIndexReadOnly((quicklist *)key->value->ptr,
+                    index,&key->listbuf,&key->listbuf_size);
+    else
+        found = entry.quicklistIndex((quicklist *)key->value->ptr,index);
+    if (!found) return REDISMODULE_ERR;
+    *ptr = (const char*)entry.m_value;
+    *len = entry.m_value ? entry.m_size : 0;
+    *ll = entry.m_longval;
+    return REDISMODULE_OK;
+}
+
 /* --------------------------------------------------------------------------
  * Key API for Sorted Set type
  * -------------------------------------------------------------------------- */
@@ -1950,6 +2038,39 @@ RedisModuleString *RM_ZsetRangeCurrentElement(RedisModuleKey *key, double *score
     return str;
 }
 
+/* Like RM_ZsetRangeCurrentElement() but, instead of returning a new string,
+ * return by reference a view of the current element of the sorted set
+ * iterator, with the same conventions of RM_ListGetView(): the element is
+ * either the string '*ptr' of length '*len', or, if '*ptr' is set to NULL,
+ * the integer '*ll'. Returns REDISMODULE_ERR if there is no active
+ * iterator. The view is valid as long as the key is open and not modified. */
+int RM_ZsetRangeCurrentElementView(RedisModuleKey *key, const char **ptr, size_t *len, long long *ll, double *score) {
+    if (key->zcurrent == NULL) return REDISMODULE_ERR;
+    if (key->value->encoding == OBJ_ENCODING_ZIPLIST) {
+        unsigned char *eptr, *sptr, *vstr;
+        unsigned int vlen;
+        int ret;
+
+        eptr = (unsigned char *)key->zcurrent;
+        ret = ziplistGet(eptr,&vstr,&vlen,ll);
+        serverAssert(ret);
+        *ptr = (const char*)vstr;
+        *len = vstr ? vlen : 0;
+        if (score) {
+            sptr = ziplistNext((unsigned char *)key->value->ptr,eptr);
+            *score = zzlGetScore(sptr);
+        }
+    } else if (key->value->encoding == OBJ_ENCODING_SKIPLIST) {
+        zskiplistNode *ln = (zskiplistNode *)key->zcurrent;
+        if (score) *score = ln->score;
+        *ptr = ln->ele;
+        *len = sdslen(ln->ele);
+    } else {
+        serverPanic("Unsupported zset encoding");
+    }
+    return REDISMODULE_OK;
+}
+
 /* Go to the next element of the sorted set iterator. Returns 1 if there was
  * a next element, 0 if we are already at the latest element or the range
  * does not include any item at all. */
@@ -2280,6 +2401,248 @@ int RM_HashGet(RedisModuleKey *key, int flags, ...) {
     return REDISMODULE_OK;
 }
 
+/* Get the value of the hash field 'field' without copying it. This is the
+ * zero-copy alternative to RM_HashGet() for modules reading fields of large
+ * hashes in a hot path, and uses the same conventions of RM_ListGetView():
+ * the value is either the string '*ptr' of length '*len', pointing directly
+ * to the hash storage, or, if '*ptr' is set to NULL, the integer '*ll'.
+ *
+ *      const char *ptr;
+ *      size_t len;
+ *      long long ll;
+ *      if (RedisModule_HashGetView(key,field,&ptr,&len,&ll) == REDISMODULE_OK)
+ *          ... use ptr/len, or ll if ptr is NULL ...
+ *
+ * The returned pointer is read only, and is only valid as long as the key
+ * is open and not modified.
+ *
+ * REDISMODULE_ERR is returned if the key is empty, is not an hash, or the
+ * field does not exist. */
+int RM_HashGetView(RedisModuleKey *key, RedisModuleString *field, const char **ptr, size_t *len, long long *ll) {
+    unsigned char *vstr;
+    unsigned int vlen;
+
+    if (key->value == NULL || key->value->type != OBJ_HASH)
+        return REDISMODULE_ERR;
+    if (hashTypeGetValue(key->value,(sds)field->ptr,&vstr,&vlen,ll) == C_ERR)
+        return REDISMODULE_ERR;
+    *ptr = (const char*)vstr;
+    *len = vstr ? vlen : 0;
+    return REDISMODULE_OK;
+}
+
+/* --------------------------------------------------------------------------
+ * Keyspace and key elements scanning
+ * -------------------------------------------------------------------------- */
+
+typedef void (*RedisModuleScanCB)(RedisModuleCtx *ctx, robj *keyname,
+                                  RedisModuleKey *key, void *privdata);
+typedef void (*RedisModuleScanKeyCB)(RedisModuleKey *key, robj *field,
+                                     robj *value, void *privdata);
+
+/* Cursor of RM_Scan() and RM_ScanKey(). */
+typedef struct RedisModuleScanCursor {
+    unsigned long cursor;   /* The dictScan() reverse binary cursor. */
+    int done;               /* True once the iteration is complete. */
+} RedisModuleScanCursor;
+
+/* Create a new cursor to be used with RedisModule_Scan() or
+ * RedisModule_ScanKey(). */
+RedisModuleScanCursor *RM_ScanCursorCreate(void) {
+    RedisModuleScanCursor *cursor =
+        (RedisModuleScanCursor*)zmalloc(sizeof(*cursor));
+    cursor->cursor = 0;
+    cursor->done = 0;
+    return cursor;
+}
+
+/* Restart an existing cursor. The keys will be rescanned. */
+void RM_ScanCursorRestart(RedisModuleScanCursor *cursor) {
+    cursor->cursor = 0;
+    cursor->done = 0;
+}
+
+/* Destroy the cursor struct. */
+void RM_ScanCursorDestroy(RedisModuleScanCursor *cursor) {
+    zfree(cursor);
+}
+
+typedef struct {
+    RedisModuleCtx *ctx;
+    RedisModuleScanCB fn;
+    void *privdata;
+    long long now;
+} moduleScanData;
+
+void moduleScanCallback(void *privdata, const dictEntry *de) {
+    moduleScanData *data = (moduleScanData*)privdata;
+    sds key = (sds)de->dictGetKey();
+    robj *keyname = createStringObject(key,sdslen(key));
+    RedisModuleKey kp;
+    long long when;
+
+    /* Logically expired keys are not reported. They can't be deleted here
+     * since the dictionary must not be modified while scanning it. */
+    when = getExpire(data->ctx->_client->m_cur_selected_db,keyname);
+    if (when == -1 || when > data->now) {
+        moduleInitKey(&kp,data->ctx,keyname,(robj*)de->dictGetVal(),
+                      REDISMODULE_READ);
+        data->fn(data->ctx,keyname,&kp,data->privdata);
+        moduleCloseKey(&kp);
+    }
+    decrRefCount(keyname);
+}
+
+/* Scan the keyspace of the selected DB, calling 'fn' for a few keys
+ * at every call:
+ *
+ *     RedisModuleScanCursor *c = RedisModule_ScanCursorCreate();
+ *     while(RedisModule_Scan(ctx, c, callback, privdata));
+ *     RedisModule_ScanCursorDestroy(c);
+ *
+ * The callback receives the key name and a key handle opened for reading,
+ * both valid only for the duration of the callback:
+ *
+ *     void callback(RedisModuleCtx *ctx, RedisModuleString *keyname,
+ *                   RedisModuleKey *key, void *privdata);
+ *
+ * The guarantees are the ones of the SCAN command: elements present in
+ * the keyspace from the start to the end of the iteration are reported at
+ * least once, others may or may not be reported, and elements may be
+ * reported multiple times. Since it is possible to release the lock
+ * between calls (from a thread safe context), this is suitable for long
+ * running background tasks. The callback must not modify the keyspace:
+ * collect the key names instead, and act on them after RM_Scan() returns.
+ *
+ * The function returns 1 if there are more elements to scan, otherwise 0
+ * is returned, with errno set to ENOENT if the cursor was already done. */
+int RM_Scan(RedisModuleCtx *ctx, RedisModuleScanCursor *cursor,
+            RedisModuleScanCB fn, void *privdata)
+{
+    moduleScanData data = {ctx, fn, privdata, mstime()};
+
+    if (cursor->done) {
+        errno = ENOENT;
+        return 0;
+    }
+    cursor->cursor = ctx->_client->m_cur_selected_db->m_dict->dictScan(
+        cursor->cursor,moduleScanCallback,NULL,&data);
+    if (cursor->cursor == 0) cursor->done = 1;
+    errno = 0;
+    return !cursor->done;
+}
+
+typedef struct {
+    RedisModuleKey *key;
+    RedisModuleScanKeyCB fn;
+    void *privdata;
+} moduleScanKeyData;
+
+void moduleScanKeyCallback(void *privdata, const dictEntry *de) {
+    moduleScanKeyData *data = (moduleScanKeyData*)privdata;
+    sds ele = (sds)de->dictGetKey();
+    robj *field = createStringObject(ele,sdslen(ele));
+    robj *value = NULL;
+
+    if (data->key->value->type == OBJ_HASH) {
+        sds val = (sds)de->dictGetVal();
+        value = createStringObject(val,sdslen(val));
+    } else if (data->key->value->type == OBJ_ZSET) {
+        value = createStringObjectFromLongDouble(*(double*)de->dictGetVal(),0);
+    }
+    data->fn(data->key,field,value,data->privdata);
+    decrRefCount(field);
+    if (value) decrRefCount(value);
+}
+
+/* Scan the elements of the hash, set or sorted set at 'key', calling 'fn'
+ * for a few elements at every call, like RM_Scan() does for the keyspace:
+ *
+ *     void callback(RedisModuleKey *key, RedisModuleString *field,
+ *                   RedisModuleString *value, void *privdata);
+ *
+ * For hashes 'value' is the value of the field, for sorted sets the score
+ * of the element, and for sets it is NULL. The strings are valid only for
+ * the duration of the callback, use RedisModule_RetainString() to keep
+ * them. Small aggregates, not encoded as hash tables, are reported all at
+ * once. The callback must not modify the key.
+ *
+ * The function returns 1 if there are more elements to scan, otherwise 0
+ * is returned and errno is set to:
+ *
+ * ENOENT: the cursor was already done.
+ * EINVAL: the key is empty or of a type that can't be scanned. */
+int RM_ScanKey(RedisModuleKey *key, RedisModuleScanCursor *cursor,
+               RedisModuleScanKeyCB fn, void *privdata)
+{
+    robj *o;
+    dict *ht = NULL;
+
+    if (key == NULL || key->value == NULL) {
+        errno = EINVAL;
+        return 0;
+    }
+    o = key->value;
+    if (o->type == OBJ_SET) {
+        if (o->encoding == OBJ_ENCODING_HT) ht = (dict*)o->ptr;
+    } else if (o->type == OBJ_HASH) {
+        if (o->encoding == OBJ_ENCODING_HT) ht = (dict*)o->ptr;
+    } else if (o->type == OBJ_ZSET) {
+        if (o->encoding == OBJ_ENCODING_SKIPLIST) ht = ((zset*)o->ptr)->_dict;
+    } else {
+        errno = EINVAL;
+        return 0;
+    }
+    if (cursor->done) {
+        errno = ENOENT;
+        return 0;
+    }
+
+    if (ht) {
+        moduleScanKeyData data = {key, fn, privdata};
+
+        cursor->cursor = ht->dictScan(cursor->cursor,moduleScanKeyCallback,
+                                      NULL,&data);
+        if (cursor->cursor == 0) cursor->done = 1;
+    } else if (o->type == OBJ_SET) {
+        int pos = 0;
+        int64_t ll;
+
+        while(((intset *)o->ptr)->intsetGet(pos++,&ll)) {
+            robj *field = createStringObjectFromLongLong(ll);
+            fn(key,field,NULL,privdata);
+            decrRefCount(field);
+        }
+        cursor->done = 1;
+    } else {
+        /* Hashes and sorted sets encoded as ziplists of field / value
+         * or element / score pairs. */
+        unsigned char *p = ziplistIndex((unsigned char *)o->ptr,0);
+        unsigned char *vstr;
+        unsigned int vlen;
+        long long vll;
+
+        while(p) {
+            robj *field, *value;
+
+            ziplistGet(p,&vstr,&vlen,&vll);
+            field = (vstr != NULL) ? createStringObject((char*)vstr,vlen) :
+                                     createStringObjectFromLongLong(vll);
+            p = ziplistNext((unsigned char *)o->ptr,p);
+            ziplistGet(p,&vstr,&vlen,&vll);
+            value = (vstr != NULL) ? createStringObject((char*)vstr,vlen) :
+                                     createStringObjectFromLongLong(vll);
+            p = ziplistNext((unsigned char *)o->ptr,p);
+            fn(key,field,value,privdata);
+            decrRefCount(field);
+            decrRefCount(value);
+        }
+        cursor->done = 1;
+    }
+    errno = 0;
+    return !cursor->done;
+}
+
 /* --------------------------------------------------------------------------
  * Redis <-> Modules generic Call() API
  * -------------------------------------------------------------------------- */
@@ -2492,6 +2855,131 @@ RedisModuleString *RM_CreateStringFromCallReply(RedisModuleCallReply *reply) {
     }
 }
 
+/* ---------------------------- RM_Call() clients ---------------------------
+ *
+ * Creating and releasing a fake client for every RM_Call() is a large part
+ * of the cost of calling a fast command, so RM_Call() takes its client from
+ * a small pool, and returns it to the pool once the reply was collected.
+ * Every pooled client also caches its argument vector and, like the Lua
+ * client does, the small string objects used as arguments, so that calling
+ * a command with C string arguments does not allocate any object in the
+ * common case. Since RM_Call() can be called recursively (a module command
+ * calling another module command), the clients in use are never in the
+ * pool, and when the pool is empty a new client is created. */
+
+#define MODULE_CALL_POOL_SIZE 8
+#define MODULE_CALL_OBJCACHE_SIZE 16
+#define MODULE_CALL_OBJCACHE_MAX_LEN 64
+
+typedef struct moduleCallClient {
+    client *c;
+    robj **argv;            /* Argument vector reused across calls. */
+    int argv_size;          /* Number of slots allocated in argv. */
+    robj *cached_objects[MODULE_CALL_OBJCACHE_SIZE];
+    size_t cached_objects_len[MODULE_CALL_OBJCACHE_SIZE];
+} moduleCallClient;
+
+static moduleCallClient *moduleCallPool[MODULE_CALL_POOL_SIZE];
+static int moduleCallPoolLen = 0;
+
+/* Get a client for RM_Call() from the pool, or create a new one. */
+static moduleCallClient *moduleGetCallClient(void) {
+    moduleCallClient *mc;
+
+    if (moduleCallPoolLen) return moduleCallPool[--moduleCallPoolLen];
+    mc = (moduleCallClient*)zcalloc(sizeof(*mc));
+    mc->c = createClient(-1);
+    mc->c->m_flags |= CLIENT_MODULE;
+    return mc;
+}
+
+static void moduleFreeCallClient(moduleCallClient *mc) {
+    int j;
+
+    for (j = 0; j < MODULE_CALL_OBJCACHE_SIZE; j++)
+        if (mc->cached_objects[j]) decrRefCount(mc->cached_objects[j]);
+    if (mc->c->m_argv == mc->argv) mc->c->m_argv = NULL;
+    zfree(mc->argv);
+    freeClient(mc->c);
+    zfree(mc);
+}
+
+/* Release the arguments and the reply of the last command executed by
+ * the client, and put it back into the pool. The client is freed instead
+ * if the command changed its state in a way a new client would not
+ * expect, for instance because of MULTI, WATCH or SUBSCRIBE. */
+static void moduleReleaseCallClient(moduleCallClient *mc) {
+    client *c = mc->c;
+    int j;
+
+    /* Command code may have changed argv/argc so we use the argv/argc of
+     * the client instead of the original vector. */
+    for (j = 0; j < c->m_argc; j++) {
+        robj *o = c->m_argv[j];
+
+        /* Try to cache the object: it must be small, SDS-encoded, and
+         * with refcount = 1 (we must be the only owner). */
+        if (j < MODULE_CALL_OBJCACHE_SIZE &&
+            o->refcount == 1 &&
+            (o->encoding == OBJ_ENCODING_RAW ||
+             o->encoding == OBJ_ENCODING_EMBSTR) &&
+            sdslen((sds)o->ptr) <= MODULE_CALL_OBJCACHE_MAX_LEN)
+        {
+            if (mc->cached_objects[j]) decrRefCount(mc->cached_objects[j]);
+            mc->cached_objects[j] = o;
+            mc->cached_objects_len[j] = sdsalloc((sds)o->ptr);
+        } else {
+            decrRefCount(o);
+        }
+    }
+    /* If the vector was replaced, the original one was already freed. */
+    if (c->m_argv && c->m_argv != mc->argv) {
+        mc->argv = c->m_argv;
+        mc->argv_size = c->m_argc;
+    }
+    c->m_argv = NULL;
+    c->m_argc = 0;
+    c->m_cmd = NULL;
+
+    c->m_response_buff_pos = 0;
+    while(c->m_reply->listLength())
+        c->m_reply->listDelNode(c->m_reply->listFirst());
+    c->m_reply_bytes = 0;
+
+    if (moduleCallPoolLen == MODULE_CALL_POOL_SIZE ||
+        (c->m_flags & ~(CLIENT_MODULE|CLIENT_READONLY|CLIENT_ASKING)) ||
+        c->m_watched_keys->listLength() ||
+        c->m_pubsub_channels->dictSize() ||
+        c->m_pubsub_patterns->listLength() ||
+        c->m_client_name)
+    {
+        moduleFreeCallClient(mc);
+        return;
+    }
+    moduleCallPool[moduleCallPoolLen++] = mc;
+}
+
+/* Return a string object with the specified content to be used as the
+ * argument at position 'j', reusing a cached object of the RM_Call()
+ * client 'mc' when possible. */
+static robj *moduleCreateArgvString(moduleCallClient *mc, int j,
+                                    const char *ptr, size_t len)
+{
+    if (mc && j < MODULE_CALL_OBJCACHE_SIZE && mc->cached_objects[j] &&
+        mc->cached_objects_len[j] >= len)
+    {
+        robj *o = mc->cached_objects[j];
+        sds s = (sds)o->ptr;
+
+        mc->cached_objects[j] = NULL;
+        memcpy(s,ptr,len);
+        s[len] = '\0';
+        sdssetlen(s,len);
+        return o;
+    }
+    return createStringObject(ptr,len);
+}
+
 /* Returns an array of robj pointers, and populates *argc with the number
  * of items, by parsing the format specifier "fmt" as described for
  * the RM_Call(), RM_Replicate() and other module APIs.
@@ -2507,16 +2995,31 @@ RedisModuleString *RM_CreateStringFromCallReply(RedisModuleCallReply *reply) {
 #define REDISMODULE_ARGV_REPLICATE (1<<0)
 
 robj **moduleCreateArgvFromUserFormat(const char *cmdname, const char *fmt, int *argcp, int *flags, va_list ap) {
+    return moduleCreateCallArgv(NULL,cmdname,fmt,argcp,flags,ap);
+}
+
+/* Like moduleCreateArgvFromUserFormat(), but if 'mc' is not NULL the
+ * argument vector and the string objects of the RM_Call() client 'mc'
+ * are reused. In this case the returned vector is owned by 'mc'. */
+static robj **moduleCreateCallArgv(moduleCallClient *mc, const char *cmdname, const char *fmt, int *argcp, int *flags, va_list ap) {
     int argc = 0, argv_size, j;
     robj **argv = NULL;
 
     /* As a first guess to avoid useless reallocations, size argv to
      * hold one argument for each char specifier in 'fmt'. */
     argv_size = strlen(fmt)+1; /* +1 because of the command name. */
-    argv = (robj **)zrealloc(argv,sizeof(robj*)*argv_size);
+    if (mc && mc->argv_size >= argv_size) {
+        argv = mc->argv;
+    } else {
+        argv = (robj **)zrealloc(mc ? mc->argv : NULL,sizeof(robj*)*argv_size);
+        if (mc) {
+            mc->argv = argv;
+            mc->argv_size = argv_size;
+        }
+    }
 
     /* Build the arguments vector based on the format specifier. */
-    argv[0] = createStringObject(cmdname,strlen(cmdname));
+    argv[0] = moduleCreateArgvString(mc,0,cmdname,strlen(cmdname));
     argc++;
 
     /* Create the client and dispatch the command. */
@@ -2524,7 +3027,8 @@ robj **moduleCreateArgvFromUserFormat(const char *cmdname, const char *fmt, int
     while(*p) {
         if (*p == 'c') {
             char *cstr = (char *)va_arg(ap,char*);
-            argv[argc++] = createStringObject(cstr,strlen(cstr));
+            argv[argc] = moduleCreateArgvString(mc,argc,cstr,strlen(cstr));
+            argc++;
         } else if (*p == 's') {
             robj *obj = (robj *)va_arg(ap,void*);
             argv[argc++] = obj;
@@ -2532,10 +3036,17 @@ robj **moduleCreateArgvFromUserFormat(const char *cmdname, const char *fmt, int
         } else if (*p == 'b') {
             char *buf = (char *)va_arg(ap,char*);
             size_t len = (size_t)va_arg(ap,size_t);
-            argv[argc++] = createStringObject(buf,len);
+            argv[argc] = moduleCreateArgvString(mc,argc,buf,len);
+            argc++;
         } else if (*p == 'l') {
-            long ll = (long)va_arg(ap,long long);
-            argv[argc++] = createObject(OBJ_STRING,sdsfromlonglong(ll));
+            /* Commands expect sds encoded arguments, so the number is
+             * converted to its string form instead of using a shared or
+             * INT encoded object. */
+            char buf[LONG_STR_SIZE];
+            long long ll = (long long)va_arg(ap,long long);
+            int len = ll2string(buf,sizeof(buf),ll);
+            argv[argc] = moduleCreateArgvString(mc,argc,buf,len);
+            argc++;
         } else if (*p == 'v') {
              /* A vector of strings */
              robj **v = (robj **)va_arg(ap, void*);
@@ -2545,7 +3056,13 @@ robj **moduleCreateArgvFromUserFormat(const char *cmdname, const char *fmt, int
               * We resize by vector_len-1 elements, because we held
               * one element in argv for the vector already */
              argv_size += vlen-1;
-             argv = (robj **)zrealloc(argv,sizeof(robj*)*argv_size);
+             if (mc == NULL || mc->argv_size < argv_size) {
+                 argv = (robj **)zrealloc(argv,sizeof(robj*)*argv_size);
+                 if (mc) {
+                     mc->argv = argv;
+                     mc->argv_size = argv_size;
+                 }
+             }
 
              size_t i = 0;
              for (i = 0; i < vlen; i++) {
@@ -2565,7 +3082,7 @@ robj **moduleCreateArgvFromUserFormat(const char *cmdname, const char *fmt, int
 fmterr:
     for (j = 0; j < argc; j++)
         decrRefCount(argv[j]);
-    zfree(argv);
+    if (mc == NULL) zfree(argv);
     return NULL;
 }
 
@@ -2574,9 +3091,11 @@ fmterr:
  * NULL is returned and errno is set to the following values:
  *
  * EINVAL: command non existing, wrong arity, wrong format specifier.
- * EPERM:  operation in Cluster instance with key in non local slot. */
+ * EPERM:  operation in Cluster instance with key in non local slot, or
+ *         the context holds the read lock (see RM_ThreadSafeContextReadLock). */
 RedisModuleCallReply *RM_Call(RedisModuleCtx *ctx, const char *cmdname, const char *fmt, ...) {
     struct redisCommand *cmd;
+    moduleCallClient *mc;
     client *c = NULL;
     robj **argv = NULL;
     int argc = 0, flags = 0;
@@ -2586,21 +3105,27 @@ RedisModuleCallReply *RM_Call(RedisModuleCtx *ctx, const char *cmdname, const ch
     int call_flags;
     sds proto;
     
+    if (ctx->flags & REDISMODULE_CTX_READ_LOCKED) {
+        errno = EPERM;
+        return NULL;
+    }
+
     cmd = lookupCommandByCString((char*)cmdname);
     if (!cmd) {
         errno = EINVAL;
         return NULL;
     }
 
-    /* Create the client and dispatch the command. */
+    /* Get a client and dispatch the command. */
     va_start(ap, fmt);
-    c = createClient(-1);
-    argv = moduleCreateArgvFromUserFormat(cmdname,fmt,&argc,&flags,ap);
+    mc = moduleGetCallClient();
+    c = mc->c;
+    argv = moduleCreateCallArgv(mc,cmdname,fmt,&argc,&flags,ap);
     replicate = flags & REDISMODULE_ARGV_REPLICATE;
     va_end(ap);
 
     /* Setup our fake client for command execution. */
-    c->m_flags |= CLIENT_MODULE;
+    c->m_flags &= ~(CLIENT_READONLY|CLIENT_ASKING);
     c->m_cur_selected_db = ctx->_client->m_cur_selected_db;
     c->m_argv = argv;
     c->m_argc = argc;
@@ -2620,7 +3145,6 @@ RedisModuleCallReply *RM_Call(RedisModuleCtx *ctx, const char *cmdname, const ch
      * received from our master. */
     if (server.cluster_enabled && !(ctx->_client->m_flags & CLIENT_MASTER)) {
         /* Duplicate relevant flags in the module client. */
-        c->m_flags &= ~(CLIENT_READONLY|CLIENT_ASKING);
         c->m_flags |= ctx->_client->m_flags & (CLIENT_READONLY|CLIENT_ASKING);
         if (getNodeByQuery(c,c->m_cmd,c->m_argv,c->m_argc,NULL,NULL) !=
                            server.cluster->m_myself)
@@ -2643,11 +3167,13 @@ RedisModuleCallReply *RM_Call(RedisModuleCtx *ctx, const char *cmdname, const ch
     }
     call(c,call_flags);
 
-    /* Convert the result of the Redis command into a suitable Lua type.
-     * The first thing we need is to create a single string from the client
-     * output buffers. */
+    /* Create a single string from the client output buffers: the reply
+     * object parses it lazily, without further copies. When the reply
+     * does not fit the static buffer, make room for the whole reply at
+     * once. */
     proto = sdsnewlen(c->m_response_buff,c->m_response_buff_pos);
-    c->m_response_buff_pos = 0;
+    if (c->m_reply->listLength())
+        proto = sdsMakeRoomFor(proto,c->m_reply_bytes);
     while(c->m_reply->listLength()) {
         sds o = (sds)c->m_reply->listFirst()->listNodeValue();
 
@@ -2658,7 +3184,7 @@ RedisModuleCallReply *RM_Call(RedisModuleCtx *ctx, const char *cmdname, const ch
     autoMemoryAdd(ctx,REDISMODULE_AM_REPLY,reply);
 
 cleanup:
-    freeClient(c);
+    moduleReleaseCallClient(mc);
     return reply;
 }
 
@@ -2669,6 +3195,284 @@ const char *RM_CallReplyProto(RedisModuleCallReply *reply, size_t *len) {
     return reply->proto;
 }
 
+/* --------------------------------------------------------------------------
+ * Keyspace notifications API
+ * -------------------------------------------------------------------------- */
+
+typedef int (*RedisModuleNotificationFunc)(RedisModuleCtx *ctx, int type,
+                                           const char *event, robj *key);
+
+/* A module subscribed to keyspace events with
+ * RM_SubscribeToKeyspaceEvents(). */
+typedef struct RedisModuleKeyspaceSubscriber {
+    RedisModule *module;
+    RedisModuleNotificationFunc notify_callback;
+    int event_mask;     /* NOTIFY_* classes of events to receive. */
+    int active;         /* True while the callback runs, to avoid recursion
+                           when the callback itself generates events. */
+} RedisModuleKeyspaceSubscriber;
+
+static list *moduleKeyspaceSubscribers;
+
+/* Fake client used to run the callbacks, created at the first
+ * subscription. */
+static client *moduleKeyspaceSubscribersClient = NULL;
+
+/* Subscribe to keyspace notifications. This way a module can observe the
+ * changes of the data set synchronously, without Pub/Sub traffic: the
+ * callback is invoked directly with the class of the event, the event name
+ * and the key, while the event is fired.
+ *
+ * 'types' is a mask of the classes of events to receive:
+ *
+ *  - REDISMODULE_NOTIFY_GENERIC: Generic commands like DEL, EXPIRE, RENAME.
+ *  - REDISMODULE_NOTIFY_STRING: String events.
+ *  - REDISMODULE_NOTIFY_LIST: List events.
+ *  - REDISMODULE_NOTIFY_SET: Set events.
+ *  - REDISMODULE_NOTIFY_HASH: Hash events.
+ *  - REDISMODULE_NOTIFY_ZSET: Sorted Set events.
+ *  - REDISMODULE_NOTIFY_EXPIRED: Expiration events.
+ *  - REDISMODULE_NOTIFY_EVICTED: Eviction events.
+ *  - REDISMODULE_NOTIFY_ALL: All events.
+ *
+ * The callback has the following signature:
+ *
+ *   int callback(RedisModuleCtx *ctx, int type, const char *event,
+ *                RedisModuleString *key);
+ *
+ * The context has the database of the key selected. Module callbacks are
+ * invoked regardless of the notify-keyspace-events configuration, and
+ * should be fast since they run synchronously inside the command that
+ * fired the event. Events fired by the callback itself are not delivered
+ * again to the same callback.
+ *
+ * The key string is valid only for the duration of the callback, use
+ * RedisModule_RetainString() to keep it. */
+int RM_SubscribeToKeyspaceEvents(RedisModuleCtx *ctx, int types,
+                                 RedisModuleNotificationFunc callback)
+{
+    RedisModuleKeyspaceSubscriber *sub =
+        (RedisModuleKeyspaceSubscriber*)zmalloc(sizeof(*sub));
+
+    sub->module = ctx->module;
+    sub->event_mask = types;
+    sub->notify_callback = callback;
+    sub->active = 0;
+    if (moduleKeyspaceSubscribersClient == NULL) {
+        moduleKeyspaceSubscribersClient = createClient(-1);
+        moduleKeyspaceSubscribersClient->m_flags |= CLIENT_MODULE;
+    }
+    moduleKeyspaceSubscribers->listAddNodeTail(sub);
+    return REDISMODULE_OK;
+}
+
+/* Return true if some module subscribed to keyspace events. */
+int moduleHasKeyspaceSubscribers(void) {
+    return moduleKeyspaceSubscribers->listLength() != 0;
+}
+
+/* Dispatch a keyspace event to the subscribed modules. Called by
+ * notifyKeyspaceEvent() for every event, so when no module is
+ * subscribed it costs just a list length check. */
+void moduleNotifyKeyspaceEvent(int type, const char *event, robj *key, int dbid) {
+    listNode *ln;
+
+    if (moduleKeyspaceSubscribers->listLength() == 0) return;
+
+    listIter li(moduleKeyspaceSubscribers);
+    while((ln = li.listNext())) {
+        RedisModuleKeyspaceSubscriber *sub =
+            (RedisModuleKeyspaceSubscriber*)ln->listNodeValue();
+
+        if ((sub->event_mask & type) && !sub->active) {
+            RedisModuleCtx ctx = REDISMODULE_CTX_INIT;
+
+            ctx.module = sub->module;
+            ctx._client = moduleKeyspaceSubscribersClient;
+            ctx._client->selectDb(dbid);
+            sub->active = 1;
+            sub->notify_callback(&ctx,type,event,key);
+            sub->active = 0;
+            moduleFreeContext(&ctx);
+        }
+    }
+}
+
+/* Remove the keyspace subscriptions of a module being unloaded. */
+void moduleUnsubscribeNotifications(RedisModule *module) {
+    listNode *ln;
+
+    listIter li(moduleKeyspaceSubscribers);
+    while((ln = li.listNext())) {
+        RedisModuleKeyspaceSubscriber *sub =
+            (RedisModuleKeyspaceSubscriber*)ln->listNodeValue();
+
+        if (sub->module == module) {
+            moduleKeyspaceSubscribers->listDelNode(ln);
+            zfree(sub);
+        }
+    }
+}
+
+/* --------------------------------------------------------------------------
+ * Modules Timers API
+ *
+ * Module timers are backed by time events of the main event loop, so the
+ * callbacks run in the main thread with a valid context and without the
+ * need to acquire the GIL. Timers have millisecond resolution and fire
+ * only once: periodic tasks can create a new timer from the callback.
+ * -------------------------------------------------------------------------- */
+
+typedef void (*RedisModuleTimerProc)(RedisModuleCtx *ctx, void *data);
+
+typedef struct RedisModuleTimer {
+    RedisModule *module;            /* Module owning the timer. */
+    RedisModuleTimerProc callback;  /* Callback to invoke on expire. */
+    void *data;                     /* Private data for the callback. */
+    int dbid;                       /* Database selected at creation. */
+    long long id;                   /* Time event ID, also the timer ID. */
+    mstime_t when;                  /* Unix time the timer fires at. */
+} RedisModuleTimer;
+
+/* Timers indexed by ID, encoded big endian to be used as rax key. */
+static rax *Timers = NULL;
+
+/* Fake client used to run the timer callbacks, created with the first
+ * timer. */
+static client *moduleTimerClient = NULL;
+
+static void moduleTimerEncodeId(unsigned char *key, uint64_t id) {
+    int j;
+
+    for (j = 7; j >= 0; j--) {
+        key[j] = id & 0xff;
+        id >>= 8;
+    }
+}
+
+/* Lookup a timer of the module 'ctx' refers to. */
+static RedisModuleTimer *moduleTimerLookup(RedisModuleCtx *ctx, uint64_t id) {
+    unsigned char key[8];
+    RedisModuleTimer *timer;
+
+    if (Timers == NULL) return NULL;
+    moduleTimerEncodeId(key,id);
+    timer = (RedisModuleTimer*)raxFind(Timers,key,sizeof(key));
+    if (timer == raxNotFound || timer->module != ctx->module) return NULL;
+    return timer;
+}
+
+static void moduleTimerRemove(RedisModuleTimer *timer) {
+    unsigned char key[8];
+
+    moduleTimerEncodeId(key,timer->id);
+    raxRemove(Timers,key,sizeof(key),NULL);
+}
+
+int moduleTimerHandler(aeEventLoop *eventLoop, long long id, void *clientData) {
+    RedisModuleTimer *timer = (RedisModuleTimer*)clientData;
+    RedisModuleCtx ctx = REDISMODULE_CTX_INIT;
+    UNUSED(eventLoop);
+    UNUSED(id);
+
+    /* Remove the timer before calling the callback, so that it is no
+     * longer visible to RM_StopTimer() and RM_GetTimerInfo(). */
+    moduleTimerRemove(timer);
+    ctx.module = timer->module;
+    ctx._client = moduleTimerClient;
+    ctx._client->selectDb(timer->dbid);
+    timer->callback(&ctx,timer->data);
+    moduleFreeContext(&ctx);
+    zfree(timer);
+    return AE_NOMORE;
+}
+
+/* Create a new timer that will fire after `period` milliseconds, and will
+ * call the specified function using `data` as argument. The returned timer
+ * ID can be used to get information from the timer or to stop it before
+ * it fires. The callback has the following signature:
+ *
+ *   void callback(RedisModuleCtx *ctx, void *data);
+ *
+ * The context has selected the database that was selected in 'ctx' when
+ * the timer was created. */
+uint64_t RM_CreateTimer(RedisModuleCtx *ctx, mstime_t period,
+                        RedisModuleTimerProc callback, void *data)
+{
+    RedisModuleTimer *timer = (RedisModuleTimer*)zmalloc(sizeof(*timer));
+    unsigned char key[8];
+
+    if (period < 0) period = 0;
+    if (Timers == NULL) Timers = raxNew();
+    if (moduleTimerClient == NULL) {
+        moduleTimerClient = createClient(-1);
+        moduleTimerClient->m_flags |= CLIENT_MODULE;
+    }
+    timer->module = ctx->module;
+    timer->callback = callback;
+    timer->data = data;
+    timer->dbid = ctx->_client ? ctx->_client->m_cur_selected_db->m_id : 0;
+    timer->when = mstime()+period;
+    timer->id = server.el->aeCreateTimeEvent(period,moduleTimerHandler,
+                                             timer,NULL);
+    moduleTimerEncodeId(key,timer->id);
+    raxInsert(Timers,key,sizeof(key),timer,NULL);
+    return timer->id;
+}
+
+/* Stop a timer of the calling module, returns REDISMODULE_OK if the timer
+ * was found and stopped, otherwise REDISMODULE_ERR is returned. If 'data'
+ * is not NULL it is set to the private data the timer was created with,
+ * so that the caller can release it. */
+int RM_StopTimer(RedisModuleCtx *ctx, uint64_t id, void **data) {
+    RedisModuleTimer *timer = moduleTimerLookup(ctx,id);
+
+    if (timer == NULL) return REDISMODULE_ERR;
+    if (data) *data = timer->data;
+    server.el->aeDeleteTimeEvent(timer->id);
+    moduleTimerRemove(timer);
+    zfree(timer);
+    return REDISMODULE_OK;
+}
+
+/* Obtain information about a timer of the calling module: the
+ * milliseconds remaining before it fires, and its private data. Both
+ * 'remaining' and 'data' can be NULL. Returns REDISMODULE_ERR if the timer
+ * does not exist or already fired, otherwise REDISMODULE_OK. */
+int RM_GetTimerInfo(RedisModuleCtx *ctx, uint64_t id, uint64_t *remaining,
+                    void **data)
+{
+    RedisModuleTimer *timer = moduleTimerLookup(ctx,id);
+
+    if (timer == NULL) return REDISMODULE_ERR;
+    if (remaining) {
+        mstime_t rem = timer->when - mstime();
+        *remaining = (rem < 0) ? 0 : rem;
+    }
+    if (data) *data = timer->data;
+    return REDISMODULE_OK;
+}
+
+/* Stop all the timers of a module being unloaded. The private data of the
+ * timers is leaked since it belongs to the module. */
+void moduleStopTimers(RedisModule *module) {
+    raxIterator ri;
+
+    if (Timers == NULL) return;
+    raxStart(&ri,Timers);
+    raxSeek(&ri,"^",NULL,0);
+    while(raxNext(&ri)) {
+        RedisModuleTimer *timer = (RedisModuleTimer*)ri.data;
+
+        if (timer->module != module) continue;
+        server.el->aeDeleteTimeEvent(timer->id);
+        raxRemove(Timers,ri.key,ri.key_len,NULL);
+        raxSeek(&ri,">",ri.key,ri.key_len);
+        zfree(timer);
+    }
+    raxStop(&ri);
+}
+
 /* --------------------------------------------------------------------------
  * Modules data types
  *
@@ -3645,18 +4449,42 @@ void RM_ThreadSafeContextLock(RedisModuleCtx *ctx) {
     moduleAcquireGIL();
 }
 
-/* Release the server lock after a thread safe API call was executed. */
+/* Acquire the server lock for reading. Multiple threads holding the read
+ * lock can run at the same time, while the main thread and the threads
+ * using RM_ThreadSafeContextLock() are excluded.
+ *
+ * With the read lock only the APIs that read the dataset can be used:
+ * keys can only be opened with REDISMODULE_READ, and the functions to read
+ * strings, lists, sorted sets and hashes work as usually, without touching
+ * the access time of keys or expiring them (logically expired keys are
+ * reported as missing). Compressed list nodes are decompressed into a
+ * buffer owned by the key instead of in place, see RM_ListGetView().
+ * RM_Call() is not available and returns NULL with errno set to EPERM,
+ * since commands are free to modify the server state even when they only
+ * read the dataset. */
+void RM_ThreadSafeContextReadLock(RedisModuleCtx *ctx) {
+    pthread_rwlock_rdlock(&moduleGIL);
+    ctx->flags |= REDISMODULE_CTX_READ_LOCKED;
+    dictPauseRehashing();
+}
+
+/* Release the server lock after a thread safe API call was executed. This
+ * works both for the lock taken with RM_ThreadSafeContextLock() and with
+ * RM_ThreadSafeContextReadLock(). */
 void RM_ThreadSafeContextUnlock(RedisModuleCtx *ctx) {
-    DICT_NOTUSED(ctx);
+    if (ctx->flags & REDISMODULE_CTX_READ_LOCKED) {
+        ctx->flags &= ~REDISMODULE_CTX_READ_LOCKED;
+        dictResumeRehashing();
+    }
     moduleReleaseGIL();
 }
 
 void moduleAcquireGIL() {
-    pthread_mutex_lock(&moduleGIL);
+    pthread_rwlock_wrlock(&moduleGIL);
 }
 
 void moduleReleaseGIL() {
-    pthread_mutex_unlock(&moduleGIL);
+    pthread_rwlock_unlock(&moduleGIL);
 }
 
 /* --------------------------------------------------------------------------
@@ -3696,6 +4524,7 @@ void moduleRegisterCoreAPI();
 
 void moduleInitModulesSystem() {
     moduleUnblockedClients = listCreate();
+    moduleKeyspaceSubscribers = listCreate();
 
     server.loadmodule_queue = listCreate();
     modules = dictCreate(&modulesDictType,NULL);
@@ -3711,9 +4540,20 @@ void moduleInitModulesSystem() {
     anetNonBlock(NULL,server.module_blocked_pipe[0]);
     anetNonBlock(NULL,server.module_blocked_pipe[1]);
 
+    /* Prefer writers where supported, so that a stream of module threads
+     * taking the read lock can't starve the main thread. */
+    pthread_rwlockattr_t attr;
+    pthread_rwlockattr_init(&attr);
+#if defined(__linux__) && defined(__GLIBC__)
+    pthread_rwlockattr_setkind_np(&attr,
+        PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+    pthread_rwlock_init(&moduleGIL,&attr);
+    pthread_rwlockattr_destroy(&attr);
+
     /* Our thread-safe contexts GIL must start with already locked:
      * it is just unlocked when it's safe. */
-    pthread_mutex_lock(&moduleGIL);
+    pthread_rwlock_wrlock(&moduleGIL);
 }
 
 /* Load all the modules in the server.loadmodule_queue list, which is
@@ -3762,6 +4602,7 @@ void moduleUnregisterCommands(RedisModule *module) {
                 server.commands->dictDelete(cmdname);
                 server.orig_commands->dictDelete(cmdname);
                 sdsfree(cmdname);
+                zfree(cp->rediscmd->latency_histogram);
                 zfree(cp->rediscmd);
                 zfree(cp);
             }
@@ -3791,6 +4632,8 @@ int moduleLoad(const char *path, void **module_argv, int module_argc) {
     if (onload((void*)&ctx,module_argv,module_argc) == REDISMODULE_ERR) {
         if (ctx.module) {
             moduleUnregisterCommands(ctx.module);
+            moduleUnsubscribeNotifications(ctx.module);
+            moduleStopTimers(ctx.module);
             moduleFreeModuleStructure(ctx.module);
         }
         dlclose(handle);
@@ -3828,7 +4671,9 @@ int moduleUnload(sds name) {
 
     moduleUnregisterCommands(module);
 
-    /* Unregister all the hooks. TODO: Yet no hooks support here. */
+    /* Unregister all the hooks. */
+    moduleUnsubscribeNotifications(module);
+    moduleStopTimers(module);
 
     /* Unload the dynamic library. */
     if (dlclose(module->m_handle) == -1) {
@@ -3940,6 +4785,7 @@ void moduleRegisterCoreAPI() {
     REGISTER_API(ValueLength);
     REGISTER_API(ListPush);
     REGISTER_API(ListPop);
+    REGISTER_API(ListGetView);
     REGISTER_API(StringToLongLong);
     REGISTER_API(StringToDouble);
     REGISTER_API(Call);
@@ -3976,11 +4822,13 @@ void moduleRegisterCoreAPI() {
     REGISTER_API(ZsetFirstInLexRange);
     REGISTER_API(ZsetLastInLexRange);
     REGISTER_API(ZsetRangeCurrentElement);
+    REGISTER_API(ZsetRangeCurrentElementView);
     REGISTER_API(ZsetRangeNext);
     REGISTER_API(ZsetRangePrev);
     REGISTER_API(ZsetRangeEndReached);
     REGISTER_API(HashSet);
     REGISTER_API(HashGet);
+    REGISTER_API(HashGetView);
     REGISTER_API(IsKeysPositionRequest);
     REGISTER_API(KeyAtPos);
     REGISTER_API(GetClientId);
@@ -4019,8 +4867,18 @@ void moduleRegisterCoreAPI() {
     REGISTER_API(GetThreadSafeContext);
     REGISTER_API(FreeThreadSafeContext);
     REGISTER_API(ThreadSafeContextLock);
+    REGISTER_API(ThreadSafeContextReadLock);
     REGISTER_API(ThreadSafeContextUnlock);
     REGISTER_API(DigestAddStringBuffer);
     REGISTER_API(DigestAddLongLong);
     REGISTER_API(DigestEndSequence);
+    REGISTER_API(ScanCursorCreate);
+    REGISTER_API(ScanCursorRestart);
+    REGISTER_API(ScanCursorDestroy);
+    REGISTER_API(Scan);
+    REGISTER_API(ScanKey);
+    REGISTER_API(SubscribeToKeyspaceEvents);
+    REGISTER_API(CreateTimer);
+    REGISTER_API(StopTimer);
+    REGISTER_API(GetTimerInfo);
 }
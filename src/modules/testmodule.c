@@ -30,8 +30,11 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#define REDISMODULE_EXPERIMENTAL_API
 #include "../redismodule.h"
+#include <stdio.h>
 #include <string.h>
+#include <pthread.h>
 
 /* --------------------------------- Helpers -------------------------------- */
 
@@ -76,6 +79,76 @@ fail:
     return REDISMODULE_OK;
 }
 
+/* TEST.CALL.REUSE -- Test that consecutive Call() invocations, that reuse
+ * the same client and argument objects, don't see the previous arguments
+ * even when the command rewrites its argument vector. */
+int TestCallReuse(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    REDISMODULE_NOT_USED(argv);
+    REDISMODULE_NOT_USED(argc);
+
+    RedisModule_AutoMemory(ctx);
+    RedisModuleCallReply *reply;
+    int j;
+
+    RedisModule_Call(ctx,"DEL","cc","myfloat","mylist");
+    for (j = 0; j < 3; j++) {
+        reply = RedisModule_Call(ctx,"INCRBYFLOAT","cc","myfloat","1.5");
+        if (RedisModule_CallReplyType(reply) != REDISMODULE_REPLY_STRING)
+            goto fail;
+        RedisModule_Call(ctx,"RPUSH","cl","mylist",(long long)j);
+    }
+    reply = RedisModule_Call(ctx,"GET","c","myfloat");
+    if (!TestMatchReply(reply,"4.5")) goto fail;
+    reply = RedisModule_Call(ctx,"LRANGE","ccc","mylist","0","-1");
+    if (RedisModule_CallReplyLength(reply) != 3) goto fail;
+    if (!TestMatchReply(RedisModule_CallReplyArrayElement(reply,2),"2"))
+        goto fail;
+    reply = RedisModule_Call(ctx,"ECHO","c","foo");
+    if (!TestMatchReply(reply,"foo")) goto fail;
+
+    RedisModule_ReplyWithSimpleString(ctx,"OK");
+    return REDISMODULE_OK;
+
+fail:
+    RedisModule_ReplyWithSimpleString(ctx,"ERR");
+    return REDISMODULE_OK;
+}
+
+/* TEST.CALL.LONGLONG -- Test Call() with integer arguments used as keys,
+ * fields and values. */
+int TestCallLongLong(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    REDISMODULE_NOT_USED(argv);
+    REDISMODULE_NOT_USED(argc);
+
+    RedisModule_AutoMemory(ctx);
+    RedisModuleCallReply *reply;
+
+    RedisModule_Call(ctx,"DEL","lc",(long long)1234,"myhash");
+    reply = RedisModule_Call(ctx,"SET","ll",(long long)1234,(long long)5678);
+    if (RedisModule_CallReplyType(reply) == REDISMODULE_REPLY_ERROR)
+        goto fail;
+    reply = RedisModule_Call(ctx,"GET","c","1234");
+    if (!TestMatchReply(reply,"5678")) goto fail;
+    reply = RedisModule_Call(ctx,"APPEND","ll",(long long)1234,(long long)9);
+    if (RedisModule_CallReplyInteger(reply) != 5) goto fail;
+    reply = RedisModule_Call(ctx,"GET","l",(long long)1234);
+    if (!TestMatchReply(reply,"56789")) goto fail;
+
+    RedisModule_Call(ctx,"HSET","cll","myhash",(long long)7,(long long)-1);
+    reply = RedisModule_Call(ctx,"HGET","cl","myhash",(long long)7);
+    if (!TestMatchReply(reply,"-1")) goto fail;
+    reply = RedisModule_Call(ctx,"HGET","cc","myhash","7");
+    if (!TestMatchReply(reply,"-1")) goto fail;
+    RedisModule_Call(ctx,"DEL","lc",(long long)1234,"myhash");
+
+    RedisModule_ReplyWithSimpleString(ctx,"OK");
+    return REDISMODULE_OK;
+
+fail:
+    RedisModule_ReplyWithSimpleString(ctx,"ERR");
+    return REDISMODULE_OK;
+}
+
 /* TEST.STRING.APPEND -- Test appending to an existing string object. */
 int TestStringAppend(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
     REDISMODULE_NOT_USED(argv);
@@ -196,6 +269,295 @@ int TestCtxFlags(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
   }
 
 
+/* TEST.SCAN -- Test the keyspace and key elements scanning API. */
+void TestScanCallback(RedisModuleCtx *ctx, RedisModuleString *keyname,
+                      RedisModuleKey *key, void *privdata)
+{
+    REDISMODULE_NOT_USED(ctx);
+    REDISMODULE_NOT_USED(keyname);
+    if (RedisModule_KeyType(key) != REDISMODULE_KEYTYPE_EMPTY)
+        (*(long long*)privdata)++;
+}
+
+void TestScanKeyCallback(RedisModuleKey *key, RedisModuleString *field,
+                         RedisModuleString *value, void *privdata)
+{
+    REDISMODULE_NOT_USED(key);
+    REDISMODULE_NOT_USED(field);
+    if (value) (*(long long*)privdata)++;
+}
+
+int TestScan(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    REDISMODULE_NOT_USED(argv);
+    REDISMODULE_NOT_USED(argc);
+    RedisModuleCallReply *reply;
+    RedisModuleScanCursor *cursor;
+    RedisModuleKey *key;
+    long long keys = 0, fields = 0, dbsize;
+
+    RedisModule_AutoMemory(ctx);
+    RedisModule_Call(ctx,"DEL","c","test.scan.hash");
+    RedisModule_Call(ctx,"HMSET","cccccc","test.scan.hash",
+        "a","1","b","2","c","3");
+
+    reply = RedisModule_Call(ctx,"DBSIZE","");
+    dbsize = RedisModule_CallReplyInteger(reply);
+    cursor = RedisModule_ScanCursorCreate();
+    while(RedisModule_Scan(ctx,cursor,TestScanCallback,&keys));
+
+    key = RedisModule_OpenKey(ctx,
+        RedisModule_CreateString(ctx,"test.scan.hash",14),REDISMODULE_READ);
+    RedisModule_ScanCursorRestart(cursor);
+    while(RedisModule_ScanKey(key,cursor,TestScanKeyCallback,&fields));
+    RedisModule_ScanCursorDestroy(cursor);
+
+    if (keys != dbsize || fields != 3) {
+        RedisModule_Log(ctx,"warning","Failed SCAN Test: %lld/%lld keys, "
+            "%lld/3 fields", keys, dbsize, fields);
+        return RedisModule_ReplyWithSimpleString(ctx,"ERR");
+    }
+    return RedisModule_ReplyWithSimpleString(ctx,"OK");
+}
+
+/* TEST.NOTIFY -- Test keyspace events subscription. */
+static long long TestNotifyHashEvents = 0;
+
+int TestNotifyCallback(RedisModuleCtx *ctx, int type, const char *event,
+                       RedisModuleString *key)
+{
+    REDISMODULE_NOT_USED(ctx);
+    REDISMODULE_NOT_USED(key);
+    if (type == REDISMODULE_NOTIFY_HASH && !strcmp(event,"hset"))
+        TestNotifyHashEvents++;
+    return REDISMODULE_OK;
+}
+
+int TestNotify(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    REDISMODULE_NOT_USED(argv);
+    REDISMODULE_NOT_USED(argc);
+    long long before = TestNotifyHashEvents;
+
+    RedisModule_AutoMemory(ctx);
+    RedisModule_Call(ctx,"HSET","ccc","test.notify.hash","a","1");
+    RedisModule_Call(ctx,"SET","cc","test.notify.string","1");
+    if (TestNotifyHashEvents != before+1) {
+        RedisModule_Log(ctx,"warning","Failed NOTIFY Test: %lld events",
+            TestNotifyHashEvents-before);
+        return RedisModule_ReplyWithSimpleString(ctx,"ERR");
+    }
+    return RedisModule_ReplyWithSimpleString(ctx,"OK");
+}
+
+/* TEST.VIEWS -- Test zero-copy access to hash, list and zset elements. */
+int TestViews(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    REDISMODULE_NOT_USED(argv);
+    REDISMODULE_NOT_USED(argc);
+    RedisModuleKey *key;
+    const char *ptr;
+    size_t len;
+    long long ll;
+    double score;
+
+    RedisModule_AutoMemory(ctx);
+    RedisModule_Call(ctx,"DEL","ccc","test.views.hash","test.views.list",
+        "test.views.zset");
+    RedisModule_Call(ctx,"HSET","ccc","test.views.hash","a","foo");
+    RedisModule_Call(ctx,"HSET","ccc","test.views.hash","b","100");
+    RedisModule_Call(ctx,"RPUSH","ccc","test.views.list","bar","200");
+    RedisModule_Call(ctx,"ZADD","ccc","test.views.zset","1.5","zoo");
+
+    key = RedisModule_OpenKey(ctx,RedisModule_CreateString(ctx,
+        "test.views.hash",15),REDISMODULE_READ);
+    if (RedisModule_HashGetView(key,RedisModule_CreateString(ctx,"a",1),
+        &ptr,&len,&ll) == REDISMODULE_ERR ||
+        ptr == NULL || len != 3 || memcmp(ptr,"foo",3)) goto fail;
+    if (RedisModule_HashGetView(key,RedisModule_CreateString(ctx,"b",1),
+        &ptr,&len,&ll) == REDISMODULE_ERR ||
+        (ptr == NULL && ll != 100) ||
+        (ptr != NULL && (len != 3 || memcmp(ptr,"100",3)))) goto fail;
+    if (RedisModule_HashGetView(key,RedisModule_CreateString(ctx,"c",1),
+        &ptr,&len,&ll) != REDISMODULE_ERR) goto fail;
+
+    key = RedisModule_OpenKey(ctx,RedisModule_CreateString(ctx,
+        "test.views.list",15),REDISMODULE_READ);
+    if (RedisModule_ListGetView(key,0,&ptr,&len,&ll) == REDISMODULE_ERR ||
+        ptr == NULL || len != 3 || memcmp(ptr,"bar",3)) goto fail;
+    if (RedisModule_ListGetView(key,-1,&ptr,&len,&ll) == REDISMODULE_ERR ||
+        ptr != NULL || ll != 200) goto fail;
+    if (RedisModule_ListGetView(key,2,&ptr,&len,&ll) != REDISMODULE_ERR)
+        goto fail;
+
+    key = RedisModule_OpenKey(ctx,RedisModule_CreateString(ctx,
+        "test.views.zset",15),REDISMODULE_READ);
+    RedisModule_ZsetFirstInScoreRange(key,REDISMODULE_NEGATIVE_INFINITE,
+        REDISMODULE_POSITIVE_INFINITE,0,0);
+    if (RedisModule_ZsetRangeCurrentElementView(key,&ptr,&len,&ll,&score)
+        == REDISMODULE_ERR || ptr == NULL || len != 3 ||
+        memcmp(ptr,"zoo",3) || score != 1.5) goto fail;
+    RedisModule_ZsetRangeStop(key);
+
+    return RedisModule_ReplyWithSimpleString(ctx,"OK");
+
+fail:
+    RedisModule_Log(ctx,"warning","Failed VIEWS Test");
+    return RedisModule_ReplyWithSimpleString(ctx,"ERR");
+}
+
+/* TEST.TIMER -- Test timers creation, inspection and removal. */
+void TestTimerCallback(RedisModuleCtx *ctx, void *data) {
+    REDISMODULE_NOT_USED(data);
+    RedisModule_Call(ctx,"INCR","c","test.timer.fired");
+}
+
+int TestTimer(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    REDISMODULE_NOT_USED(argv);
+    REDISMODULE_NOT_USED(argc);
+    static int mydata;
+    RedisModuleTimerID id;
+    uint64_t remaining;
+    void *data;
+
+    id = RedisModule_CreateTimer(ctx,10000,TestTimerCallback,&mydata);
+    if (RedisModule_GetTimerInfo(ctx,id,&remaining,&data) == REDISMODULE_ERR
+        || remaining > 10000 || data != &mydata)
+    {
+        RedisModule_Log(ctx,"warning","Failed TIMER Test: bad timer info");
+        return RedisModule_ReplyWithSimpleString(ctx,"ERR");
+    }
+    data = NULL;
+    if (RedisModule_StopTimer(ctx,id,&data) == REDISMODULE_ERR ||
+        data != &mydata ||
+        RedisModule_GetTimerInfo(ctx,id,NULL,NULL) != REDISMODULE_ERR ||
+        RedisModule_StopTimer(ctx,id,NULL) != REDISMODULE_ERR)
+    {
+        RedisModule_Log(ctx,"warning","Failed TIMER Test: stop failed");
+        return RedisModule_ReplyWithSimpleString(ctx,"ERR");
+    }
+    return RedisModule_ReplyWithSimpleString(ctx,"OK");
+}
+
+/* TEST.READLOCK -- Test that threads holding the read lock can read the
+ * same compressed list at the same time. The command blocks the client,
+ * so it can't run via TEST.IT and must be called directly. */
+#define TEST_READLOCK_THREADS 4
+#define TEST_READLOCK_ITEMS 1000
+
+/* Reader thread of TEST.READLOCK. Returns non NULL on failure. */
+void *TestReadLockThread(void *arg) {
+    RedisModuleBlockedClient *bc = arg;
+    RedisModuleCtx *ctx = RedisModule_GetThreadSafeContext(bc);
+    RedisModuleString *keyname =
+        RedisModule_CreateString(ctx,"test.readlock",13);
+    const char *ptr;
+    size_t len;
+    long long ll;
+    char buf[64];
+    void *err = NULL;
+    int round, j, buflen;
+
+    for (round = 0; round < 10 && err == NULL; round++) {
+        RedisModule_ThreadSafeContextReadLock(ctx);
+        RedisModuleKey *key = RedisModule_OpenKey(ctx,keyname,
+            REDISMODULE_READ);
+        for (j = 0; j < TEST_READLOCK_ITEMS; j++) {
+            buflen = snprintf(buf,sizeof(buf),"element:%04d:%s",j,
+                "xxxxxxxxxxxxxxxxxxxxxxxx");
+            if (RedisModule_ListGetView(key,j,&ptr,&len,&ll) ==
+                REDISMODULE_ERR || ptr == NULL || len != (size_t)buflen ||
+                memcmp(ptr,buf,len))
+            {
+                err = bc;
+                break;
+            }
+        }
+        RedisModule_CloseKey(key);
+        RedisModule_ThreadSafeContextUnlock(ctx);
+    }
+    RedisModule_FreeString(ctx,keyname);
+    RedisModule_FreeThreadSafeContext(ctx);
+    return err;
+}
+
+/* Start the readers, wait for them and unblock the client. */
+void *TestReadLockMain(void *arg) {
+    RedisModuleBlockedClient *bc = arg;
+    pthread_t tid[TEST_READLOCK_THREADS];
+    int *failed = RedisModule_Alloc(sizeof(int));
+    int started = 0, j;
+
+    *failed = 0;
+    for (j = 0; j < TEST_READLOCK_THREADS; j++) {
+        if (pthread_create(&tid[started],NULL,TestReadLockThread,bc) != 0)
+            *failed = 1;
+        else
+            started++;
+    }
+    for (j = 0; j < started; j++) {
+        void *err;
+        pthread_join(tid[j],&err);
+        if (err) *failed = 1;
+    }
+    RedisModule_UnblockClient(bc,failed);
+    return NULL;
+}
+
+int TestReadLockReply(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    REDISMODULE_NOT_USED(argv);
+    REDISMODULE_NOT_USED(argc);
+    int *failed = RedisModule_GetBlockedClientPrivateData(ctx);
+
+    RedisModule_Call(ctx,"DEL","c","test.readlock");
+    if (*failed) {
+        RedisModule_Log(ctx,"warning","Failed READLOCK Test");
+        return RedisModule_ReplyWithSimpleString(ctx,"ERR");
+    }
+    return RedisModule_ReplyWithSimpleString(ctx,"OK");
+}
+
+void TestReadLockFree(void *privdata) {
+    RedisModule_Free(privdata);
+}
+
+int TestReadLock(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    REDISMODULE_NOT_USED(argv);
+    REDISMODULE_NOT_USED(argc);
+    RedisModuleCallReply *reply;
+    RedisModuleString *fill, *depth;
+    char buf[64];
+    pthread_t tid;
+    int j;
+
+    RedisModule_AutoMemory(ctx);
+
+    /* Create a list made of many small compressed nodes. The options only
+     * apply to new lists, so they are restored as soon as it is created. */
+    reply = RedisModule_Call(ctx,"CONFIG","cc","GET","list-max-ziplist-size");
+    fill = RedisModule_CreateStringFromCallReply(
+        RedisModule_CallReplyArrayElement(reply,1));
+    reply = RedisModule_Call(ctx,"CONFIG","cc","GET","list-compress-depth");
+    depth = RedisModule_CreateStringFromCallReply(
+        RedisModule_CallReplyArrayElement(reply,1));
+    RedisModule_Call(ctx,"CONFIG","ccc","SET","list-max-ziplist-size","4");
+    RedisModule_Call(ctx,"CONFIG","ccc","SET","list-compress-depth","1");
+    RedisModule_Call(ctx,"DEL","c","test.readlock");
+    for (j = 0; j < TEST_READLOCK_ITEMS; j++) {
+        snprintf(buf,sizeof(buf),"element:%04d:%s",j,
+            "xxxxxxxxxxxxxxxxxxxxxxxx");
+        RedisModule_Call(ctx,"RPUSH","cc","test.readlock",buf);
+    }
+    RedisModule_Call(ctx,"CONFIG","ccs","SET","list-max-ziplist-size",fill);
+    RedisModule_Call(ctx,"CONFIG","ccs","SET","list-compress-depth",depth);
+
+    RedisModuleBlockedClient *bc = RedisModule_BlockClient(ctx,
+        TestReadLockReply,NULL,TestReadLockFree,0);
+    if (pthread_create(&tid,NULL,TestReadLockMain,bc) != 0) {
+        RedisModule_AbortBlock(bc);
+        return RedisModule_ReplyWithError(ctx,"-ERR Can't start thread");
+    }
+    pthread_detach(tid);
+    return REDISMODULE_OK;
+}
+
 /* ----------------------------- Test framework ----------------------------- */
 
 /* Return 1 if the reply matches the specified string, otherwise log errors
@@ -263,6 +625,12 @@ int TestIt(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
     T("test.call","");
     if (!TestAssertStringReply(ctx,reply,"OK",2)) goto fail;
 
+    T("test.call.reuse","");
+    if (!TestAssertStringReply(ctx,reply,"OK",2)) goto fail;
+
+    T("test.call.longlong","");
+    if (!TestAssertStringReply(ctx,reply,"OK",2)) goto fail;
+
     T("test.ctxflags","");
     if (!TestAssertStringReply(ctx,reply,"OK",2)) goto fail;
 
@@ -275,6 +643,18 @@ int TestIt(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
     T("test.string.printf", "cc", "foo", "bar");
     if (!TestAssertStringReply(ctx,reply,"Got 3 args. argv[1]: foo, argv[2]: bar",38)) goto fail;
 
+    T("test.scan","");
+    if (!TestAssertStringReply(ctx,reply,"OK",2)) goto fail;
+
+    T("test.notify","");
+    if (!TestAssertStringReply(ctx,reply,"OK",2)) goto fail;
+
+    T("test.timer","");
+    if (!TestAssertStringReply(ctx,reply,"OK",2)) goto fail;
+
+    T("test.views","");
+    if (!TestAssertStringReply(ctx,reply,"OK",2)) goto fail;
+
     RedisModule_ReplyWithSimpleString(ctx,"ALL TESTS PASSED");
     return REDISMODULE_OK;
 
@@ -295,6 +675,14 @@ int RedisModule_OnLoad(RedisModuleCtx *ctx, RedisModuleString **argv, int argc)
         TestCall,"write deny-oom",1,1,1) == REDISMODULE_ERR)
         return REDISMODULE_ERR;
 
+    if (RedisModule_CreateCommand(ctx,"test.call.reuse",
+        TestCallReuse,"write deny-oom",0,0,0) == REDISMODULE_ERR)
+        return REDISMODULE_ERR;
+
+    if (RedisModule_CreateCommand(ctx,"test.call.longlong",
+        TestCallLongLong,"write deny-oom",0,0,0) == REDISMODULE_ERR)
+        return REDISMODULE_ERR;
+
     if (RedisModule_CreateCommand(ctx,"test.string.append",
         TestStringAppend,"write deny-oom",1,1,1) == REDISMODULE_ERR)
         return REDISMODULE_ERR;
@@ -311,6 +699,29 @@ int RedisModule_OnLoad(RedisModuleCtx *ctx, RedisModuleString **argv, int argc)
         TestCtxFlags,"readonly",1,1,1) == REDISMODULE_ERR)
         return REDISMODULE_ERR;
 
+    if (RedisModule_CreateCommand(ctx,"test.scan",
+        TestScan,"write deny-oom",0,0,0) == REDISMODULE_ERR)
+        return REDISMODULE_ERR;
+
+    if (RedisModule_CreateCommand(ctx,"test.notify",
+        TestNotify,"write deny-oom",0,0,0) == REDISMODULE_ERR)
+        return REDISMODULE_ERR;
+
+    RedisModule_SubscribeToKeyspaceEvents(ctx,REDISMODULE_NOTIFY_HASH,
+        TestNotifyCallback);
+
+    if (RedisModule_CreateCommand(ctx,"test.views",
+        TestViews,"write deny-oom",0,0,0) == REDISMODULE_ERR)
+        return REDISMODULE_ERR;
+
+    if (RedisModule_CreateCommand(ctx,"test.timer",
+        TestTimer,"readonly",0,0,0) == REDISMODULE_ERR)
+        return REDISMODULE_ERR;
+
+    if (RedisModule_CreateCommand(ctx,"test.readlock",
+        TestReadLock,"write deny-oom",0,0,0) == REDISMODULE_ERR)
+        return REDISMODULE_ERR;
+
     if (RedisModule_CreateCommand(ctx,"test.it",
         TestIt,"readonly",1,1,1) == REDISMODULE_ERR)
         return REDISMODULE_ERR;
@@ -58,7 +58,45 @@ void *dupClientReplyValue(void *o) {
 }
 
 void freeClientReplyValue(void *o) {
-    sdsfree((sds)o);
+    if (!releaseSharedReply((sds)o)) sdsfree((sds)o);
+}
+
+/* Shared replies: a reply sent to many clients, like a large Pub/Sub
+ * message, can be serialized a single time and referenced by the reply
+ * lists of all the receivers. The references are counted in
+ * server.shared_replies: a shared sds is never modified in place, and it
+ * is freed only when the last client has sent it. The table is empty
+ * unless shared replies are in flight, so normal replies only pay for a
+ * dictSize() check when released.
+ *
+ * Register 's' as a shared reply, with a single reference owned by the
+ * caller that should drop it with releaseSharedReply(). */
+sds createSharedReply(sds s) {
+    dictEntry *de = server.shared_replies->dictAddRaw(s,NULL);
+
+    serverAssert(de != NULL);
+    de->dictSetSignedIntegerVal(1);
+    return s;
+}
+
+/* Drop a reference to a shared reply, freeing it with the last one.
+ * Returns 0 if 's' is not a shared reply, and nothing was done. */
+int releaseSharedReply(sds s) {
+    dictEntry *de;
+
+    if (server.shared_replies->dictSize() == 0 ||
+        (de = server.shared_replies->dictFind(s)) == NULL) return 0;
+    de->dictSetSignedIntegerVal(de->dictGetSignedIntegerVal()-1);
+    if (de->dictGetSignedIntegerVal() == 0) {
+        server.shared_replies->dictDelete(s);
+        sdsfree(s);
+    }
+    return 1;
+}
+
+int isSharedReply(sds s) {
+    return server.shared_replies->dictSize() &&
+           server.shared_replies->dictFind(s) != NULL;
 }
 
 int listMatchObjects(void *a, void *b) {
@@ -107,33 +145,37 @@ client::client(uint64_t in_client_id, int in_fd)
  : m_client_id(in_client_id)
  , m_fd(in_fd)
  , m_client_name(NULL)
- , m_response_buff_pos(0)
  , m_query_buf(sdsempty())
  , m_pending_query_buf(sdsempty())
  , m_query_buf_peak(0)
- , m_req_protocol_type(0)
  , m_argc(0)
  , m_argv(NULL)
  , m_cmd(NULL)
  , m_last_cmd(NULL)
+ , m_slot(-1)
+ , m_req_protocol_type(0)
  , m_multi_bulk_len(0)
  , m_bulk_len(-1)
+ , m_reply(listCreate())
+ , m_reply_bytes(0)
  , m_already_sent_len(0)
- , m_flags(0)
  , m_ctime(server.unixtime)
  , m_last_interaction_time(m_ctime)
+ , m_stat_cmds(0)
+ , m_stat_cmd_usec(0)
+ , m_stat_net_input_bytes(0)
+ , m_stat_net_output_bytes(0)
+ , m_obuf_soft_limit_reached_time(0)
+ , m_flags(0)
  , m_authenticated(0)
  , m_replication_state(REPL_STATE_NONE)
  , m_repl_put_online_on_ack(0)
- , m_applied_replication_offset(0)
  , m_read_replication_offset(0)
+ , m_applied_replication_offset(0)
  , m_replication_ack_off(0)
  , m_replication_ack_time(0)
  , m_slave_listening_port(0)
  , m_slave_capabilities(SLAVE_CAPA_NONE)
- , m_reply(listCreate())
- , m_reply_bytes(0)
- , m_obuf_soft_limit_reached_time(0)
  , m_blocking_op_type(BLOCKED_NONE)
  , m_blocking_state()
  , m_last_write_global_replication_offset(0)
@@ -141,6 +183,7 @@ client::client(uint64_t in_client_id, int in_fd)
  , m_pubsub_channels(dictCreate(&objectKeyPointerValueDictType,NULL))
  , m_pubsub_patterns(listCreate())
  , m_cached_peer_id(NULL)
+ , m_response_buff_pos(0)
 {
     m_reply->listSetFreeMethod(freeClientReplyValue);
     m_reply->listSetDupMethod(dupClientReplyValue);
@@ -176,6 +219,10 @@ int client::prepareClientToWrite() {
      * handler since there is no socket at all. */
     if (m_flags & (CLIENT_LUA|CLIENT_MODULE)) return C_OK;
 
+    /* The replies to a node migrating slots to us are only inspected to
+     * detect errors, see clusterSlotImportCheckReplies(), and never sent. */
+    if (m_flags & CLIENT_SLOT_IMPORT) return C_OK;
+
     /* CLIENT REPLY OFF / SKIP handling: don't send replies. */
     if (m_flags & (CLIENT_REPLY_OFF|CLIENT_REPLY_SKIP)) return C_ERR;
 
@@ -234,9 +281,13 @@ int client::_addReplyToBuffer(const char *s, size_t len) {
 }
 
 void client::_addReplyObjectToList(robj *o) {
+    memAcctFrame maf;
+
     if (m_flags & CLIENT_CLOSE_AFTER_REPLY)
         return;
 
+    /* Replies are not part of the keyspace memory. */
+    memAcctBeginNested(&maf);
     if (m_reply->listLength() == 0) {
         sds s = sdsdup((sds)o->ptr);
         m_reply->listAddNodeTail(s);
@@ -247,7 +298,9 @@ void client::_addReplyObjectToList(robj *o) {
 
         /* Append to this object when possible. If tail == NULL it was
          * set via addDeferredMultiBulkLength(). */
-        if (tail && sdslen(tail)+sdslen((sds)o->ptr) <= PROTO_REPLY_CHUNK_BYTES) {
+        if (tail && sdslen(tail)+sdslen((sds)o->ptr) <= PROTO_REPLY_CHUNK_BYTES &&
+            !isSharedReply(tail))
+        {
             tail = sdscatsds(tail,(sds)o->ptr);
             ln->SetNodeValue(tail);
             m_reply_bytes += sdslen((sds)o->ptr);
@@ -257,17 +310,24 @@ void client::_addReplyObjectToList(robj *o) {
             m_reply_bytes += sdslen(s);
         }
     }
+    memAcctEnd(&maf);
     asyncCloseClientOnOutputBufferLimitReached();
 }
 
 /* This method takes responsibility over the sds. When it is no longer
  * needed it will be free'd, otherwise it ends up in a robj. */
 void client::_addReplySdsToList(sds s) {
+    memAcctFrame maf;
+
     if (m_flags & CLIENT_CLOSE_AFTER_REPLY) {
         sdsfree(s);
         return;
     }
 
+    /* Replies are not part of the keyspace memory, including 's' that the
+     * caller allocated. */
+    memAcctForget(zmalloc_size(sdsAllocPtr(s)));
+    memAcctBeginNested(&maf);
     if (m_reply->listLength() == 0) {
         m_reply->listAddNodeTail(s);
         m_reply_bytes += sdslen(s);
@@ -277,7 +337,9 @@ void client::_addReplySdsToList(sds s) {
 
         /* Append to this object when possible. If tail == NULL it was
          * set via addDeferredMultiBulkLength(). */
-        if (tail && sdslen(tail)+sdslen(s) <= PROTO_REPLY_CHUNK_BYTES) {
+        if (tail && sdslen(tail)+sdslen(s) <= PROTO_REPLY_CHUNK_BYTES &&
+            !isSharedReply(tail))
+        {
             tail = sdscatsds(tail,s);
             ln->SetNodeValue(tail);
             m_reply_bytes += sdslen(s);
@@ -287,12 +349,17 @@ void client::_addReplySdsToList(sds s) {
             m_reply_bytes += sdslen(s);
         }
     }
+    memAcctEnd(&maf);
     asyncCloseClientOnOutputBufferLimitReached();
 }
 
 void client::_addReplyStringToList(const char *s, size_t len) {
+    memAcctFrame maf;
+
     if (m_flags & CLIENT_CLOSE_AFTER_REPLY) return;
 
+    /* Replies are not part of the keyspace memory. */
+    memAcctBeginNested(&maf);
     if (m_reply->listLength() == 0) {
         sds node = sdsnewlen(s,len);
         m_reply->listAddNodeTail(node);
@@ -303,7 +370,9 @@ void client::_addReplyStringToList(const char *s, size_t len) {
 
         /* Append to this object when possible. If tail == NULL it was
          * set via addDeferredMultiBulkLength(). */
-        if (tail && sdslen(tail)+len <= PROTO_REPLY_CHUNK_BYTES) {
+        if (tail && sdslen(tail)+len <= PROTO_REPLY_CHUNK_BYTES &&
+            !isSharedReply(tail))
+        {
             tail = sdscatlen(tail,s,len);
             ln->SetNodeValue(tail);
             m_reply_bytes += len;
@@ -313,6 +382,7 @@ void client::_addReplyStringToList(const char *s, size_t len) {
             m_reply_bytes += len;
         }
     }
+    memAcctEnd(&maf);
     asyncCloseClientOnOutputBufferLimitReached();
 }
 
@@ -322,6 +392,16 @@ void client::_addReplyStringToList(const char *s, size_t len) {
  * -------------------------------------------------------------------------- */
 
 void client::addReply(robj *obj) {
+    if (m_flags & CLIENT_LUA_REPLY_SINK) {
+        if (sdsEncodedObject(obj)) {
+            luaReplySinkProtocol((const char*)obj->ptr,sdslen((sds)obj->ptr));
+        } else {
+            char buf[32];
+            int len = ll2string(buf,sizeof(buf),(long)obj->ptr);
+            luaReplySinkProtocol(buf,len);
+        }
+        return;
+    }
     if (prepareClientToWrite() != C_OK)
         return;
 
@@ -359,6 +439,11 @@ void client::addReply(robj *obj) {
 }
 
 void client::addReplySds(sds s) {
+    if (m_flags & CLIENT_LUA_REPLY_SINK) {
+        luaReplySinkProtocol(s,sdslen(s));
+        sdsfree(s);
+        return;
+    }
     if (prepareClientToWrite() != C_OK) {
         /* The caller expects the sds to be free'd. */
         sdsfree(s);
@@ -372,6 +457,25 @@ void client::addReplySds(sds s) {
     }
 }
 
+/* Add a reference to the shared reply 's' to the client output list,
+ * without copying it. See createSharedReply(). The output buffer limits
+ * account the whole string to every client referencing it. */
+void client::addReplySharedSds(sds s) {
+    if (m_flags & CLIENT_LUA_REPLY_SINK) {
+        luaReplySinkProtocol(s,sdslen(s));
+        return;
+    }
+    if (prepareClientToWrite() != C_OK) return;
+    if (m_flags & CLIENT_CLOSE_AFTER_REPLY) return;
+
+    dictEntry *de = server.shared_replies->dictFind(s);
+    serverAssert(de != NULL);
+    de->dictSetSignedIntegerVal(de->dictGetSignedIntegerVal()+1);
+    m_reply->listAddNodeTail(s);
+    m_reply_bytes += sdslen(s);
+    asyncCloseClientOnOutputBufferLimitReached();
+}
+
 /* This low level function just adds whatever protocol you send it to the
  * client buffer, trying the static buffer initially, and using the string
  * of objects if not possible.
@@ -381,6 +485,10 @@ void client::addReplySds(sds s) {
  * _addReplyStringToList() if we fail to extend the existing tail object
  * in the list of objects. */
 void client::addReplyString(const char *s, size_t len) {
+    if (m_flags & CLIENT_LUA_REPLY_SINK) {
+        luaReplySinkProtocol(s,len);
+        return;
+    }
     if (prepareClientToWrite() != C_OK)
         return;
     if (_addReplyToBuffer(s,len) != C_OK)
@@ -435,25 +543,37 @@ void client::addReplyStatusFormat(const char *fmt, ...) {
 /* Adds an empty object to the reply list that will contain the multi bulk
  * length, which is not known when this function is called. */
 void* client::addDeferredMultiBulkLength() {
+    memAcctFrame maf;
+
+    if (m_flags & CLIENT_LUA_REPLY_SINK) return luaReplySinkDeferredLen();
+
     /* Note that we install the write event here even if the object is not
      * ready to be sent, since we are sure that before returning to the
      * event loop setDeferredMultiBulkLength() will be called. */
     if (prepareClientToWrite() != C_OK)
         return NULL;
+    memAcctBeginNested(&maf);
     m_reply->listAddNodeTail(NULL); /* NULL is our placeholder. */
+    memAcctEnd(&maf);
     return m_reply->listLast();
 }
 
 /* Populate the length object and try gluing it to the next chunk. */
 void client::setDeferredMultiBulkLength(void *node, long length) {
     listNode *ln = (listNode*)node;
+    memAcctFrame maf;
     sds len, next;
 
     /* Abort when *node is NULL: when the client should not accept writes
      * we return NULL in addDeferredMultiBulkLength() */
     if (node == NULL)
         return;
+    if (m_flags & CLIENT_LUA_REPLY_SINK) {
+        luaReplySinkSetDeferredLen(node,length);
+        return;
+    }
 
+    memAcctBeginNested(&maf);
     len = sdscatprintf(sdsnewlen("*",1),"%ld\r\n",length);
     ln->SetNodeValue(len);
     m_reply_bytes += sdslen(len);
@@ -469,6 +589,7 @@ void client::setDeferredMultiBulkLength(void *node, long length) {
              * amount of bytes from one node to another. */
         }
     }
+    memAcctEnd(&maf);
     asyncCloseClientOnOutputBufferLimitReached();
 }
 
@@ -521,7 +642,9 @@ void client::addReplyLongLongWithPrefix(long long ll, char prefix) {
 }
 
 void client::addReplyLongLong(long long ll) {
-    if (ll == 0)
+    if (m_flags & CLIENT_LUA_REPLY_SINK)
+        luaReplySinkLongLong(ll);
+    else if (ll == 0)
         addReply(shared.czero);
     else if (ll == 1)
         addReply(shared.cone);
@@ -530,7 +653,9 @@ void client::addReplyLongLong(long long ll) {
 }
 
 void client::addReplyMultiBulkLen(long length) {
-    if (length < OBJ_SHARED_BULKHDR_LEN)
+    if (m_flags & CLIENT_LUA_REPLY_SINK)
+        luaReplySinkMultiBulkLen(length);
+    else if (length < OBJ_SHARED_BULKHDR_LEN)
         addReply(shared.mbulkhdr[length]);
     else
         addReplyLongLongWithPrefix(length,'*');
@@ -564,6 +689,10 @@ void client::addReplyBulkLen(robj *obj) {
 
 /* Add a Redis Object as a bulk reply */
 void client::addReplyBulk(robj *obj) {
+    if ((m_flags & CLIENT_LUA_REPLY_SINK) && sdsEncodedObject(obj)) {
+        luaReplySinkBulk((const char*)obj->ptr,sdslen((sds)obj->ptr));
+        return;
+    }
     addReplyBulkLen(obj);
     addReply(obj);
     addReply(shared.crlf);
@@ -571,6 +700,10 @@ void client::addReplyBulk(robj *obj) {
 
 /* Add a C buffer as bulk reply */
 void client::addReplyBulkCBuffer(const void *p, size_t len) {
+    if (m_flags & CLIENT_LUA_REPLY_SINK) {
+        luaReplySinkBulk((const char*)p,len);
+        return;
+    }
     addReplyLongLongWithPrefix(len,'$');
     addReplyString((const char *)p,len);
     addReply(shared.crlf);
@@ -578,6 +711,11 @@ void client::addReplyBulkCBuffer(const void *p, size_t len) {
 
 /* Add sds to reply (takes ownership of sds and frees it) */
 void client::addReplyBulkSds(sds s)  {
+    if (m_flags & CLIENT_LUA_REPLY_SINK) {
+        luaReplySinkBulk(s,sdslen(s));
+        sdsfree(s);
+        return;
+    }
     addReplyLongLongWithPrefix(sdslen(s),'$');
     addReplySds(s);
     addReply(shared.crlf);
@@ -734,6 +872,7 @@ void client::freeClientArgv() {
         decrRefCount(m_argv[j]);
     m_argc = 0;
     m_cmd = NULL;
+    m_slot = -1;
 }
 
 /* Close all the slaves connections. This is useful in chained replication
@@ -826,6 +965,10 @@ client::~client()
     sdsfree(m_pending_query_buf);
     m_query_buf = NULL;
 
+    /* A slots import stops when the source node closes the link. */
+    if (m_flags & CLIENT_SLOT_IMPORT)
+        clusterSlotImportClientFreed(this);
+
     /* Deallocate structures used to block on blocking ops. */
     if (m_flags & CLIENT_BLOCKED)
         unblockClient();
@@ -972,6 +1115,7 @@ int writeToClient(int fd, client *c, int handler_installed) {
              zmalloc_used_memory() < server.maxmemory)) break;
     }
     server.stat_net_output_bytes += totwritten;
+    c->m_stat_net_output_bytes += totwritten;
     if (nwritten == -1) {
         if (errno == EAGAIN) {
             nwritten = 0;
@@ -1354,6 +1498,8 @@ void client::processInputBuffer() {
         if (m_argc == 0) {
             resetClient();
         } else {
+            int importing = m_flags & CLIENT_SLOT_IMPORT;
+
             /* Only reset the client when the command was executed. */
             if (processCommand(this) == C_OK) {
                 if (m_flags & CLIENT_MASTER && !(m_flags & CLIENT_MULTI)) {
@@ -1373,6 +1519,10 @@ void client::processInputBuffer() {
              * freed. */
             if (server.current_client == NULL)
                 break;
+
+            /* Check if the command of the slots import failed. */
+            if (importing && (m_flags & CLIENT_SLOT_IMPORT))
+                clusterSlotImportCheckReplies(this);
         }
     }
     server.current_client = NULL;
@@ -1428,6 +1578,7 @@ void readQueryFromClient(aeEventLoop *el, int fd, void *privdata, int mask) {
     c->m_last_interaction_time = server.unixtime;
     if (c->m_flags & CLIENT_MASTER) c->m_read_replication_offset += nread;
     server.stat_net_input_bytes += nread;
+    c->m_stat_net_input_bytes += nread;
     if (sdslen(c->m_query_buf) > server.client_max_querybuf_len) {
         sds ci = c->catClientInfoString(sdsempty()), bytes = sdsempty();
 
@@ -1544,7 +1695,7 @@ sds client::catClientInfoString(sds s) {
     if (emask & AE_WRITABLE) *p++ = 'w';
     *p = '\0';
     return sdscatfmt(s,
-        "id=%U addr=%s fd=%i name=%s age=%I idle=%I flags=%s db=%i sub=%i psub=%i multi=%i qbuf=%U qbuf-free=%U obl=%U oll=%U omem=%U events=%s cmd=%s",
+        "id=%U addr=%s fd=%i name=%s age=%I idle=%I flags=%s db=%i sub=%i psub=%i multi=%i qbuf=%U qbuf-free=%U obl=%U oll=%U omem=%U events=%s cmd=%s tot-cmds=%U tot-usec=%U tot-net-in=%U tot-net-out=%U",
         (unsigned long long) m_client_id,
         getClientPeerId(),
         m_fd,
@@ -1562,7 +1713,11 @@ sds client::catClientInfoString(sds s) {
         (unsigned long long) m_reply->listLength(),
         (unsigned long long) getClientOutputBufferMemoryUsage(),
         events,
-        m_last_cmd ? m_last_cmd->name : "NULL");
+        m_last_cmd ? m_last_cmd->name : "NULL",
+        m_stat_cmds,
+        m_stat_cmd_usec,
+        m_stat_net_input_bytes,
+        m_stat_net_output_bytes);
 }
 
 sds getAllClientsInfoString() {
@@ -1578,6 +1733,82 @@ sds getAllClientsInfoString() {
     return o;
 }
 
+/* Metrics CLIENT TOP can sort the clients by. */
+#define CLIENT_TOP_USEC 0
+#define CLIENT_TOP_CMDS 1
+#define CLIENT_TOP_NET_IN 2
+#define CLIENT_TOP_NET_OUT 3
+
+static int clientTopMetric; /* Metric used by clientTopCompare(). */
+
+static unsigned long long clientTopGetMetric(client *c) {
+    switch(clientTopMetric) {
+    case CLIENT_TOP_USEC: return c->m_stat_cmd_usec;
+    case CLIENT_TOP_CMDS: return c->m_stat_cmds;
+    case CLIENT_TOP_NET_IN: return c->m_stat_net_input_bytes;
+    default: return c->m_stat_net_output_bytes;
+    }
+}
+
+static int clientTopCompare(const void *a, const void *b) {
+    unsigned long long ma = clientTopGetMetric(*(client**)a);
+    unsigned long long mb = clientTopGetMetric(*(client**)b);
+
+    if (ma == mb) return 0;
+    return (ma > mb) ? -1 : 1;
+}
+
+/* CLIENT TOP <usec|cmds|net-in|net-out> [COUNT <count>]
+ *
+ * Reply with the CLIENT LIST lines of the 'count' (default 10) clients with
+ * the highest cumulative command execution time, number of commands, bytes
+ * read or bytes written. */
+static void clientTopCommand(client *c) {
+    long count = 10, numclients = 0, j;
+    client **clients;
+    listNode *ln;
+    sds o;
+
+    if (!strcasecmp((const char*)c->m_argv[2]->ptr,"usec")) {
+        clientTopMetric = CLIENT_TOP_USEC;
+    } else if (!strcasecmp((const char*)c->m_argv[2]->ptr,"cmds")) {
+        clientTopMetric = CLIENT_TOP_CMDS;
+    } else if (!strcasecmp((const char*)c->m_argv[2]->ptr,"net-in")) {
+        clientTopMetric = CLIENT_TOP_NET_IN;
+    } else if (!strcasecmp((const char*)c->m_argv[2]->ptr,"net-out")) {
+        clientTopMetric = CLIENT_TOP_NET_OUT;
+    } else {
+        c->addReply(shared.syntaxerr);
+        return;
+    }
+    if (c->m_argc == 5) {
+        if (strcasecmp((const char*)c->m_argv[3]->ptr,"count")) {
+            c->addReply(shared.syntaxerr);
+            return;
+        }
+        if (getLongFromObjectOrReply(c,c->m_argv[4],&count,NULL) != C_OK)
+            return;
+        if (count < 0) count = 0;
+    }
+
+    clients = (client**)zmalloc(sizeof(client*)*
+                                (server.clients->listLength()+1));
+    listIter li(server.clients);
+    while ((ln = li.listNext()) != NULL)
+        clients[numclients++] = (client *)ln->listNodeValue();
+    qsort(clients,numclients,sizeof(client*),clientTopCompare);
+    if (count > numclients) count = numclients;
+
+    o = sdsempty();
+    for (j = 0; j < count; j++) {
+        o = clients[j]->catClientInfoString(o);
+        o = sdscatlen(o,"\n",1);
+    }
+    zfree(clients);
+    c->addReplyBulkCBuffer(o,sdslen(o));
+    sdsfree(o);
+}
+
 void clientCommand(client *c) {
     listNode *ln;
     client *_client;
@@ -1587,6 +1818,10 @@ void clientCommand(client *c) {
         sds o = getAllClientsInfoString();
         c->addReplyBulkCBuffer(o,sdslen(o));
         sdsfree(o);
+    } else if (!strcasecmp((const char*)c->m_argv[1]->ptr,"top") &&
+               (c->m_argc == 3 || c->m_argc == 5))
+    {
+        clientTopCommand(c);
     } else if (!strcasecmp((const char*)c->m_argv[1]->ptr,"reply") && c->m_argc == 3) {
         /* CLIENT REPLY ON|OFF|SKIP */
         if (!strcasecmp((const char*)c->m_argv[2]->ptr,"on")) {
@@ -1729,7 +1964,7 @@ void clientCommand(client *c) {
         pauseClients(duration);
         c->addReply(shared.ok);
     } else {
-        c->addReplyError( "Syntax error, try CLIENT (LIST | KILL | GETNAME | SETNAME | PAUSE | REPLY)");
+        c->addReplyError( "Syntax error, try CLIENT (LIST | TOP | KILL | GETNAME | SETNAME | PAUSE | REPLY)");
     }
 }
 
@@ -1758,8 +1993,11 @@ void securityWarningCommand(client *c) {
  * ref count is decremented. */
 void client::rewriteClientCommandVector(int argc, ...) {
     va_list ap;
+    memAcctFrame maf;
     int j;
 
+    /* The command vector is not part of the keyspace memory. */
+    memAcctBeginNested(&maf);
     robj **argv = (robj **)zmalloc(sizeof(robj*)*argc);
     va_start(ap,argc);
     for (j = 0; j < argc; j++) {
@@ -1781,14 +2019,19 @@ void client::rewriteClientCommandVector(int argc, ...) {
     m_cmd = lookupCommandOrOriginal((sds)m_argv[0]->ptr);
     serverAssertWithInfo(this,NULL,m_cmd != NULL);
     va_end(ap);
+    memAcctEnd(&maf);
 }
 
 /* Completely replace the client command vector with the provided one. */
 void client::replaceClientCommandVector(int argc, robj **argv) {
+    memAcctFrame maf;
+
+    memAcctBeginNested(&maf);
     freeClientArgv();
     zfree(m_argv);
     m_argv = argv;
     m_argc = argc;
+    memAcctEnd(&maf);
     m_cmd = lookupCommandOrOriginal((sds)m_argv[0]->ptr);
     serverAssertWithInfo(this,NULL,m_cmd != NULL);
 }
@@ -1806,7 +2049,9 @@ void client::replaceClientCommandVector(int argc, robj **argv) {
  *    free the no longer used objects on c->argv. */
 void client::rewriteClientCommandArgument(int i, robj *newval) {
     robj *oldval;
+    memAcctFrame maf;
 
+    memAcctBeginNested(&maf);
     if (i >= m_argc) {
         m_argv = (robj **)zrealloc(m_argv,sizeof(robj*)*(i+1));
         m_argc = i+1;
@@ -1817,6 +2062,7 @@ void client::rewriteClientCommandArgument(int i, robj *newval) {
     incrRefCount(newval);
     if (oldval)
         decrRefCount(oldval);
+    memAcctEnd(&maf);
 
     /* If this is the command name make sure to fix c->cmd. */
     if (i == 0) {
@@ -85,46 +85,106 @@ sds keyspaceEventsFlagsToString(int flags) {
     return res;
 }
 
-/* The API provided to the rest of the Redis core is a simple function:
- *
- * notifyKeyspaceEvent(char *event, robj *key, int dbid);
- *
- * 'event' is a C string representing the event name.
- * 'key' is a Redis object representing the key name.
- * 'dbid' is the database ID where the key lives.  */
-void notifyKeyspaceEvent(int type, const char *event, robj *key, int dbid) {
-    sds chan;
+/* Channel prefixes "__keyspace@<db>__:" and "__keyevent@<db>__:" for every
+ * DB, created once at startup so that notifications don't need to format
+ * the DB number every time. */
+static sds *keyspaceChannelPrefix[2];
+
+void notifyKeyspaceEventsInit() {
+    for (int kind = 0; kind < 2; kind++) {
+        keyspaceChannelPrefix[kind] =
+            (sds *)zmalloc(sizeof(sds)*server.dbnum);
+        for (int j = 0; j < server.dbnum; j++)
+            keyspaceChannelPrefix[kind][j] = sdscatprintf(sdsempty(),
+                "__key%s@%d__:", kind ? "event" : "space", j);
+    }
+}
+
+/* Return true if the channel 's' (or the literal prefix of a pattern if
+ * 'pattern' is true) may be the channel of a keyspace (kind 0) or keyevent
+ * (kind 1) notification. The Pub/Sub layer uses this to count how many
+ * subscribers may be interested in notifications, see
+ * server.keyspace_listeners. */
+int keyspaceChannelPrefixMatch(const char *s, size_t len, int kind, int pattern) {
+    const char *prefix = kind ? "__keyevent@" : "__keyspace@";
+    size_t prefixlen = 11;
+
+    if (len < prefixlen) {
+        if (!pattern) return 0;
+        prefixlen = len;
+    }
+    return memcmp(s,prefix,prefixlen) == 0;
+}
+
+/* Deliver the event to the modules and to the Pub/Sub subscribers. */
+static void notifyKeyspaceEventToListeners(int type, const char *event, robj *key, int dbid) {
+    sds chan, prefix;
     robj *chanobj, *eventobj;
-    int len = -1;
-    char buf[24];
+    size_t eventlen;
+
+    /* Modules subscribed to keyspace events receive them regardless of
+     * the notify-keyspace-events configuration. */
+    moduleNotifyKeyspaceEvent(type,event,key,dbid);
 
     /* If notifications for this class of events are off, return ASAP. */
     if (!(server.notify_keyspace_events & type)) return;
 
-    eventobj = createStringObject(event,strlen(event));
+    /* Don't create the channels at all if no subscriber can match them. */
+    int keyspace = (server.notify_keyspace_events & NOTIFY_KEYSPACE) &&
+                   server.keyspace_listeners[0];
+    int keyevent = (server.notify_keyspace_events & NOTIFY_KEYEVENT) &&
+                   server.keyspace_listeners[1];
+    if (!keyspace && !keyevent) return;
+
+    eventlen = strlen(event);
 
     /* __keyspace@<db>__:<key> <event> notifications. */
-    if (server.notify_keyspace_events & NOTIFY_KEYSPACE) {
-        chan = sdsnewlen("__keyspace@",11);
-        len = ll2string(buf,sizeof(buf),dbid);
-        chan = sdscatlen(chan, buf, len);
-        chan = sdscatlen(chan, "__:", 3);
+    if (keyspace) {
+        prefix = keyspaceChannelPrefix[0][dbid];
+        chan = sdsMakeRoomFor(sdsempty(),
+            sdslen(prefix)+sdslen((sds)key->ptr));
+        chan = sdscatsds(chan, prefix);
         chan = sdscatsds(chan, (const sds)key->ptr);
         chanobj = createObject(OBJ_STRING, chan);
+        eventobj = createStringObject(event,eventlen);
         pubsubPublishMessage(chanobj, eventobj);
+        decrRefCount(eventobj);
         decrRefCount(chanobj);
     }
 
     /* __keyevente@<db>__:<event> <key> notifications. */
-    if (server.notify_keyspace_events & NOTIFY_KEYEVENT) {
-        chan = sdsnewlen("__keyevent@",11);
-        if (len == -1) len = ll2string(buf,sizeof(buf),dbid);
-        chan = sdscatlen(chan, buf, len);
-        chan = sdscatlen(chan, "__:", 3);
-        chan = sdscatsds(chan, (const sds)eventobj->ptr);
+    if (keyevent) {
+        prefix = keyspaceChannelPrefix[1][dbid];
+        chan = sdsMakeRoomFor(sdsempty(),sdslen(prefix)+eventlen);
+        chan = sdscatsds(chan, prefix);
+        chan = sdscatlen(chan, event, eventlen);
         chanobj = createObject(OBJ_STRING, chan);
         pubsubPublishMessage(chanobj, key);
         decrRefCount(chanobj);
     }
-    decrRefCount(eventobj);
+}
+
+/* The API provided to the rest of the Redis core is a simple function:
+ *
+ * notifyKeyspaceEvent(char *event, robj *key, int dbid);
+ *
+ * 'event' is a C string representing the event name.
+ * 'key' is a Redis object representing the key name.
+ * 'dbid' is the database ID where the key lives.  */
+void notifyKeyspaceEvent(int type, const char *event, robj *key, int dbid) {
+    memAcctFrame maf;
+    long long start;
+    int timed;
+
+    if (!(server.notify_keyspace_events & type) &&
+        !moduleHasKeyspaceSubscribers()) return;
+
+    /* The memory used to deliver the event is not part of the keyspace,
+     * while the time is reported by the slow log, if enabled. */
+    timed = server.slowlog_log_slower_than >= 0;
+    start = timed ? ustime() : 0;
+    memAcctBeginNested(&maf);
+    notifyKeyspaceEventToListeners(type,event,key,dbid);
+    memAcctEnd(&maf);
+    if (timed) server.notify_usec += ustime()-start;
 }
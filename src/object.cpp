@@ -318,7 +318,11 @@ void decrRefCount(robj *o) {
         case OBJ_MODULE: freeModuleObject(o); break;
         default: serverPanic("Unknown object type"); break;
         }
-        zfree(o);
+        /* Strings may share the allocation with the object even if they
+         * are no longer EMBSTR encoded: tryObjectEncoding() and the modules
+         * DMA API convert them in place. */
+        if (o->type == OBJ_STRING) zfree(o);
+        else zfree_with_size(o,sizeof(*o));
     } else {
         if (o->refcount <= 0) serverPanic("decrRefCount against refcount <= 0");
         if (o->refcount != OBJ_SHARED_REFCOUNT) o->refcount--;
@@ -700,7 +704,6 @@ char *strEncoding(int encoding) {
  * Note that the returned value is just an approximation, especially in the
  * case of aggregated data types where only "sample_size" elements
  * are checked and averaged to estimate the total size. */
-#define OBJ_COMPUTE_SIZE_DEF_SAMPLES 5 /* Default sample size. */
 size_t objectComputeSize(robj *o, size_t sample_size) {
     sds ele, ele2;
     dict *d;
@@ -1060,6 +1063,267 @@ void objectCommand(client *c) {
     }
 }
 
+/* ======================= Memory profiling by key prefix ===================
+ *
+ * MEMORY PREFIXES START walks the whole keyspace with dictScan(), a few
+ * buckets at a time from databasesCron(), without ever using more than
+ * memory-prefix-budget microseconds per cron cycle. The memory used by every
+ * key is estimated with objectComputeSize() (so aggregated values are
+ * sampled exactly like MEMORY USAGE does), and aggregated both by key prefix
+ * and by type/encoding. The prefix of a key is the part of its name up to
+ * and including the first of the memory-prefix-delimiters characters: keys
+ * without any delimiter are aggregated under the empty prefix.
+ *
+ * The results are only approximated: keys modified while the scan is in
+ * progress may be counted with their old or new size, and a key may even be
+ * reported twice if the table is resized, as per dictScan() guarantees. */
+
+#define MEMPREFIX_MAX_PREFIXES 10000 /* Distinct prefixes we track at most. */
+#define MEMPREFIX_DEF_COUNT 10       /* Prefixes reported by default. */
+#define MEMPREFIX_NUM_TYPES (OBJ_MODULE+1)
+#define MEMPREFIX_NUM_ENCODINGS (OBJ_ENCODING_QUICKLIST+1)
+
+#define MEMPREFIX_IDLE 0
+#define MEMPREFIX_RUNNING 1
+#define MEMPREFIX_DONE 2
+#define MEMPREFIX_STOPPED 3
+
+struct memPrefixStats {
+    unsigned long long keys;
+    unsigned long long bytes;
+    sds prefix;             /* Only set for the stats in the radix tree. */
+};
+
+static struct memPrefixState {
+    int status;             /* One of the MEMPREFIX_* states. */
+    int dbid;               /* DB we are scanning. */
+    unsigned long cursor;   /* dictScan() cursor in the current DB. */
+    sds delimiters;         /* Delimiters in use for the current scan. */
+    rax *prefixes;          /* Prefix -> memPrefixStats. */
+    unsigned long numprefixes;
+    memPrefixStats dropped; /* Keys over MEMPREFIX_MAX_PREFIXES prefixes. */
+    memPrefixStats total;
+    memPrefixStats types[MEMPREFIX_NUM_TYPES][MEMPREFIX_NUM_ENCODINGS];
+    mstime_t start_time;    /* Unix time in ms of the scan start. */
+    mstime_t end_time;      /* Unix time in ms of the scan end, or 0. */
+    long long cpu_usec;     /* Time spent scanning in cron cycles. */
+} MemPrefix;
+
+/* Free the results of the last scan. */
+static void memPrefixReset(void) {
+    if (MemPrefix.prefixes) {
+        raxIterator ri;
+
+        raxStart(&ri,MemPrefix.prefixes);
+        raxSeek(&ri,"^",NULL,0);
+        while(raxNext(&ri)) {
+            memPrefixStats *ps = (memPrefixStats*)ri.data;
+            sdsfree(ps->prefix);
+            zfree(ps);
+        }
+        raxStop(&ri);
+        raxFree(MemPrefix.prefixes);
+    }
+    sdsfree(MemPrefix.delimiters);
+    memset(&MemPrefix,0,sizeof(MemPrefix));
+}
+
+/* dictScan() callback: account the memory used by a key. */
+static void memPrefixScanCallback(void *privdata, const dictEntry *de) {
+    sds key = (sds)de->dictGetKey();
+    robj *val = (robj*)de->dictGetVal();
+    size_t keylen = sdslen(key), prefixlen = 0;
+    memPrefixStats *ps;
+    size_t usage;
+    UNUSED(privdata);
+
+    /* Same estimation of MEMORY USAGE. */
+    usage = objectComputeSize(val,OBJ_COMPUTE_SIZE_DEF_SAMPLES);
+    usage += sdsAllocSize(key);
+    usage += sizeof(dictEntry);
+
+    while(prefixlen < keylen &&
+          memchr(MemPrefix.delimiters,key[prefixlen],
+                 sdslen(MemPrefix.delimiters)) == NULL) prefixlen++;
+    prefixlen = (prefixlen == keylen) ? 0 : prefixlen+1;
+
+    ps = (memPrefixStats*)raxFind(MemPrefix.prefixes,
+                                  (unsigned char*)key,prefixlen);
+    if (ps == raxNotFound) {
+        if (MemPrefix.numprefixes < MEMPREFIX_MAX_PREFIXES) {
+            ps = (memPrefixStats*)zcalloc(sizeof(*ps));
+            ps->prefix = sdsnewlen(key,prefixlen);
+            raxInsert(MemPrefix.prefixes,(unsigned char*)key,prefixlen,ps,NULL);
+            MemPrefix.numprefixes++;
+        } else {
+            ps = &MemPrefix.dropped;
+        }
+    }
+    ps->keys++;
+    ps->bytes += usage;
+
+    if (val->type < MEMPREFIX_NUM_TYPES &&
+        val->encoding < MEMPREFIX_NUM_ENCODINGS)
+    {
+        MemPrefix.types[val->type][val->encoding].keys++;
+        MemPrefix.types[val->type][val->encoding].bytes += usage;
+    }
+    MemPrefix.total.keys++;
+    MemPrefix.total.bytes += usage;
+}
+
+/* Called by databasesCron() to advance the scan, if any, for at most
+ * memory-prefix-budget microseconds. */
+void memoryPrefixCron(void) {
+    long long start;
+    int iterations = 0;
+
+    if (MemPrefix.status != MEMPREFIX_RUNNING) return;
+
+    start = ustime();
+    while(1) {
+        redisDb *db = server.db+MemPrefix.dbid;
+
+        MemPrefix.cursor = db->m_dict->dictScan(MemPrefix.cursor,
+                               memPrefixScanCallback,NULL,NULL);
+        if (MemPrefix.cursor == 0 && ++MemPrefix.dbid >= server.dbnum) {
+            MemPrefix.status = MEMPREFIX_DONE;
+            MemPrefix.end_time = mstime();
+            serverLog(LL_VERBOSE,
+                "Memory prefixes scan done in %lldms, keys=%llu, prefixes=%lu",
+                MemPrefix.end_time - MemPrefix.start_time,
+                MemPrefix.total.keys, MemPrefix.numprefixes);
+            break;
+        }
+        /* Check the time limit once every 16 scan iterations, like the
+         * active defrag does. */
+        if (++iterations > 16) {
+            if (ustime() - start > server.memory_prefix_budget) break;
+            iterations = 0;
+        }
+    }
+    MemPrefix.cpu_usec += ustime() - start;
+}
+
+static int memPrefixStatsCompare(const void *a, const void *b) {
+    const memPrefixStats *sa = *(const memPrefixStats**)a;
+    const memPrefixStats *sb = *(const memPrefixStats**)b;
+
+    if (sa->bytes == sb->bytes) return 0;
+    return (sa->bytes > sb->bytes) ? -1 : 1;
+}
+
+/* Reply with the results of the last (or current) scan, reporting the
+ * 'count' prefixes using more memory. */
+static void memPrefixReply(client *c, long count) {
+    static const char *status[] = {"idle","running","done","stopped"};
+    static const char *types[] = {"string","list","set","zset","hash","module"};
+    memPrefixStats **sorted = NULL;
+    unsigned long j, numprefixes = 0;
+    int type, encoding, numtypes = 0;
+
+    if (MemPrefix.prefixes) {
+        raxIterator ri;
+
+        sorted = (memPrefixStats**)zmalloc(sizeof(memPrefixStats*)*
+                                           (MemPrefix.numprefixes+1));
+        raxStart(&ri,MemPrefix.prefixes);
+        raxSeek(&ri,"^",NULL,0);
+        while(raxNext(&ri)) sorted[numprefixes++] = (memPrefixStats*)ri.data;
+        raxStop(&ri);
+        qsort(sorted,numprefixes,sizeof(memPrefixStats*),memPrefixStatsCompare);
+        if ((unsigned long)count < numprefixes) numprefixes = count;
+    }
+
+    c->addReplyMultiBulkLen(20);
+    c->addReplyBulkCString("status");
+    c->addReplyBulkCString(status[MemPrefix.status]);
+    c->addReplyBulkCString("delimiters");
+    c->addReplyBulkCString(MemPrefix.delimiters ?
+                           MemPrefix.delimiters : server.memory_prefix_delimiters);
+    c->addReplyBulkCString("elapsed-ms");
+    c->addReplyLongLong(MemPrefix.start_time == 0 ? 0 :
+        (MemPrefix.end_time ? MemPrefix.end_time : mstime()) -
+        MemPrefix.start_time);
+    c->addReplyBulkCString("scan-us");
+    c->addReplyLongLong(MemPrefix.cpu_usec);
+    c->addReplyBulkCString("keys");
+    c->addReplyLongLong(MemPrefix.total.keys);
+    c->addReplyBulkCString("bytes");
+    c->addReplyLongLong(MemPrefix.total.bytes);
+    c->addReplyBulkCString("prefixes-count");
+    c->addReplyLongLong(MemPrefix.numprefixes);
+
+    c->addReplyBulkCString("prefixes");
+    c->addReplyMultiBulkLen(numprefixes);
+    for (j = 0; j < numprefixes; j++) {
+        c->addReplyMultiBulkLen(3);
+        c->addReplyBulkCBuffer(sorted[j]->prefix,sdslen(sorted[j]->prefix));
+        c->addReplyLongLong(sorted[j]->keys);
+        c->addReplyLongLong(sorted[j]->bytes);
+    }
+    zfree(sorted);
+
+    c->addReplyBulkCString("prefixes-dropped");
+    c->addReplyMultiBulkLen(2);
+    c->addReplyLongLong(MemPrefix.dropped.keys);
+    c->addReplyLongLong(MemPrefix.dropped.bytes);
+
+    c->addReplyBulkCString("types");
+    for (type = 0; type < MEMPREFIX_NUM_TYPES; type++)
+        for (encoding = 0; encoding < MEMPREFIX_NUM_ENCODINGS; encoding++)
+            if (MemPrefix.types[type][encoding].keys) numtypes++;
+    c->addReplyMultiBulkLen(numtypes);
+    for (type = 0; type < MEMPREFIX_NUM_TYPES; type++) {
+        for (encoding = 0; encoding < MEMPREFIX_NUM_ENCODINGS; encoding++) {
+            memPrefixStats *ts = &MemPrefix.types[type][encoding];
+
+            if (ts->keys == 0) continue;
+            c->addReplyMultiBulkLen(4);
+            c->addReplyBulkCString(types[type]);
+            c->addReplyBulkCString(type == OBJ_MODULE ? "raw" :
+                                   strEncoding(encoding));
+            c->addReplyLongLong(ts->keys);
+            c->addReplyLongLong(ts->bytes);
+        }
+    }
+}
+
+/* MEMORY PREFIXES START|STOP
+ * MEMORY PREFIXES [COUNT <count>] */
+static void memoryPrefixesCommand(client *c) {
+    long count = MEMPREFIX_DEF_COUNT;
+
+    if (c->m_argc == 3 && !strcasecmp((const char*)c->m_argv[2]->ptr,"start")) {
+        memPrefixReset();
+        MemPrefix.status = MEMPREFIX_RUNNING;
+        MemPrefix.delimiters = sdsnew(server.memory_prefix_delimiters);
+        MemPrefix.prefixes = raxNew();
+        MemPrefix.start_time = mstime();
+        c->addReply(shared.ok);
+        return;
+    } else if (c->m_argc == 3 &&
+               !strcasecmp((const char*)c->m_argv[2]->ptr,"stop"))
+    {
+        if (MemPrefix.status == MEMPREFIX_RUNNING) {
+            MemPrefix.status = MEMPREFIX_STOPPED;
+            MemPrefix.end_time = mstime();
+        }
+        c->addReply(shared.ok);
+        return;
+    } else if (c->m_argc == 4 &&
+               !strcasecmp((const char*)c->m_argv[2]->ptr,"count"))
+    {
+        if (getLongFromObjectOrReply(c,c->m_argv[3],&count,NULL) != C_OK)
+            return;
+        if (count < 0) count = 0;
+    } else if (c->m_argc != 2) {
+        c->addReply(shared.syntaxerr);
+        return;
+    }
+    memPrefixReply(c,count);
+}
+
 /* The memory command will eventually be a complete interface for the
  * memory introspection capabilities of Redis.
  *
@@ -1122,13 +1386,28 @@ void memoryCommand(client *c) {
             char dbname[32];
             snprintf(dbname,sizeof(dbname),"db.%zd",mh->db[j].dbid);
             c->addReplyBulkCString(dbname);
-            c->addReplyMultiBulkLen(4);
+            c->addReplyMultiBulkLen(server.memory_accounting ?
+                                    4+MEMACCT_TYPES*2 : 4);
 
             c->addReplyBulkCString("overhead.hashtable.main");
             c->addReplyLongLong(mh->db[j].overhead_ht_main);
 
             c->addReplyBulkCString("overhead.hashtable.expires");
             c->addReplyLongLong(mh->db[j].overhead_ht_expires);
+
+            /* Exact dataset memory by type, see memacct.c. */
+            if (server.memory_accounting) {
+                long long bytes[MEMACCT_TYPES];
+
+                memAcctGetBytes(server.db+mh->db[j].dbid,bytes);
+                for (int type = 0; type < MEMACCT_TYPES; type++) {
+                    char field[32];
+                    snprintf(field,sizeof(field),"dataset.%s",
+                        memAcctTypeName(type));
+                    c->addReplyBulkCString(field);
+                    c->addReplyLongLong(bytes[type]);
+                }
+            }
         }
 
         c->addReplyBulkCString("overhead.total");
@@ -1181,8 +1460,10 @@ void memoryCommand(client *c) {
         c->addReply( shared.ok);
         /* Nothing to do for other allocators. */
 #endif
+    } else if (!strcasecmp((const char*)c->m_argv[1]->ptr,"prefixes") && c->m_argc <= 4) {
+        memoryPrefixesCommand(c);
     } else if (!strcasecmp((const char*)c->m_argv[1]->ptr,"help") && c->m_argc == 2) {
-        c->addReplyMultiBulkLen(5);
+        c->addReplyMultiBulkLen(7);
         c->addReplyBulkCString(
 "MEMORY DOCTOR                        - Outputs memory problems report");
         c->addReplyBulkCString(
@@ -1193,6 +1474,10 @@ void memoryCommand(client *c) {
 "MEMORY PURGE                         - Ask the allocator to release memory");
         c->addReplyBulkCString(
 "MEMORY MALLOC-STATS                  - Show allocator internal stats");
+        c->addReplyBulkCString(
+"MEMORY PREFIXES START|STOP           - Start or stop a keyspace scan by key prefix");
+        c->addReplyBulkCString(
+"MEMORY PREFIXES [COUNT <count>]      - Show memory usage by key prefix and type");
     } else {
         c->addReplyError("Syntax error. Try MEMORY HELP");
     }
@@ -48,6 +48,97 @@ int listMatchPubsubPattern(void *a, void *b) {
            (equalStringObjects(pa->pattern,pb->pattern));
 }
 
+/* Update the count of the channels / patterns that may receive keyspace
+ * notifications when 'name' is added (delta 1) or removed (delta -1). */
+void pubsubUpdateKeyspaceListeners(const char *name, size_t len, int pattern,
+                                   int delta)
+{
+    for (int kind = 0; kind < 2; kind++) {
+        if (keyspaceChannelPrefixMatch(name,len,kind,pattern))
+            server.keyspace_listeners[kind] += delta;
+    }
+}
+
+/* Patterns are indexed by their literal prefix, that is everything before
+ * the first glob special char, so that publishing a message only needs to
+ * check the patterns whose prefix is also a prefix of the channel. Those
+ * are further checked with a matcher selected when the pattern is
+ * subscribed: the common forms "prefix*" and "prefix*suffix" don't need
+ * a full glob match. */
+int pubsubIsGlobChar(char c) {
+    return c == '*' || c == '?' || c == '[' || c == '\\';
+}
+
+void pubsubCompilePattern(pubsubPattern *pat) {
+    sds p = (sds)pat->pattern->ptr;
+    size_t len = sdslen(p), i, j;
+
+    for (i = 0; i < len && !pubsubIsGlobChar(p[i]); i++);
+    pat->prefixlen = i;
+    pat->suffixlen = 0;
+    if (i == len) {
+        pat->type = PUBSUB_PATTERN_EXACT;
+        return;
+    }
+    pat->type = PUBSUB_PATTERN_GENERIC;
+    if (p[i] != '*') return;
+
+    while (i < len && p[i] == '*') i++;
+    for (j = i; j < len && !pubsubIsGlobChar(p[j]); j++);
+    if (j != len) return;
+    pat->suffixlen = len-i;
+    pat->type = pat->suffixlen ? PUBSUB_PATTERN_PREFIX_SUFFIX :
+                                 PUBSUB_PATTERN_PREFIX;
+}
+
+/* Match the channel against the pattern, given that the channel is already
+ * known to start with the literal prefix of the pattern. */
+int pubsubPatternMatch(pubsubPattern *pat, const char *channel, size_t len) {
+    sds p = (sds)pat->pattern->ptr;
+
+    switch(pat->type) {
+    case PUBSUB_PATTERN_EXACT:
+        return len == pat->prefixlen;
+    case PUBSUB_PATTERN_PREFIX:
+        return 1;
+    case PUBSUB_PATTERN_PREFIX_SUFFIX:
+        return len >= pat->prefixlen+pat->suffixlen &&
+               memcmp(channel+len-pat->suffixlen,
+                      p+sdslen(p)-pat->suffixlen,pat->suffixlen) == 0;
+    default:
+        return stringmatchlen(p+pat->prefixlen,sdslen(p)-pat->prefixlen,
+                              channel+pat->prefixlen,len-pat->prefixlen,0);
+    }
+}
+
+void pubsubIndexPattern(pubsubPattern *pat) {
+    unsigned char *prefix = (unsigned char*)pat->pattern->ptr;
+    list *l = (list*)raxFind(server.pubsub_patterns_index,prefix,pat->prefixlen);
+
+    if (l == raxNotFound) {
+        l = listCreate();
+        raxInsert(server.pubsub_patterns_index,prefix,pat->prefixlen,l,NULL);
+    }
+    l->listAddNodeTail(pat);
+    pubsubUpdateKeyspaceListeners((char*)prefix,pat->prefixlen,1,1);
+}
+
+void pubsubUnindexPattern(pubsubPattern *pat) {
+    unsigned char *prefix = (unsigned char*)pat->pattern->ptr;
+    list *l = (list*)raxFind(server.pubsub_patterns_index,prefix,pat->prefixlen);
+    listNode *ln;
+
+    serverAssert(l != raxNotFound);
+    pubsubUpdateKeyspaceListeners((char*)prefix,pat->prefixlen,1,-1);
+    ln = l->listSearchKey(pat);
+    serverAssert(ln != NULL);
+    l->listDelNode(ln);
+    if (l->listLength() == 0) {
+        listRelease(l);
+        raxRemove(server.pubsub_patterns_index,prefix,pat->prefixlen,NULL);
+    }
+}
+
 /* Return the number of channels + patterns a client is subscribed to. */
 int clientSubscriptionsCount(client *c) {
     return c->m_pubsub_channels->dictSize()+
@@ -71,6 +162,9 @@ int pubsubSubscribeChannel(client *c, robj *channel) {
             clients = listCreate();
             server.pubsub_channels->dictAdd(channel,clients);
             incrRefCount(channel);
+            if (sdsEncodedObject(channel))
+                pubsubUpdateKeyspaceListeners((char*)channel->ptr,
+                    sdslen((sds)channel->ptr),0,1);
         } else {
             clients = (list *)de->dictGetVal();
         }
@@ -108,6 +202,9 @@ int client::pubsubUnsubscribeChannel(robj *channel, int notify) {
             /* Free the list and associated hash entry at all if this was
              * the latest client, so that it will be possible to abuse
              * Redis PUBSUB creating millions of channels. */
+            if (sdsEncodedObject(channel))
+                pubsubUpdateKeyspaceListeners((char*)channel->ptr,
+                    sdslen((sds)channel->ptr),0,-1);
             server.pubsub_channels->dictDelete(channel);
         }
     }
@@ -136,7 +233,9 @@ int pubsubSubscribePattern(client *c, robj *pattern) {
         pat = (pubsubPattern *)zmalloc(sizeof(*pat));
         pat->pattern = getDecodedObject(pattern);
         pat->client = c;
+        pubsubCompilePattern(pat);
         server.pubsub_patterns->listAddNodeTail(pat);
+        pubsubIndexPattern(pat);
     }
     /* Notify the client */
     c->addReply(shared.mbulkhdr[3]);
@@ -160,6 +259,7 @@ int client::pubsubUnsubscribePattern(robj *pattern, int notify) {
         pat.client = this;
         pat.pattern = pattern;
         ln = server.pubsub_patterns->listSearchKey(&pat);
+        pubsubUnindexPattern((pubsubPattern*)ln->listNodeValue());
         server.pubsub_patterns->listDelNode(ln);
     }
     /* Notify the client */
@@ -221,14 +321,87 @@ int client::pubsubUnsubscribeAllPatterns(int notify) {
     return count;
 }
 
+/* Messages with a channel and payload bigger than this are serialized a
+ * single time and shared among the output lists of all the receivers. */
+#define PUBSUB_SHARED_REPLY_MIN_BYTES 1024
+
+/* Return the "$<len>\r\n<channel>\r\n$<len>\r\n<message>\r\n" part of the
+ * message delivered to subscribers as a shared reply, or NULL if the message
+ * is small enough that copying it is cheaper. */
+sds pubsubCreateSharedBody(robj *channel, robj *message) {
+    sds body;
+
+    channel = getDecodedObject(channel);
+    message = getDecodedObject(message);
+    if (sdslen((sds)channel->ptr)+sdslen((sds)message->ptr) <
+        PUBSUB_SHARED_REPLY_MIN_BYTES)
+    {
+        decrRefCount(channel);
+        decrRefCount(message);
+        return NULL;
+    }
+    body = sdsMakeRoomFor(sdsempty(),
+        sdslen((sds)channel->ptr)+sdslen((sds)message->ptr)+LONG_STR_SIZE*2+6);
+    body = sdscatfmt(body,"$%u\r\n",(unsigned)sdslen((sds)channel->ptr));
+    body = sdscatsds(body,(sds)channel->ptr);
+    body = sdscatfmt(body,"\r\n$%u\r\n",(unsigned)sdslen((sds)message->ptr));
+    body = sdscatsds(body,(sds)message->ptr);
+    body = sdscatlen(body,"\r\n",2);
+    decrRefCount(channel);
+    decrRefCount(message);
+    return createSharedReply(body);
+}
+
+/* State of the delivery of a message to the matching patterns. */
+struct pubsubPatternsDelivery {
+    robj *channel;  /* Decoded channel name. */
+    robj *message;
+    sds body;       /* Shared channel + message reply, or NULL. */
+    int receivers;
+};
+
+/* raxFindPrefixes() callback: deliver the message to the patterns, in the
+ * list 'data', whose literal prefix is a prefix of the channel. */
+static void pubsubPublishToPatterns(void *data, void *privdata) {
+    pubsubPatternsDelivery *pd = (pubsubPatternsDelivery*)privdata;
+    char *chan = (char*)pd->channel->ptr;
+    size_t chanlen = sdslen((sds)pd->channel->ptr);
+    listNode *ln;
+
+    listIter li((list*)data);
+    while ((ln = li.listNext()) != NULL) {
+        pubsubPattern *pat = (pubsubPattern *)ln->listNodeValue();
+
+        if (!pubsubPatternMatch(pat,chan,chanlen)) continue;
+        pat->client->addReply(shared.mbulkhdr[4]);
+        pat->client->addReply(shared.pmessagebulk);
+        pat->client->addReplyBulk(pat->pattern);
+        if (pd->body) {
+            pat->client->addReplySharedSds(pd->body);
+        } else {
+            pat->client->addReplyBulk(pd->channel);
+            pat->client->addReplyBulk(pd->message);
+        }
+        pd->receivers++;
+    }
+}
+
 /* Publish a message */
 int pubsubPublishMessage(robj *channel, robj *message) {
     int receivers = 0;
     dictEntry *de;
-    listNode *ln;
+    sds body = NULL;
 
-    /* Send to clients listening for that channel */
+    /* Serialize the channel and the message only once if they are big and
+     * there are at least two receivers. */
     de = server.pubsub_channels->dictFind(channel);
+    if ((de ? ((list*)de->dictGetVal())->listLength() : 0) +
+        server.pubsub_patterns->listLength() > 1)
+    {
+        body = pubsubCreateSharedBody(channel,message);
+    }
+
+    /* Send to clients listening for that channel */
     if (de) {
         list* _list = (list*)de->dictGetVal();
         listNode *ln;
@@ -239,32 +412,33 @@ int pubsubPublishMessage(robj *channel, robj *message) {
 
             c->addReply(shared.mbulkhdr[3]);
             c->addReply(shared.messagebulk);
-            c->addReplyBulk(channel);
-            c->addReplyBulk(message);
+            if (body) {
+                c->addReplySharedSds(body);
+            } else {
+                c->addReplyBulk(channel);
+                c->addReplyBulk(message);
+            }
             receivers++;
         }
     }
-    /* Send to clients listening to matching channels */
+    /* Send to clients listening to matching channels: only the patterns
+     * whose literal prefix is a prefix of the channel are candidates, and
+     * they are all found with a single walk of the index. */
     if (server.pubsub_patterns->listLength()) {
-        listIter li(server.pubsub_patterns);
-        channel = getDecodedObject(channel);
-        while ((ln = li.listNext()) != NULL) {
-            pubsubPattern *pat = (pubsubPattern *)ln->listNodeValue();
-
-            if (stringmatchlen((char*)pat->pattern->ptr,
-                                sdslen((sds)pat->pattern->ptr),
-                                (char*)channel->ptr,
-                                sdslen((sds)channel->ptr),0)) {
-                pat->client->addReply(shared.mbulkhdr[4]);
-                pat->client->addReply(shared.pmessagebulk);
-                pat->client->addReplyBulk(pat->pattern);
-                pat->client->addReplyBulk(channel);
-                pat->client->addReplyBulk(message);
-                receivers++;
-            }
-        }
-        decrRefCount(channel);
+        pubsubPatternsDelivery pd;
+
+        pd.channel = getDecodedObject(channel);
+        pd.message = message;
+        pd.body = body;
+        pd.receivers = 0;
+        raxFindPrefixes(server.pubsub_patterns_index,
+                        (unsigned char*)pd.channel->ptr,
+                        sdslen((sds)pd.channel->ptr),
+                        pubsubPublishToPatterns,&pd);
+        receivers += pd.receivers;
+        decrRefCount(pd.channel);
     }
+    if (body) releaseSharedReply(body);
     return receivers;
 }
 
@@ -1250,15 +1250,12 @@ quicklist *quicklistDup(quicklist *in_orig) {
     return copy;
 }
 
-/* Populate 'entry' with the element at the specified zero-based index
- * where 0 is the head, 1 is the element next to head
- * and so on. Negative integers are used in order to count
- * from the tail, -1 is the last element, -2 the penultimate
- * and so on. If the index is out of range 0 is returned.
+/* Set 'm_node' and 'm_offset' to the position of the element at the
+ * specified index, without touching the node itself.
  *
  * Returns 1 if element found
  * Returns 0 if element not found */
-int quicklistEntry::quicklistIndex(const quicklist *in_ql, const long long idx)
+int quicklistEntry::quicklistIndexNode(const quicklist *in_ql, const long long idx)
 {
     quicklistNode *n;
     unsigned long long accum = 0;
@@ -1305,6 +1302,21 @@ int quicklistEntry::quicklistIndex(const quicklist *in_ql, const long long idx)
          * the result of the original if (index < 0) above. */
         m_offset = (-index) - 1 + accum;
     }
+    return 1;
+}
+
+/* Populate 'entry' with the element at the specified zero-based index
+ * where 0 is the head, 1 is the element next to head
+ * and so on. Negative integers are used in order to count
+ * from the tail, -1 is the last element, -2 the penultimate
+ * and so on. If the index is out of range 0 is returned.
+ *
+ * Returns 1 if element found
+ * Returns 0 if element not found */
+int quicklistEntry::quicklistIndex(const quicklist *in_ql, const long long idx)
+{
+    if (!quicklistIndexNode(in_ql, idx))
+        return 0;
 
     quicklist::quicklistDecompressNodeForUse(m_node);
     m_zip_list = ziplistIndex(m_node->m_ql_LZF, m_offset);
@@ -1314,6 +1326,41 @@ int quicklistEntry::quicklistIndex(const quicklist *in_ql, const long long idx)
     return 1;
 }
 
+/* Like quicklistIndex(), but the quicklist is never modified, so that
+ * multiple threads can read the same list at the same time. If the node
+ * holding the element is compressed, it is decompressed into '*in_buf',
+ * a zmalloc()ed buffer of '*in_buf_size' bytes owned by the caller (it can
+ * start as NULL and is grown as needed), and the entry points inside it.
+ * Such an entry can only be used to read the element.
+ *
+ * Returns 1 if element found
+ * Returns 0 if element not found */
+int quicklistEntry::quicklistIndexReadOnly(const quicklist *in_ql, const long long idx,
+                                           unsigned char **in_buf, size_t *in_buf_size)
+{
+    unsigned char *zl;
+
+    if (!quicklistIndexNode(in_ql, idx))
+        return 0;
+
+    if (quicklistNodeIsCompressed(m_node)) {
+        quicklistLZF *lzf = (quicklistLZF *)m_node->m_ql_LZF;
+        if (*in_buf_size < m_node->m_zip_list_size) {
+            *in_buf = (unsigned char *)zrealloc(*in_buf, m_node->m_zip_list_size);
+            *in_buf_size = m_node->m_zip_list_size;
+        }
+        if (lzf_decompress(lzf->m_compressed, lzf->m_LZF_size, *in_buf,
+                           m_node->m_zip_list_size) == 0)
+            return 0;
+        zl = *in_buf;
+    } else {
+        zl = m_node->m_ql_LZF;
+    }
+    m_zip_list = ziplistIndex(zl, m_offset);
+    ziplistGet(m_zip_list, &m_value, &m_size, &m_longval);
+    return 1;
+}
+
 quicklistEntry::quicklistEntry(const quicklist *in_ql, const long long idx)
 {
     quicklistIndex(in_ql, idx);
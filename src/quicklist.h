@@ -119,6 +119,8 @@ public:
     void initEntry();
 
     int quicklistIndex(const quicklist *in_ql, const long long in_index);
+    int quicklistIndexReadOnly(const quicklist *in_ql, const long long in_index,
+                               unsigned char **in_buf, size_t *in_buf_size);
 
     const quicklist *m_quicklist;
     quicklistNode *m_node;
@@ -127,6 +129,9 @@ public:
     long long m_longval;
     unsigned int m_size;
     int m_offset;
+
+private:
+    int quicklistIndexNode(const quicklist *in_ql, const long long in_index);
 };
 
 #define QUICKLIST_HEAD 0
@@ -806,6 +806,41 @@ void *raxFind(rax *rax, unsigned char *s, size_t len) {
     return raxGetData(h);
 }
 
+/* Call 'fn' with the associated value and 'privdata' for every key that is
+ * a prefix of 's' (including 's' itself), in order of increasing length.
+ * Unlike calling raxFind() for every prefix, the tree is walked only once,
+ * from the root along 's'. */
+void raxFindPrefixes(rax *rax, unsigned char *s, size_t len,
+                     void (*fn)(void *data, void *privdata), void *privdata)
+{
+    raxNode *h = rax->head;
+    size_t i = 0; /* Position in the string. */
+    size_t j;     /* Position in the node children (or bytes if compressed).*/
+
+    while(1) {
+        /* The first 'i' bytes of 's' are a key if 'h' is a key node. */
+        if (h->iskey) fn(raxGetData(h),privdata);
+        if (h->size == 0 || i == len) break;
+
+        unsigned char *v = h->data;
+        if (h->iscompr) {
+            for (j = 0; j < h->size && i < len; j++, i++) {
+                if (v[j] != s[i]) break;
+            }
+            if (j != h->size) break;
+            j = 0; /* Compressed node only child is at index 0. */
+        } else {
+            for (j = 0; j < h->size; j++) {
+                if (v[j] == s[i]) break;
+            }
+            if (j == h->size) break;
+            i++;
+        }
+        raxNode **children = raxNodeFirstChildPtr(h);
+        memcpy(&h,children+j,sizeof(h));
+    }
+}
+
 /* Return the memory address where the 'parent' node stores the specified
  * 'child' pointer, so that the caller can update the pointer with another
  * one if needed. The function assumes it will find a match, otherwise the
@@ -1522,6 +1522,7 @@ int rdbLoadRio(rio *rdb, rdbSaveInfo *rsi) {
     redisDb *db = server.db+0;
     char buf[1024];
     long long expiretime, now = mstime();
+    memAcctFrame maf;
 
     rdb->m_update_cksum_func = rdbLoadProgressCallback;
     rdb->m_max_processing_chunk = server.loading_process_events_interval_bytes;
@@ -1637,7 +1638,9 @@ int rdbLoadRio(rio *rdb, rdbSaveInfo *rsi) {
 
         /* Read key */
         if ((key = rdbLoadStringObject(rdb)) == NULL) goto eoferr;
-        /* Read value */
+        /* Read value, accounting its memory to the key being created. */
+        memAcctBegin(&maf,NULL);
+        memAcctTouch(db,MEMACCT_PENDING);
         if ((val = rdbLoadObject(type,rdb)) == NULL) goto eoferr;
         /* Check if the key already expired. This function is used when loading
          * an RDB file from disk, either at startup, or when an RDB was
@@ -1645,8 +1648,9 @@ int rdbLoadRio(rio *rdb, rdbSaveInfo *rsi) {
          * responsible for key expiry. If we would expire keys here, the
          * snapshot taken by the master may not be reflected on the slave. */
         if (server.masterhost == NULL && expiretime != -1 && expiretime < now) {
-            decrRefCount(key);
             decrRefCount(val);
+            memAcctEnd(&maf);
+            decrRefCount(key);
             continue;
         }
         /* Add the new object in the hash table */
@@ -1654,6 +1658,7 @@ int rdbLoadRio(rio *rdb, rdbSaveInfo *rsi) {
 
         /* Set the expire time if needed */
         if (expiretime != -1) setExpire(NULL,db,key,expiretime);
+        memAcctEnd(&maf);
 
         decrRefCount(key);
     }
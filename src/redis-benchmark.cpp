@@ -39,16 +39,28 @@
 #include <sys/time.h>
 #include <signal.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include <sds.h> /* Use hiredis sds. */
 #include "ae.h"
 #include "hiredis.h"
 #include "adlist.h"
 #include "zmalloc.h"
+#include "atomicvar.h"
 
 #define UNUSED(V) ((void) V)
 #define RANDPTR_INITIAL_SIZE 8
 
+/* With --threads the clients are spread over N event loops, each one served
+ * by its own thread. The counters shared by all the threads are updated with
+ * the atomicvar.h macros. */
+struct benchmarkThread {
+    pthread_t thread;
+    aeEventLoop *el;
+    list *clients;          /* Clients served by this thread. */
+    int liveclients;        /* Only accessed by the thread itself. */
+};
+
 static struct _config {
     aeEventLoop *el;
     const char *hostip;
@@ -79,6 +91,11 @@ static struct _config {
     sds dbnumstr;
     char *tests;
     char *auth;
+    int num_threads;
+    benchmarkThread *threads;
+    pthread_mutex_t liveclients_mutex;
+    pthread_mutex_t requests_issued_mutex;
+    pthread_mutex_t requests_finished_mutex;
 };
 _config config;
 
@@ -96,12 +113,15 @@ struct _client {
                                such as auth and select are prefixed to the pipeline of
                                benchmark commands and discarded after the first send. */
     int prefixlen;          /* Size in bytes of the pending prefix commands */
+    benchmarkThread *thread; /* Thread serving the client, NULL without --threads */
 };
 typedef _client* pclient;
 
 /* Prototypes */
 static void writeHandler(aeEventLoop *el, int fd, void *privdata, int mask);
 static void createMissingClients(pclient c);
+static pclient createClient(char *cmd, size_t len, pclient from,
+                            benchmarkThread *thread);
 
 /* Implementation */
 static long long ustime() {
@@ -124,22 +144,34 @@ static long long mstime() {
     return mst;
 }
 
+/* Return the event loop serving the client. */
+static aeEventLoop *clientEventLoop(pclient c) {
+    return c->thread ? c->thread->el : config.el;
+}
+
 static void freeClient(pclient c) {
+    benchmarkThread *thread = c->thread;
+    aeEventLoop *el = clientEventLoop(c);
+    list *clients = thread ? thread->clients : config.clients;
     listNode *ln;
-    config.el->aeDeleteFileEvent(c->context->fd,AE_WRITABLE);
-    config.el->aeDeleteFileEvent(c->context->fd,AE_READABLE);
+
+    el->aeDeleteFileEvent(c->context->fd,AE_WRITABLE);
+    el->aeDeleteFileEvent(c->context->fd,AE_READABLE);
     redisFree(c->context);
     sdsfree(c->obuf);
     zfree(c->randptr);
     zfree(c);
-    config.liveclients--;
-    ln = config.clients->listSearchKey(c);
+    atomicDecr(config.liveclients,1);
+    ln = clients->listSearchKey(c);
     assert(ln != NULL);
-    config.clients->listDelNode(ln);
+    clients->listDelNode(ln);
+
+    /* A thread is done once all its clients are gone. */
+    if (thread && --thread->liveclients == 0) thread->el->aeStop();
 }
 
-static void freeAllClients() {
-    listNode *ln = config.clients->listFirst();
+static void freeClientsList(list *clients) {
+    listNode *ln = clients->listFirst();
 
     while(ln) {
         listNode* next = ln->listNextNode();
@@ -148,10 +180,20 @@ static void freeAllClients() {
     }
 }
 
+static void freeAllClients() {
+    int j;
+
+    freeClientsList(config.clients);
+    for (j = 0; j < config.num_threads; j++)
+        freeClientsList(config.threads[j].clients);
+}
+
 static void resetClient(pclient c) {
-    config.el->aeDeleteFileEvent(c->context->fd,AE_WRITABLE);
-    config.el->aeDeleteFileEvent(c->context->fd,AE_READABLE);
-    config.el->aeCreateFileEvent(c->context->fd,AE_WRITABLE,writeHandler,c);
+    aeEventLoop *el = clientEventLoop(c);
+
+    el->aeDeleteFileEvent(c->context->fd,AE_WRITABLE);
+    el->aeDeleteFileEvent(c->context->fd,AE_READABLE);
+    el->aeCreateFileEvent(c->context->fd,AE_WRITABLE,writeHandler,c);
     c->written = 0;
     c->pending = config.pipeline;
 }
@@ -173,13 +215,22 @@ static void randomizeClientKey(pclient c) {
 }
 
 static void clientDone(pclient c) {
-    if (config.requests_finished == config.requests) {
+    int requests_finished;
+
+    atomicGet(config.requests_finished,requests_finished);
+    if (requests_finished >= config.requests) {
+        /* Threads stop by themselves once all their clients are freed. */
+        if (c->thread == NULL) config.el->aeStop();
         freeClient(c);
-        config.el->aeStop();
         return;
     }
     if (config.keepalive) {
         resetClient(c);
+    } else if (c->thread) {
+        /* Replace the client with a new one served by the same thread, as
+         * the other event loops can't be touched from here. */
+        createClient(NULL,0,c,c->thread);
+        freeClient(c);
     } else {
         config.liveclients--;
         createMissingClients(c);
@@ -243,8 +294,10 @@ static void readHandler(aeEventLoop *el, int fd, void *privdata, int mask) {
                     continue;
                 }
 
-                if (config.requests_finished < config.requests)
-                    config.latency[config.requests_finished++] = c->latency;
+                int requests_finished;
+                atomicGetIncr(config.requests_finished,requests_finished,1);
+                if (requests_finished < config.requests)
+                    config.latency[requests_finished] = c->latency;
                 c->pending--;
                 if (c->pending == 0) {
                     clientDone(c);
@@ -259,14 +312,15 @@ static void readHandler(aeEventLoop *el, int fd, void *privdata, int mask) {
 
 static void writeHandler(aeEventLoop *el, int fd, void *privdata, int mask) {
     pclient c = (pclient)privdata;
-    UNUSED(el);
     UNUSED(fd);
     UNUSED(mask);
 
     /* Initialize request when nothing was written. */
     if (c->written == 0) {
         /* Enforce upper bound to number of requests. */
-        if (config.requests_issued++ >= config.requests) {
+        int requests_issued;
+        atomicGetIncr(config.requests_issued,requests_issued,1);
+        if (requests_issued >= config.requests) {
             freeClient(c);
             return;
         }
@@ -288,8 +342,8 @@ static void writeHandler(aeEventLoop *el, int fd, void *privdata, int mask) {
         }
         c->written += nwritten;
         if (sdslen(c->obuf) == c->written) {
-            config.el->aeDeleteFileEvent(c->context->fd,AE_WRITABLE);
-            config.el->aeCreateFileEvent(c->context->fd,AE_READABLE,readHandler,c);
+            el->aeDeleteFileEvent(c->context->fd,AE_WRITABLE);
+            el->aeCreateFileEvent(c->context->fd,AE_READABLE,readHandler,c);
         }
     }
 }
@@ -314,8 +368,12 @@ static void writeHandler(aeEventLoop *el, int fd, void *privdata, int mask) {
  * 2) The offsets of the __rand_int__ elements inside the command line, used
  *    for arguments randomization.
  *
- * Even when cloning another client, prefix commands are applied if needed.*/
-static pclient createClient(char *cmd, size_t len, pclient from) {
+ * Even when cloning another client, prefix commands are applied if needed.
+ *
+ * The client is served by the event loop of 'thread', or by the main one
+ * if 'thread' is NULL. */
+static pclient createClient(char *cmd, size_t len, pclient from,
+                            benchmarkThread *thread) {
     int j;
     pclient c = (pclient)zmalloc(sizeof(struct _client));
 
@@ -405,18 +463,31 @@ static pclient createClient(char *cmd, size_t len, pclient from) {
             }
         }
     }
+    c->thread = thread;
     if (config.idlemode == 0)
-        config.el->aeCreateFileEvent(c->context->fd,AE_WRITABLE,writeHandler,c);
-    config.clients->listAddNodeTail(c);
-    config.liveclients++;
+        clientEventLoop(c)->aeCreateFileEvent(c->context->fd,AE_WRITABLE,writeHandler,c);
+    if (thread) {
+        thread->clients->listAddNodeTail(c);
+        thread->liveclients++;
+    } else {
+        config.clients->listAddNodeTail(c);
+    }
+    atomicIncr(config.liveclients,1);
     return c;
 }
 
+/* Return the thread that should serve the next client created, spreading
+ * the clients evenly among the threads. */
+static benchmarkThread *nextClientThread() {
+    if (config.num_threads == 0) return NULL;
+    return config.threads+(config.liveclients % config.num_threads);
+}
+
 static void createMissingClients(pclient c) {
     int n = 0;
 
     while(config.liveclients < config.numclients) {
-        createClient(NULL,0,c);
+        createClient(NULL,0,c,nextClientThread());
 
         /* Listen backlog is quite limited on most systems */
         if (++n > 64) {
@@ -442,6 +513,8 @@ static void showLatencyReport() {
         printf("  %d parallel clients\n", config.numclients);
         printf("  %d bytes payload\n", config.datasize);
         printf("  keep alive: %d\n", config.keepalive);
+        if (config.num_threads)
+            printf("  %d threads\n", config.num_threads);
         printf("\n");
 
         qsort(config.latency,config.requests,sizeof(long long),compareLatency);
@@ -460,18 +533,46 @@ static void showLatencyReport() {
     }
 }
 
+static void *benchmarkThreadMain(void *arg) {
+    benchmarkThread *thread = (benchmarkThread*)arg;
+
+    thread->el->aeMain();
+    return NULL;
+}
+
 static void benchmark(char *title, char *cmd, int len) {
+    int j;
+
     config.title = title;
     config.requests_issued = 0;
     config.requests_finished = 0;
 
-    pclient c = createClient(cmd,len,NULL);
+    pclient c = createClient(cmd,len,NULL,nextClientThread());
     createMissingClients(c);
 
     config.start = mstime();
-    config.el->aeMain();
+    if (config.num_threads) {
+        for (j = 0; j < config.num_threads; j++) {
+            if (pthread_create(&config.threads[j].thread,NULL,
+                               benchmarkThreadMain,config.threads+j) != 0)
+            {
+                fprintf(stderr,"Can't create the benchmark threads: %s\n",
+                    strerror(errno));
+                exit(1);
+            }
+        }
+        for (j = 0; j < config.num_threads; j++)
+            pthread_join(config.threads[j].thread,NULL);
+    } else {
+        config.el->aeMain();
+    }
     config.totlatency = mstime()-config.start;
 
+    /* Threads finishing at the same time may count a few replies past the
+     * last request, that were not counted by the single threaded loop. */
+    if (config.requests_finished > config.requests)
+        config.requests_finished = config.requests;
+
     showLatencyReport();
     freeAllClients();
 }
@@ -542,6 +643,10 @@ int parseOptions(int argc, const char **argv) {
             config.tests = sdscat(config.tests,(char*)argv[++i]);
             config.tests = sdscat(config.tests,",");
             sdstolower(config.tests);
+        } else if (!strcmp(argv[i],"--threads")) {
+            if (lastarg) goto invalid;
+            config.num_threads = atoi(argv[++i]);
+            if (config.num_threads < 0) config.num_threads = 0;
         } else if (!strcmp(argv[i],"--dbnum")) {
             if (lastarg) goto invalid;
             config.dbnum = atoi(argv[++i]);
@@ -589,7 +694,9 @@ usage:
 " -l                 Loop. Run the tests forever\n"
 " -t <tests>         Only run the comma separated list of tests. The test\n"
 "                    names are the same as the ones produced as output.\n"
-" -I                 Idle mode. Just open N idle connections and wait.\n\n"
+" -I                 Idle mode. Just open N idle connections and wait.\n"
+" --threads <num>    Spread the clients over <num> event loops, each one served\n"
+"                    by its own thread (default 0, the main thread only).\n\n"
 "Examples:\n\n"
 " Run the benchmark with the default configuration against 127.0.0.1:6379:\n"
 "   $ redis-benchmark\n\n"
@@ -610,22 +717,25 @@ usage:
 }
 
 int showThroughput(struct aeEventLoop *eventLoop, long long id, void *clientData) {
+    int liveclients, requests_finished;
     UNUSED(eventLoop);
     UNUSED(id);
     UNUSED(clientData);
 
-    if (config.liveclients == 0) {
+    atomicGet(config.liveclients,liveclients);
+    atomicGet(config.requests_finished,requests_finished);
+    if (liveclients == 0 && requests_finished < config.requests) {
         fprintf(stderr,"All clients disconnected... aborting.\n");
         exit(1);
     }
     if (config.csv) return 250;
     if (config.idlemode == 1) {
-        printf("clients: %d\r", config.liveclients);
+        printf("clients: %d\r", liveclients);
         fflush(stdout);
 	return 250;
     }
     float dt = (float)(mstime()-config.start)/1000.0;
-    float rps = (float)config.requests_finished/dt;
+    float rps = (float)requests_finished/dt;
     printf("%s: %.2f\r", config.title, rps);
     fflush(stdout);
     return 250; /* every 250ms */
@@ -660,7 +770,6 @@ int main(int argc, const char **argv) {
     config.requests = 100000;
     config.liveclients = 0;
     config.el = aeCreateEventLoop(1024*10);
-    config.el->aeCreateTimeEvent(1,showThroughput,NULL,NULL);
     config.keepalive = 1;
     config.datasize = 3;
     config.pipeline = 1;
@@ -679,11 +788,35 @@ int main(int argc, const char **argv) {
     config.tests = NULL;
     config.dbnum = 0;
     config.auth = NULL;
+    config.num_threads = 0;
+    config.threads = NULL;
+    pthread_mutex_init(&config.liveclients_mutex,NULL);
+    pthread_mutex_init(&config.requests_issued_mutex,NULL);
+    pthread_mutex_init(&config.requests_finished_mutex,NULL);
 
     i = parseOptions(argc,argv);
     argc -= i;
     argv += i;
 
+    /* Idle clients are all served by the main thread, and there is no point
+     * in having threads without clients to serve. */
+    if (config.idlemode) config.num_threads = 0;
+    if (config.num_threads > config.numclients)
+        config.num_threads = config.numclients;
+    if (config.num_threads) {
+        config.threads = (benchmarkThread*)
+            zmalloc(sizeof(benchmarkThread)*config.num_threads);
+        for (i = 0; i < config.num_threads; i++) {
+            config.threads[i].el = aeCreateEventLoop(1024*10);
+            config.threads[i].clients = listCreate();
+            config.threads[i].liveclients = 0;
+        }
+        /* Progress is reported by the first thread. */
+        config.threads[0].el->aeCreateTimeEvent(1,showThroughput,NULL,NULL);
+    } else {
+        config.el->aeCreateTimeEvent(1,showThroughput,NULL,NULL);
+    }
+
     config.latency = (long long *)zmalloc(sizeof(long long)*config.requests);
 
     if (config.keepalive == 0) {
@@ -692,7 +825,7 @@ int main(int argc, const char **argv) {
 
     if (config.idlemode) {
         printf("Creating %d idle connections and waiting forever (Ctrl+C when done)\n", config.numclients);
-        c = createClient("",0,NULL); /* will never receive a reply */
+        c = createClient("",0,NULL,NULL); /* will never receive a reply */
         createMissingClients(c);
         config.el->aeMain();
         /* and will wait for every */
@@ -882,6 +882,7 @@ void sendBulkToSlave(aeEventLoop *el, int fd, void *privdata, int mask) {
             return;
         }
         server.stat_net_output_bytes += nwritten;
+        slave->m_stat_net_output_bytes += nwritten;
         sdsrange(slave->m_replication_db_preamble,nwritten,-1);
         if (sdslen(slave->m_replication_db_preamble) == 0) {
             sdsfree(slave->m_replication_db_preamble);
@@ -911,6 +912,7 @@ void sendBulkToSlave(aeEventLoop *el, int fd, void *privdata, int mask) {
     }
     slave->m_replication_db_file_offset += nwritten;
     server.stat_net_output_bytes += nwritten;
+    slave->m_stat_net_output_bytes += nwritten;
     if (slave->m_replication_db_file_offset == slave->m_replication_db_file_size) {
         close(slave->m_replication_db_fd);
         slave->m_replication_db_fd = -1;
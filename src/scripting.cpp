@@ -103,6 +103,101 @@ void sha1hex(char *digest, char *script, size_t len) {
     digest[40] = '\0';
 }
 
+/* Convert the 40 chars hex SHA1 'hex' into the 20 bytes binary form.
+ * Both lower and upper case digits are accepted. Returns 0 if 'hex' is not
+ * a valid SHA1, 1 otherwise. */
+int luaShaHexToBin(unsigned char *bin, const char *hex) {
+    int j;
+
+    for (j = 0; j < 40; j++) {
+        char c = hex[j];
+        int v;
+
+        if (c >= '0' && c <= '9') v = c-'0';
+        else if (c >= 'a' && c <= 'f') v = c-'a'+10;
+        else if (c >= 'A' && c <= 'F') v = c-'A'+10;
+        else return 0;
+        if (j & 1) bin[j/2] |= v;
+        else bin[j/2] = v << 4;
+    }
+    return 1;
+}
+
+/* ---------------------------------------------------------------------------
+ * Scripts registry.
+ *
+ * Every script known to the server has a luaScript entry in
+ * server.lua_registry, keyed by its binary SHA1, holding a reference to the
+ * compiled function in the Lua registry: EVALSHA does not need to build the
+ * f_<sha> name and look it up among the Lua globals. The server.lua_bodies
+ * dictionary maps the script bodies to the same entries, so that EVAL does
+ * not need to compute the SHA1 of scripts already seen.
+ * ------------------------------------------------------------------------- */
+
+#define LUA_STATS_HIST_BUCKETS 32 /* Bucket N counts calls taking
+                                      [2^N, 2^(N+1)) microseconds. */
+
+typedef struct luaScript {
+    unsigned char sha[20];  /* Binary SHA1 of the body, the registry key. */
+    char funcname[43];      /* f_<hex sha1>, the name of the Lua function. */
+    int funcref;            /* Reference of the function in the registry. */
+    sds hexsha;             /* The server.lua_scripts key of this script. */
+    robj *body;             /* The body, also stored in server.lua_scripts. */
+    /* Execution statistics, see SCRIPT STATS and INFO scriptstats. */
+    long long calls;        /* Number of EVAL/EVALSHA calls. */
+    long long microseconds; /* Total execution time. */
+    long long max_microseconds; /* Slowest execution. */
+    long long redis_calls;  /* Number of redis.call() / redis.pcall(). */
+    long long latency_hist[LUA_STATS_HIST_BUCKETS];
+} luaScript;
+
+/* The script in execution, if any, for redis.call() to account itself. */
+static luaScript *luaCurrentScript = NULL;
+
+static uint64_t luaRegistryHash(const void *key) {
+    uint64_t h;
+
+    /* The key is a SHA1: any part of it is a perfectly good hash. */
+    memcpy(&h,key,sizeof(h));
+    return h;
+}
+
+static int luaRegistryKeyCompare(void *privdata, const void *key1,
+        const void *key2)
+{
+    DICT_NOTUSED(privdata);
+    return memcmp(key1,key2,20) == 0;
+}
+
+static void luaRegistryValDestructor(void *privdata, void *val) {
+    DICT_NOTUSED(privdata);
+    zfree(val);
+}
+
+/* server.lua_registry binary SHA1 (owned by the value) -> luaScript. */
+dictType luaRegistryDictType = {
+    luaRegistryHash,            /* hash function */
+    NULL,                       /* key dup */
+    NULL,                       /* val dup */
+    luaRegistryKeyCompare,      /* key compare */
+    NULL,                       /* key destructor */
+    luaRegistryValDestructor    /* val destructor */
+};
+
+/* server.lua_bodies script body (owned by the value) -> luaScript. */
+dictType luaBodiesDictType = {
+    dictSdsHash,                /* hash function */
+    NULL,                       /* key dup */
+    NULL,                       /* val dup */
+    dictSdsKeyCompare,          /* key compare */
+    NULL,                       /* key destructor */
+    NULL                        /* val destructor */
+};
+
+/* References of the tables reused as KEYS and ARGV at every call. */
+static int luaKeysRef = LUA_NOREF;
+static int luaArgvRef = LUA_NOREF;
+
 /* ---------------------------------------------------------------------------
  * Redis reply to Lua type conversion functions.
  * ------------------------------------------------------------------------- */
@@ -229,6 +324,273 @@ void luaPushError(lua_State *lua, char *error) {
     lua_settable(lua,-3);
 }
 
+/* ---------------------------------------------------------------------------
+ * Lua reply sink.
+ *
+ * While redis.call() runs a command the Lua client is flagged with
+ * CLIENT_LUA_REPLY_SINK, and the addReply*() family calls the functions
+ * below instead of appending protocol to the client output buffers. This
+ * way the reply is converted into Lua values while it is emitted, without
+ * serializing it to RESP and parsing it back: bulk strings, integers and
+ * multi bulk lengths are pushed on the Lua stack directly, while the raw
+ * protocol emitted by addReply() / addReplyString() is fed to an
+ * incremental parser producing the same values redisProtocolToLuaType()
+ * would produce.
+ * ------------------------------------------------------------------------- */
+
+#define LUA_SINK_MAX_DEPTH 32   /* Max nesting of aggregate replies. */
+
+static struct luaReplySink {
+    int depth;          /* Number of aggregates currently being populated. */
+    long remaining[LUA_SINK_MAX_DEPTH]; /* Missing elements, -1 if deferred. */
+    long index[LUA_SINK_MAX_DEPTH];     /* Elements already stored. */
+    sds line;           /* Partial protocol line received so far. */
+    sds bulk;           /* Partial bulk payload received so far. */
+    long long bulkleft; /* Bulk payload + CRLF bytes missing, -1 if none. */
+    int type;           /* Type byte of the (first) top level reply. */
+    int replies;        /* Number of top level replies completed. */
+    int error;          /* The emitted reply can't be converted. */
+} luaSink;
+
+void luaReplySinkStart(void) {
+    if (luaSink.line == NULL) {
+        luaSink.line = sdsempty();
+        luaSink.bulk = sdsempty();
+    }
+    sdsclear(luaSink.line);
+    sdsclear(luaSink.bulk);
+    luaSink.depth = 0;
+    luaSink.bulkleft = -1;
+    luaSink.type = 0;
+    luaSink.replies = 0;
+    luaSink.error = 0;
+}
+
+/* Return true if the sink is not in the middle of a protocol token, so
+ * that typed values can be pushed directly. */
+static int luaSinkIdle(void) {
+    return luaSink.bulkleft == -1 && sdslen(luaSink.line) == 0;
+}
+
+static void luaSinkBeginValue(int type) {
+    if (luaSink.depth == 0 && luaSink.replies == 0) luaSink.type = type;
+}
+
+/* The value on the top of the Lua stack is complete: store it into the
+ * aggregate being populated, closing every aggregate that gets all its
+ * elements as a result. Only the first top level reply is retained. */
+static void luaSinkValueDone(lua_State *lua) {
+    while (luaSink.depth) {
+        int d = luaSink.depth-1;
+
+        lua_rawseti(lua,-2,++luaSink.index[d]);
+        if (luaSink.remaining[d] == -1 || --luaSink.remaining[d] > 0) return;
+        luaSink.depth--;
+    }
+    if (luaSink.replies++) lua_pop(lua,1);
+}
+
+/* Push a new table for an aggregate of 'len' elements, or -1 if the
+ * length will be set later via luaReplySinkSetDeferredLen(). */
+static void luaSinkOpenAggregate(lua_State *lua, long len) {
+    if (luaSink.depth == LUA_SINK_MAX_DEPTH || !lua_checkstack(lua,2)) {
+        luaSink.error = 1;
+        return;
+    }
+    lua_newtable(lua);
+    if (len == 0) {
+        luaSinkValueDone(lua);
+        return;
+    }
+    luaSink.remaining[luaSink.depth] = len;
+    luaSink.index[luaSink.depth] = 0;
+    luaSink.depth++;
+}
+
+/* Process a protocol line, 'l' does not include the CRLF terminator. */
+static void luaSinkProcessLine(lua_State *lua, const char *l, size_t len) {
+    long long ll;
+
+    if (len == 0) {
+        luaSink.error = 1;
+        return;
+    }
+    luaSinkBeginValue(l[0]);
+    switch(l[0]) {
+    case ':':
+    case '$':
+    case '*':
+        if (!string2ll(l+1,len-1,&ll)) {
+            luaSink.error = 1;
+        } else if (l[0] == ':') {
+            lua_pushnumber(lua,(lua_Number)ll);
+            luaSinkValueDone(lua);
+        } else if (ll < 0) {
+            lua_pushboolean(lua,0);
+            luaSinkValueDone(lua);
+        } else if (l[0] == '$') {
+            luaSink.bulkleft = ll+2;
+        } else {
+            luaSinkOpenAggregate(lua,ll);
+        }
+        break;
+    case '+':
+    case '-':
+        lua_newtable(lua);
+        lua_pushstring(lua,l[0] == '+' ? "ok" : "err");
+        lua_pushlstring(lua,l+1,len-1);
+        lua_settable(lua,-3);
+        luaSinkValueDone(lua);
+        break;
+    default:
+        luaSink.error = 1;
+        break;
+    }
+}
+
+/* Feed raw protocol to the sink. */
+void luaReplySinkProtocol(const char *p, size_t len) {
+    lua_State *lua = server.lua;
+
+    while (len && !luaSink.error) {
+        size_t n;
+
+        if (luaSink.bulkleft != -1) {
+            if (sdslen(luaSink.bulk) == 0 && (size_t)luaSink.bulkleft <= len) {
+                /* The whole payload is here: no need to copy it. */
+                n = luaSink.bulkleft;
+                lua_pushlstring(lua,p,n-2);
+            } else {
+                n = ((size_t)luaSink.bulkleft < len) ? luaSink.bulkleft : len;
+                luaSink.bulk = sdscatlen(luaSink.bulk,p,n);
+                luaSink.bulkleft -= n;
+                p += n;
+                len -= n;
+                if (luaSink.bulkleft) continue;
+                lua_pushlstring(lua,luaSink.bulk,sdslen(luaSink.bulk)-2);
+                sdsclear(luaSink.bulk);
+                n = 0;
+            }
+            p += n;
+            len -= n;
+            luaSink.bulkleft = -1;
+            luaSinkValueDone(lua);
+            continue;
+        }
+
+        const char *nl = (const char*)memchr(p,'\n',len);
+        if (nl == NULL) {
+            luaSink.line = sdscatlen(luaSink.line,p,len);
+            return;
+        }
+        n = nl-p+1;
+        if (sdslen(luaSink.line)) {
+            luaSink.line = sdscatlen(luaSink.line,p,n);
+            if (sdslen(luaSink.line) < 2) {
+                luaSink.error = 1;
+            } else {
+                luaSinkProcessLine(lua,luaSink.line,sdslen(luaSink.line)-2);
+            }
+            sdsclear(luaSink.line);
+        } else if (n < 2) {
+            luaSink.error = 1;
+        } else {
+            luaSinkProcessLine(lua,p,n-2);
+        }
+        p += n;
+        len -= n;
+    }
+}
+
+/* Feed <prefix><ll>\r\n to the protocol parser. */
+static void luaSinkProtocolLongLong(char prefix, long long ll) {
+    char buf[128];
+    int len;
+
+    buf[0] = prefix;
+    len = ll2string(buf+1,sizeof(buf)-1,ll);
+    buf[len+1] = '\r';
+    buf[len+2] = '\n';
+    luaReplySinkProtocol(buf,len+3);
+}
+
+void luaReplySinkBulk(const char *p, size_t len) {
+    if (luaSink.error) return;
+    if (!luaSinkIdle()) {
+        luaSinkProtocolLongLong('$',len);
+        luaReplySinkProtocol(p,len);
+        luaReplySinkProtocol("\r\n",2);
+        return;
+    }
+    luaSinkBeginValue('$');
+    lua_pushlstring(server.lua,p,len);
+    luaSinkValueDone(server.lua);
+}
+
+void luaReplySinkLongLong(long long ll) {
+    if (luaSink.error) return;
+    if (!luaSinkIdle()) {
+        luaSinkProtocolLongLong(':',ll);
+        return;
+    }
+    luaSinkBeginValue(':');
+    lua_pushnumber(server.lua,(lua_Number)ll);
+    luaSinkValueDone(server.lua);
+}
+
+void luaReplySinkMultiBulkLen(long length) {
+    if (luaSink.error) return;
+    if (!luaSinkIdle()) {
+        luaSinkProtocolLongLong('*',length);
+        return;
+    }
+    luaSinkBeginValue('*');
+    luaSinkOpenAggregate(server.lua,length);
+}
+
+/* Open an aggregate whose length is not yet known. The returned handle is
+ * what luaReplySinkSetDeferredLen() will receive. */
+void *luaReplySinkDeferredLen(void) {
+    if (luaSink.error) return NULL;
+    if (!luaSinkIdle()) {
+        luaSink.error = 1;
+        return NULL;
+    }
+    luaSinkBeginValue('*');
+    luaSinkOpenAggregate(server.lua,-1);
+    if (luaSink.error) return NULL;
+    return (void*)(long)luaSink.depth;
+}
+
+void luaReplySinkSetDeferredLen(void *node, long length) {
+    int d = (int)(long)node-1;
+
+    if (luaSink.error) return;
+    /* Deferred aggregates are always completed in LIFO order, and once
+     * the length is set all their elements were already emitted. */
+    if (d != luaSink.depth-1 || luaSink.remaining[d] != -1 ||
+        luaSink.index[d] != length || !luaSinkIdle())
+    {
+        luaSink.error = 1;
+        return;
+    }
+    luaSink.depth--;
+    luaSinkValueDone(server.lua);
+}
+
+/* Called after the command returned: leave exactly one value on the stack
+ * above 'base', and return the type byte of the reply ('-' for errors). */
+int luaReplySinkEnd(lua_State *lua, int base) {
+    if (luaSink.error || luaSink.replies == 0 || luaSink.depth ||
+        !luaSinkIdle())
+    {
+        lua_settop(lua,base);
+        luaPushError(lua,"Unable to convert the command reply to Lua types");
+        return '-';
+    }
+    return luaSink.type;
+}
+
 /* In case the error set into the Lua stack by luaPushError() was generated
  * by the non-error-trapping version of redis.pcall(), which is redis.call(),
  * this function will raise the Lua error so that the execution of the
@@ -560,6 +922,7 @@ int luaRedisGenericCommand(lua_State *lua, int raise_error) {
     }
 
     /* Run the command */
+    if (luaCurrentScript) luaCurrentScript->redis_calls++;
     if (server.lua_replicate_commands) {
         /* Set flags according to redis.set_repl() settings. */
         if (server.lua_repl & PROPAGATE_AOF)
@@ -567,6 +930,27 @@ int luaRedisGenericCommand(lua_State *lua, int raise_error) {
         if (server.lua_repl & PROPAGATE_REPL)
             call_flags |= CMD_CALL_PROPAGATE_REPL;
     }
+    if (!ldb.active) {
+        /* Fast path: the reply is converted to Lua values while the
+         * command emits it, see the "Lua reply sink" section. The debugger
+         * needs the protocol in order to log it, so it takes the slow
+         * path below. */
+        int base = lua_gettop(lua), type;
+
+        luaReplySinkStart();
+        c->m_flags |= CLIENT_LUA_REPLY_SINK;
+        call(c,call_flags);
+        c->m_flags &= ~CLIENT_LUA_REPLY_SINK;
+        type = luaReplySinkEnd(lua,base);
+
+        if (raise_error && type != '-') raise_error = 0;
+        if ((cmd->m_flags & CMD_SORT_FOR_SCRIPT) &&
+            (server.lua_replicate_commands == 0) &&
+            (type == '*' && lua_istable(lua,-1))) {
+                luaSortArray(lua);
+        }
+        goto cleanup;
+    }
     call(c,call_flags);
 
     /* Convert the result of the Redis command into a suitable Lua type.
@@ -933,6 +1317,8 @@ void scriptingInit(int setup) {
      * This is useful for replication, as we need to replicate EVALSHA
      * as EVAL, so we need to remember the associated script. */
     server.lua_scripts = dictCreate(&shaScriptObjectDictType,NULL);
+    server.lua_registry = dictCreate(&luaRegistryDictType,NULL);
+    server.lua_bodies = dictCreate(&luaBodiesDictType,NULL);
 
     /* Register the redis commands table and fields */
     lua_newtable(lua);
@@ -1078,6 +1464,13 @@ void scriptingInit(int setup) {
     /* Lua beginners often don't use "local", this is likely to introduce
      * subtle bugs in their code. To prevent problems we protect accesses
      * to global variables. */
+    /* Create the tables that evalGenericCommand() populates and exposes
+     * as KEYS and ARGV. */
+    lua_newtable(lua);
+    luaKeysRef = luaL_ref(lua,LUA_REGISTRYINDEX);
+    lua_newtable(lua);
+    luaArgvRef = luaL_ref(lua,LUA_REGISTRYINDEX);
+
     scriptingEnableGlobalsProtection(lua);
 
     server.lua = lua;
@@ -1086,6 +1479,8 @@ void scriptingInit(int setup) {
 /* Release resources related to Lua scripting.
  * This function is used in order to reset the scripting environment. */
 void scriptingRelease() {
+    dictRelease(server.lua_bodies);
+    dictRelease(server.lua_registry);
     dictRelease(server.lua_scripts);
     lua_close(server.lua);
 }
@@ -1096,11 +1491,35 @@ void scriptingReset() {
 }
 
 /* Set an array of Redis String Objects as a Lua array (table) stored into a
- * global variable. */
-void luaSetGlobalArray(lua_State *lua, char *var, robj **elev, int elec) {
+ * global variable. The table referenced by 'ref' is reused: everything the
+ * previous script left in it, including fields that are not part of the
+ * sequence and its metatable, is removed. */
+void luaSetGlobalArray(lua_State *lua, char *var, int ref, robj **elev, int elec) {
     int j;
 
-    lua_newtable(lua);
+    lua_rawgeti(lua,LUA_REGISTRYINDEX,ref);
+    if (lua_getmetatable(lua,-1)) {
+        lua_pop(lua,1);
+        lua_pushnil(lua);
+        lua_setmetatable(lua,-2);
+    }
+
+    /* Clear the fields we are not going to overwrite. Clearing existing
+     * fields is allowed while traversing the table with lua_next(). */
+    lua_pushnil(lua);
+    while(lua_next(lua,-2)) {
+        lua_Number n;
+
+        lua_pop(lua,1); /* Discard the value, keep the key for lua_next(). */
+        if (lua_type(lua,-1) != LUA_TNUMBER ||
+            (n = lua_tonumber(lua,-1)) < 1 || n > elec || n != (int)n)
+        {
+            lua_pushvalue(lua,-1);
+            lua_pushnil(lua);
+            lua_rawset(lua,-4);
+        }
+    }
+
     for (j = 0; j < elec; j++) {
         lua_pushlstring(lua,(char*)elev[j]->ptr,sdslen((sds)elev[j]->ptr));
         lua_rawseti(lua,-2,j+1);
@@ -1155,6 +1574,144 @@ int redis_math_randomseed (lua_State *L) {
  * EVAL and SCRIPT commands implementation
  * ------------------------------------------------------------------------- */
 
+/* ---------------------------------------------------------------------------
+ * Scripts execution statistics
+ * ------------------------------------------------------------------------- */
+
+static void luaResetScriptStats(luaScript *ls) {
+    ls->calls = 0;
+    ls->microseconds = 0;
+    ls->max_microseconds = 0;
+    ls->redis_calls = 0;
+    memset(ls->latency_hist,0,sizeof(ls->latency_hist));
+}
+
+/* Reset the statistics of all the scripts, used by CONFIG RESETSTAT. */
+void luaResetScriptsStats(void) {
+    dictIterator di(server.lua_registry);
+    dictEntry *de;
+
+    while((de = di.dictNext()) != NULL)
+        luaResetScriptStats((luaScript*)de->dictGetVal());
+}
+
+static void luaUpdateScriptStats(luaScript *ls, long long duration) {
+    int bucket = 0;
+
+    ls->calls++;
+    ls->microseconds += duration;
+    if (duration > ls->max_microseconds) ls->max_microseconds = duration;
+    while (duration > 1 && bucket < LUA_STATS_HIST_BUCKETS-1) {
+        duration >>= 1;
+        bucket++;
+    }
+    ls->latency_hist[bucket]++;
+}
+
+/* qsort() comparator: scripts taking more time overall first. */
+static int luaScriptStatsCompare(const void *a, const void *b) {
+    const luaScript *sa = *(const luaScript**)a, *sb = *(const luaScript**)b;
+
+    if (sa->microseconds == sb->microseconds) return 0;
+    return (sa->microseconds > sb->microseconds) ? -1 : 1;
+}
+
+/* Return the scripts that were called at least once, sorted by total
+ * execution time. The array must be freed with zfree(). */
+static luaScript **luaGetCalledScripts(unsigned long *count) {
+    luaScript **scripts;
+    dictEntry *de;
+    unsigned long j = 0;
+
+    scripts = (luaScript**)zmalloc(sizeof(luaScript*)*
+                                   (server.lua_registry->dictSize()+1));
+    dictIterator di(server.lua_registry);
+    while((de = di.dictNext()) != NULL) {
+        luaScript *ls = (luaScript*)de->dictGetVal();
+        if (ls->calls) scripts[j++] = ls;
+    }
+    qsort(scripts,j,sizeof(luaScript*),luaScriptStatsCompare);
+    *count = j;
+    return scripts;
+}
+
+/* Emit the statistics of a script as a flat field / value array. The
+ * histogram is an array of <max microseconds> <calls> pairs, only for the
+ * non empty buckets. */
+static void luaReplyScriptStats(client *c, luaScript *ls) {
+    void *replylen;
+    int j, buckets = 0;
+
+    c->addReplyMultiBulkLen(12);
+    c->addReplyBulkCString("sha");
+    c->addReplyBulkCBuffer(ls->hexsha,40);
+    c->addReplyBulkCString("calls");
+    c->addReplyLongLong(ls->calls);
+    c->addReplyBulkCString("usec");
+    c->addReplyLongLong(ls->microseconds);
+    c->addReplyBulkCString("max_usec");
+    c->addReplyLongLong(ls->max_microseconds);
+    c->addReplyBulkCString("redis_calls");
+    c->addReplyLongLong(ls->redis_calls);
+    c->addReplyBulkCString("latency_histogram");
+    replylen = c->addDeferredMultiBulkLength();
+    for (j = 0; j < LUA_STATS_HIST_BUCKETS; j++) {
+        if (ls->latency_hist[j] == 0) continue;
+        c->addReplyLongLong((2LL<<j)-1);
+        c->addReplyLongLong(ls->latency_hist[j]);
+        buckets++;
+    }
+    c->setDeferredMultiBulkLength(replylen,buckets*2);
+}
+
+/* SCRIPT STATS [<sha1> ...] -- Statistics of the specified scripts, or of
+ * all the scripts called at least once, slowest first. */
+static void scriptStatsCommand(client *c) {
+    if (c->m_argc == 2) {
+        unsigned long count, j;
+        luaScript **scripts = luaGetCalledScripts(&count);
+
+        c->addReplyMultiBulkLen(count);
+        for (j = 0; j < count; j++) luaReplyScriptStats(c,scripts[j]);
+        zfree(scripts);
+    } else {
+        int j;
+
+        c->addReplyMultiBulkLen(c->m_argc-2);
+        for (j = 2; j < c->m_argc; j++) {
+            sds hex = (sds)c->m_argv[j]->ptr;
+            unsigned char sha[20];
+            luaScript *ls = NULL;
+
+            if (sdslen(hex) == 40 && luaShaHexToBin(sha,hex))
+                ls = (luaScript*)server.lua_registry->dictFetchValue(sha);
+            if (ls)
+                luaReplyScriptStats(c,ls);
+            else
+                c->addReply(shared.nullmultibulk);
+        }
+    }
+}
+
+/* Append the "scriptstats" INFO section fields to 'info'. */
+sds genLuaScriptsInfoString(sds info) {
+    unsigned long count, j;
+    luaScript **scripts = luaGetCalledScripts(&count);
+
+    for (j = 0; j < count; j++) {
+        luaScript *ls = scripts[j];
+
+        info = sdscatprintf(info,
+            "scriptstat_%s:calls=%lld,usec=%lld,usec_per_call=%.2f,"
+            "max_usec=%lld,redis_calls=%lld\r\n",
+            ls->hexsha, ls->calls, ls->microseconds,
+            (float)ls->microseconds/ls->calls, ls->max_microseconds,
+            ls->redis_calls);
+    }
+    zfree(scripts);
+    return info;
+}
+
 /* Define a Lua function with the specified body.
  * The function name will be generated in the following form:
  *
@@ -1172,9 +1729,10 @@ int redis_math_randomseed (lua_State *L) {
  *
  * If 'c' is not NULL, on error the client is informed with an appropriate
  * error describing the nature of the problem and the Lua interpreter error. */
-sds luaCreateFunction(client *c, lua_State *lua, robj *body) {
+static luaScript *luaCreateScript(client *c, lua_State *lua, robj *body) {
     char funcname[43];
     dictEntry *de;
+    luaScript *ls;
 
     funcname[0] = 'f';
     funcname[1] = '_';
@@ -1182,8 +1740,11 @@ sds luaCreateFunction(client *c, lua_State *lua, robj *body) {
 
     sds sha = sdsnewlen(funcname+2,40);
     if ((de = server.lua_scripts->dictFind(sha)) != NULL) {
+        unsigned char binsha[20];
+
         sdsfree(sha);
-        return (sds)de->dictGetKey();
+        luaShaHexToBin(binsha,funcname+2);
+        return (luaScript*)server.lua_registry->dictFetchValue(binsha);
     }
     sds funcdef = sdsempty();
     funcdef = sdscat(funcdef,"function ");
@@ -1221,7 +1782,28 @@ sds luaCreateFunction(client *c, lua_State *lua, robj *body) {
     int retval = server.lua_scripts->dictAdd(sha,body);
     serverAssertWithInfo(c ? c : server.lua_client,NULL,retval == DICT_OK);
     incrRefCount(body);
-    return sha;
+
+    /* Register the script, taking a reference to the function just
+     * defined so that calls don't need to lookup the Lua globals. */
+    ls = (luaScript*)zmalloc(sizeof(*ls));
+    luaShaHexToBin(ls->sha,funcname+2);
+    memcpy(ls->funcname,funcname,sizeof(funcname));
+    lua_getglobal(lua,funcname);
+    ls->funcref = luaL_ref(lua,LUA_REGISTRYINDEX);
+    ls->hexsha = sha;
+    ls->body = body;
+    luaResetScriptStats(ls);
+    server.lua_registry->dictAdd(ls->sha,ls);
+    server.lua_bodies->dictAdd(body->ptr,ls);
+    return ls;
+}
+
+/* Like luaCreateScript() but returns the SHA1 of the script as an hex
+ * SDS string. */
+sds luaCreateFunction(client *c, lua_State *lua, robj *body) {
+    luaScript *ls = luaCreateScript(c,lua,body);
+
+    return ls ? ls->hexsha : NULL;
 }
 
 /* This is the Lua script "count" hook that we use to detect scripts timeout. */
@@ -1251,8 +1833,8 @@ void luaMaskCountHook(lua_State *lua, lua_Debug *ar) {
 
 void evalGenericCommand(client *c, int evalsha) {
     lua_State *lua = server.lua;
-    char funcname[43];
-    long long numkeys;
+    luaScript *ls;
+    long long numkeys, start;
     int delhook = 0, err;
 
     /* When we replicate whole scripts, we want the same PRNG sequence at
@@ -1284,57 +1866,39 @@ void evalGenericCommand(client *c, int evalsha) {
         return;
     }
 
-    /* We obtain the script SHA1, then check if this function is already
-     * defined into the Lua state */
-    funcname[0] = 'f';
-    funcname[1] = '_';
+    /* Lookup the script in the registry: EVAL uses the body itself,
+     * so that the SHA1 is computed only the first time a script is seen,
+     * while EVALSHA converts the SHA1 to its binary form. */
     if (!evalsha) {
-        /* Hash the code if this is an EVAL call */
-        sha1hex(funcname+2, (char *)c->m_argv[1]->ptr,sdslen((sds)c->m_argv[1]->ptr));
+        ls = (luaScript*)server.lua_bodies->dictFetchValue(c->m_argv[1]->ptr);
+        if (ls == NULL) {
+            /* Function not defined... let's define it. */
+            ls = luaCreateScript(c,lua,c->m_argv[1]);
+            /* The error is sent to the client by luaCreateScript()
+             * itself when it returns NULL. */
+            if (ls == NULL) return;
+        }
     } else {
-        /* We already have the SHA if it is a EVALSHA */
-        int j;
-        char *sha = (char *)c->m_argv[1]->ptr;
-
-        /* Convert to lowercase. We don't use tolower since the function
-         * managed to always show up in the profiler output consuming
-         * a non trivial amount of time. */
-        for (j = 0; j < 40; j++)
-            funcname[j+2] = (sha[j] >= 'A' && sha[j] <= 'Z') ?
-                sha[j]+('a'-'A') : sha[j];
-        funcname[42] = '\0';
-    }
-
-    /* Push the pcall error handler function on the stack. */
-    lua_getglobal(lua, "__redis__err__handler");
+        unsigned char sha[20];
 
-    /* Try to lookup the Lua function */
-    lua_getglobal(lua, funcname);
-    if (lua_isnil(lua,-1)) {
-        lua_pop(lua,1); /* remove the nil from the stack */
-        /* Function not defined... let's define it if we have the
-         * body of the function. If this is an EVALSHA call we can just
-         * return an error. */
-        if (evalsha) {
-            lua_pop(lua,1); /* remove the error handler from the stack. */
+        if (!luaShaHexToBin(sha,(const char*)c->m_argv[1]->ptr) ||
+            (ls = (luaScript*)server.lua_registry->dictFetchValue(sha)) == NULL)
+        {
             c->addReply( shared.noscripterr);
             return;
         }
-        if (luaCreateFunction(c,lua,c->m_argv[1]) == NULL) {
-            lua_pop(lua,1); /* remove the error handler from the stack. */
-            /* The error is sent to the client by luaCreateFunction()
-             * itself when it returns NULL. */
-            return;
-        }
-        /* Now the following is guaranteed to return non nil */
-        lua_getglobal(lua, funcname);
-        serverAssert(!lua_isnil(lua,-1));
     }
 
+    /* Push the pcall error handler function on the stack, then the
+     * function to call. */
+    lua_getglobal(lua, "__redis__err__handler");
+    lua_rawgeti(lua, LUA_REGISTRYINDEX, ls->funcref);
+
     /* Populate the argv and keys table accordingly to the arguments that
      * EVAL received. */
-    luaSetGlobalArray(lua,"KEYS",c->m_argv+3,numkeys);
-    luaSetGlobalArray(lua,"ARGV",c->m_argv+3+numkeys,c->m_argc-3-numkeys);
+    luaSetGlobalArray(lua,"KEYS",luaKeysRef,c->m_argv+3,numkeys);
+    luaSetGlobalArray(lua,"ARGV",luaArgvRef,c->m_argv+3+numkeys,
+                      c->m_argc-3-numkeys);
 
     /* Select the right DB in the context of the Lua client */
     server.lua_client->selectDb(c->m_cur_selected_db->m_id);
@@ -1362,7 +1926,11 @@ void evalGenericCommand(client *c, int evalsha) {
     /* At this point whether this script was never seen before or if it was
      * already defined, we can call it. We have zero arguments and expect
      * a single return value. */
+    luaCurrentScript = ls;
+    start = ustime();
     err = lua_pcall(lua,0,1,-2);
+    luaUpdateScriptStats(ls,ustime()-start);
+    luaCurrentScript = NULL;
 
     /* Perform some cleanup that we need to do both on error and success. */
     if (delhook) lua_sethook(lua,NULL,0,0); /* Disable hook */
@@ -1394,7 +1962,7 @@ void evalGenericCommand(client *c, int evalsha) {
 
     if (err) {
         c->addReplyErrorFormat("Error running script (call to %s): %s\n",
-            funcname, lua_tostring(lua,-1));
+            ls->funcname, lua_tostring(lua,-1));
         lua_pop(lua,2); /* Consume the Lua reply and remove error handler. */
     } else {
         /* On success convert the Lua return value into Redis protocol, and
@@ -1431,13 +1999,10 @@ void evalGenericCommand(client *c, int evalsha) {
             /* This script is not in our script cache, replicate it as
              * EVAL, then add it into the script cache, as from now on
              * slaves and AOF know about it. */
-            robj *script = (robj *)server.lua_scripts->dictFetchValue(c->m_argv[1]->ptr);
-
             replicationScriptCacheAdd((sds)c->m_argv[1]->ptr);
-            serverAssertWithInfo(c,NULL,script != NULL);
             c->rewriteClientCommandArgument(0,
                 resetRefCount(createStringObject("EVAL",4)));
-            c->rewriteClientCommandArgument(1,script);
+            c->rewriteClientCommandArgument(1,ls->body);
             forceCommandPropagation(c,PROPAGATE_REPL|PROPAGATE_AOF);
         }
     }
@@ -1497,6 +2062,8 @@ void scriptCommand(client *c) {
             server.lua_kill = 1;
             c->addReply(shared.ok);
         }
+    } else if (c->m_argc >= 2 && !strcasecmp((const char*)c->m_argv[1]->ptr,"stats")) {
+        scriptStatsCommand(c);
     } else if (c->m_argc == 3 && !strcasecmp((const char*)c->m_argv[1]->ptr,"debug")) {
         if (c->clientHasPendingReplies()) {
             c->addReplyError("SCRIPT DEBUG must be called outside a pipeline");
@@ -157,7 +157,12 @@ sds sdsdup(const sds s) {
 /* Free an sds string. No operation is performed if 's' is NULL. */
 void sdsfree(sds s) {
     if (s == NULL) return;
-    s_free((char*)s-sdsHdrSize(s[-1]));
+    /* Except for SDS_TYPE_5 strings, whose length may be reduced in place,
+     * the header tells the size of the allocation. */
+    if ((s[-1] & SDS_TYPE_MASK) == SDS_TYPE_5)
+        s_free((char*)s-sdsHdrSize(s[-1]));
+    else
+        s_free_with_size((char*)s-sdsHdrSize(s[-1]),sdsAllocSize(s));
 }
 
 /* Set the sds string length to the length as obtained with strlen(), so
@@ -220,6 +220,7 @@ struct redisCommand redisCommandTable[] = {
     {"incrby",incrbyCommand,3,"wmF",0,NULL,1,1,1,0,0},
     {"decrby",decrbyCommand,3,"wmF",0,NULL,1,1,1,0,0},
     {"incrbyfloat",incrbyfloatCommand,3,"wmF",0,NULL,1,1,1,0,0},
+    {"throttle",throttleCommand,-5,"wmRF",0,NULL,1,1,1,0,0},
     {"getset",getsetCommand,3,"wm",0,NULL,1,1,1,0,0},
     {"mset",msetCommand,-3,"wm",0,NULL,1,-1,2,0,0},
     {"msetnx",msetnxCommand,-3,"wm",0,NULL,1,-1,2,0,0},
@@ -308,7 +309,8 @@ struct redisCommand redisCommandTable[] = {
     {"pfdebug",pfdebugCommand,-3,"w",0,NULL,0,0,0,0,0},
     {"post",securityWarningCommand,-1,"lt",0,NULL,0,0,0,0,0},
     {"host:",securityWarningCommand,-1,"lt",0,NULL,0,0,0,0,0},
-    {"latency",latencyCommand,-2,"aslt",0,NULL,0,0,0,0,0}
+    {"latency",latencyCommand,-2,"aslt",0,NULL,0,0,0,0,0},
+    {"hotkeys",hotkeysCommand,-1,"rR",0,NULL,0,0,0,0,0}
 };
 
 /*============================ Utility functions ============================ */
@@ -606,6 +608,20 @@ dictType keyptrDictType = {
     NULL                        /* val destructor */
 };
 
+/* Shared replies table. sds pointer -> references count. */
+uint64_t dictPtrHash(const void *key) {
+    return dictGenHashFunction((unsigned char*)&key,sizeof(key));
+}
+
+dictType sharedRepliesDictType = {
+    dictPtrHash,                /* hash function */
+    NULL,                       /* key dup */
+    NULL,                       /* val dup */
+    NULL,                       /* key compare */
+    NULL,                       /* key destructor */
+    NULL                        /* val destructor */
+};
+
 /* Command table. sds string -> command struct pointer. */
 dictType commandTableDictType = {
     dictSdsCaseHash,            /* hash function */
@@ -788,6 +804,7 @@ int clientsCronHandleTimeout(client *c, mstime_t now_ms) {
         !(c->m_flags & CLIENT_MASTER) &&   /* no timeout for masters */
         !(c->m_flags & CLIENT_BLOCKED) &&  /* no timeout for BLPOP */
         !(c->m_flags & CLIENT_PUBSUB) &&   /* no timeout for Pub/Sub clients */
+        !(c->m_flags & CLIENT_SLOT_IMPORT) && /* no timeout for slot imports */
         (now - c->m_last_interaction_time > server.maxidletime))
     {
         serverLog(LL_VERBOSE,"Closing idle client");
@@ -886,6 +903,9 @@ void databasesCron() {
     if (server.active_defrag_enabled)
         activeDefragCycle();
 
+    /* Advance the MEMORY PREFIXES keyspace scan, if any. */
+    memoryPrefixCron();
+
     /* Perform hash tables rehashing if needed, but only if there are no
      * other processes saving the DB on disk. Otherwise rehashing is bad
      * as will cause a lot of copy-on-write of memory pages. */
@@ -1134,6 +1154,11 @@ int serverCron(struct aeEventLoop *eventLoop, long long id, void *clientData) {
             flushAppendOnlyFile(0);
     }
 
+    /* Decay the hot keys counters. */
+    run_with_period(HOTKEYS_DECAY_PERIOD*1000) {
+        hotkeysDecay();
+    }
+
     /* Close clients that need to be closed asynchronous */
     freeClientsInAsyncFreeQueue();
 
@@ -1195,8 +1220,11 @@ void beforeSleep(struct aeEventLoop *eventLoop) {
 
     /* Run a fast expire cycle (the called function will return
      * ASAP if a fast cycle is not needed). */
-    if (server.active_expire_enabled && server.masterhost == NULL)
+    if (server.active_expire_enabled && server.masterhost == NULL) {
+        long long start = ustime();
         activeExpireCycle(ACTIVE_EXPIRE_CYCLE_FAST);
+        latencyAddPhaseSample(LATENCY_PHASE_EXPIRE_FAST,ustime()-start);
+    }
 
     /* Send all the slaves an ACK request if at least one client blocked
      * during the previous event loop iteration. */
@@ -1227,10 +1255,14 @@ void beforeSleep(struct aeEventLoop *eventLoop) {
         processUnblockedClients();
 
     /* Write the AOF buffer on disk */
+    long long start = ustime();
     flushAppendOnlyFile(0);
+    long long aof_end = ustime();
+    latencyAddPhaseSample(LATENCY_PHASE_AOF_FLUSH,aof_end-start);
 
     /* Handle writes with pending output buffers. */
     handleClientsWithPendingWrites();
+    latencyAddPhaseSample(LATENCY_PHASE_PENDING_WRITES,ustime()-aof_end);
 
     /* Before we are going to sleep, let the threads access the dataset by
      * releasing the GIL. Redis main thread will not touch anything at this
@@ -1419,6 +1451,10 @@ void initServerConfig() {
     server.maxmemory_samples = CONFIG_DEFAULT_MAXMEMORY_SAMPLES;
     server.lfu_log_factor = CONFIG_DEFAULT_LFU_LOG_FACTOR;
     server.lfu_decay_time = CONFIG_DEFAULT_LFU_DECAY_TIME;
+    server.hotkeys_sample_ratio = CONFIG_DEFAULT_HOTKEYS_SAMPLE_RATIO;
+    server.memory_prefix_delimiters = zstrdup(CONFIG_DEFAULT_MEMORY_PREFIX_DELIMITERS);
+    server.memory_prefix_budget = CONFIG_DEFAULT_MEMORY_PREFIX_BUDGET;
+    server.memory_accounting = CONFIG_DEFAULT_MEMORY_ACCOUNTING;
     server.hash_max_ziplist_entries = OBJ_HASH_MAX_ZIPLIST_ENTRIES;
     server.hash_max_ziplist_value = OBJ_HASH_MAX_ZIPLIST_VALUE;
     server.list_max_ziplist_size = OBJ_LIST_MAX_ZIPLIST_SIZE;
@@ -1429,6 +1465,7 @@ void initServerConfig() {
     server.hll_sparse_max_bytes = CONFIG_DEFAULT_HLL_SPARSE_MAX_BYTES;
     server.shutdown_asap = 0;
     server.cluster_enabled = 0;
+    server.executing_slot = -1;
     server.cluster_node_timeout = CLUSTER_DEFAULT_NODE_TIMEOUT;
     server.cluster_migration_barrier = CLUSTER_DEFAULT_MIGRATION_BARRIER;
     server.cluster_slave_validity_factor = CLUSTER_DEFAULT_SLAVE_VALIDITY;
@@ -1513,6 +1550,7 @@ void initServerConfig() {
     server.execCommand = lookupCommandByCString("exec");
     server.expireCommand = lookupCommandByCString("expire");
     server.pexpireCommand = lookupCommandByCString("pexpire");
+    server.pexpireatCommand = lookupCommandByCString("pexpireat");
 
     /* Slow log */
     server.slowlog_log_slower_than = CONFIG_DEFAULT_SLOWLOG_LOG_SLOWER_THAN;
@@ -1843,6 +1881,7 @@ void initServer() {
         exit(1);
     }
     server.db = (redisDb *)zmalloc(sizeof(redisDb)*server.dbnum);
+    notifyKeyspaceEventsInit();
 
     /* Open the TCP listening socket for the user commands. */
     if (server.port != 0 &&
@@ -1876,6 +1915,9 @@ void initServer() {
     server.pubsub_patterns = listCreate();
     server.pubsub_patterns->listSetFreeMethod(freePubsubPattern);
     server.pubsub_patterns->listSetMatchMethod(listMatchPubsubPattern);
+    server.pubsub_patterns_index = raxNew();
+    server.shared_replies = dictCreate(&sharedRepliesDictType,NULL);
+    server.keyspace_listeners[0] = server.keyspace_listeners[1] = 0;
     server.cronloops = 0;
     server.rdb_child_pid = -1;
     server.aof_child_pid = -1;
@@ -2012,6 +2054,8 @@ void resetCommandTableStats() {
         c = (struct redisCommand *) de->dictGetVal();
         c->microseconds = 0;
         c->calls = 0;
+        zfree(c->latency_histogram);
+        c->latency_histogram = NULL;
     }
 }
 
@@ -2095,10 +2139,22 @@ struct redisCommand *lookupCommandOrOriginal(sds name) {
 void propagate(struct redisCommand *cmd, int dbid, robj **argv, int argc,
                int flags)
 {
+    memAcctFrame maf;
+    /* The time is only needed by the slow log. */
+    int timed = server.slowlog_log_slower_than >= 0;
+    long long start = timed ? ustime() : 0;
+
+    /* Buffers are not part of the keyspace memory. */
+    memAcctBeginNested(&maf);
     if (server.aof_state != AOF_OFF && flags & PROPAGATE_AOF)
         feedAppendOnlyFile(cmd,dbid,argv,argc);
-    if (flags & PROPAGATE_REPL)
+    if (flags & PROPAGATE_REPL) {
         replicationFeedSlaves(server.slaves,dbid,argv,argc);
+        if (server.cluster_enabled)
+            clusterFeedSlotMigration(cmd,dbid,argv,argc);
+    }
+    memAcctEnd(&maf);
+    if (timed) server.propagate_usec += ustime()-start;
 }
 
 /* Used inside commands to schedule the propagation of additional commands
@@ -2117,16 +2173,19 @@ void alsoPropagate(struct redisCommand *cmd, int dbid, robj **argv, int argc,
                    int target)
 {
     robj **argvcopy;
+    memAcctFrame maf;
     int j;
 
     if (server.loading) return; /* No propagation during loading. */
 
+    memAcctBeginNested(&maf);
     argvcopy = (robj**)zmalloc(sizeof(robj*)*argc);
     for (j = 0; j < argc; j++) {
         argvcopy[j] = argv[j];
         incrRefCount(argv[j]);
     }
     redisOpArrayAppend(&server.also_propagate,cmd,dbid,argvcopy,argc,target);
+    memAcctEnd(&maf);
 }
 
 /* It is possible to call the function forceCommandPropagation() inside a
@@ -2194,6 +2253,17 @@ void preventCommandReplication(client *c) {
 void call(client *c, int flags) {
     long long dirty, start, duration;
     int client_old_flags = c->m_flags;
+    memAcctFrame maf_call, maf_proc;
+    /* Counters used to break down the duration in the slow log. */
+    long long propagate_usec = server.propagate_usec;
+    long long notify_usec = server.notify_usec;
+    long long reply_bytes = c->m_reply_bytes+c->m_response_buff_pos;
+    long long allocated = zmalloc_thread_used_memory();
+    long long propagate_usec_proc;
+
+    /* Only the command itself is accounted as keyspace memory: not what
+     * call() does around it, that may be running inside EVAL or EXEC. */
+    memAcctBeginNested(&maf_call);
 
     /* Sent the command to clients in MONITOR mode, only if the commands are
      * not generated from reading an AOF. */
@@ -2210,11 +2280,20 @@ void call(client *c, int flags) {
     redisOpArray prev_also_propagate = server.also_propagate;
     redisOpArrayInit(&server.also_propagate);
 
+    /* Expose the hash slot of the keys of the command, if known. Modules
+     * can open any key, so for them it is always computed again. */
+    int prev_executing_slot = server.executing_slot;
+    server.executing_slot = (c->m_cmd->m_flags & CMD_MODULE) ? -1 : c->m_slot;
+
     /* Call the command. */
     dirty = server.dirty;
     start = ustime();
+    memAcctBegin(&maf_proc,c);
     c->m_cmd->proc(c);
+    memAcctEnd(&maf_proc);
     duration = ustime()-start;
+    propagate_usec_proc = server.propagate_usec;
+    server.executing_slot = prev_executing_slot;
     dirty = server.dirty-dirty;
     if (dirty < 0) dirty = 0;
 
@@ -2233,17 +2312,23 @@ void call(client *c, int flags) {
             server.lua_caller->m_flags |= CLIENT_FORCE_AOF;
     }
 
-    /* Log the command into the Slow log if needed, and populate the
-     * per-command statistics that we show in INFO commandstats. */
+    /* Populate the latency monitor and the per-command statistics that we
+     * show in INFO commandstats. */
     if (flags & CMD_CALL_SLOWLOG && c->m_cmd->proc != execCommand) {
         const char *latency_event = (c->m_cmd->m_flags & CMD_FAST) ?
                               "fast-command" : "command";
         latencyAddSampleIfNeeded(latency_event,duration/1000);
-        slowlogPushEntryIfNeeded(c,c->m_argv,c->m_argc,duration);
     }
     if (flags & CMD_CALL_STATS) {
         c->m_last_cmd->microseconds += duration;
         c->m_last_cmd->calls++;
+        latencyHistogramAdd(&c->m_last_cmd->latency_histogram,duration);
+        /* Per client totals, see CLIENT TOP. The commands of a transaction
+         * are accounted one by one. */
+        if (c->m_cmd->proc != execCommand) {
+            c->m_stat_cmds++;
+            c->m_stat_cmd_usec += duration;
+        }
     }
 
     /* Propagate the command into the AOF and replication link */
@@ -2305,7 +2390,23 @@ void call(client *c, int flags) {
         redisOpArrayFree(&server.also_propagate);
     }
     server.also_propagate = prev_also_propagate;
+
+    /* Log the command into the Slow log if needed. Since the command is
+     * propagated after it returns, the propagation adds to its duration. */
+    if (flags & CMD_CALL_SLOWLOG && c->m_cmd->proc != execCommand) {
+        slowlogPhases phases;
+
+        duration += server.propagate_usec-propagate_usec_proc;
+        phases.propagation = server.propagate_usec-propagate_usec;
+        phases.notification = server.notify_usec-notify_usec;
+        phases.execution = duration-phases.propagation-phases.notification;
+        phases.reply_bytes =
+            c->m_reply_bytes+c->m_response_buff_pos-reply_bytes;
+        phases.allocated = zmalloc_thread_used_memory()-allocated;
+        slowlogPushEntryIfNeeded(c,c->m_argv,c->m_argc,duration,&phases);
+    }
     server.stat_numcommands++;
+    memAcctEnd(&maf_call);
 }
 
 /* If this function gets called we already read a whole
@@ -2353,16 +2454,17 @@ int processCommand(client *c) {
 
     /* If cluster is enabled perform the cluster redirection here.
      * However we don't perform the redirection if:
-     * 1) The sender of this command is our master.
+     * 1) The sender of this command is our master, or a node migrating
+     *    slots to us with CLUSTER MIGRATESLOTS.
      * 2) The command has no key arguments. */
     if (server.cluster_enabled &&
-        !(c->m_flags & CLIENT_MASTER) &&
+        !(c->m_flags & (CLIENT_MASTER|CLIENT_SLOT_IMPORT)) &&
         !(c->m_flags & CLIENT_LUA &&
           server.lua_caller->m_flags & CLIENT_MASTER) &&
         !(c->m_cmd->getkeys_proc == NULL && c->m_cmd->firstkey == 0 &&
           c->m_cmd->proc != execCommand))
     {
-        int hashslot;
+        int hashslot = -1;
         int error_code;
         clusterNode *n = getNodeByQuery(c,c->m_cmd,c->m_argv,c->m_argc,
                                         &hashslot,&error_code);
@@ -2375,6 +2477,17 @@ int processCommand(client *c) {
             clusterRedirectClient(c,n,hashslot,error_code);
             return C_OK;
         }
+        /* All the keys of the command are in this slot: remember it so
+         * that it is not computed again while executing the command. */
+        c->m_slot = hashslot;
+    }
+
+    /* A node migrating slots to us with CLUSTER MIGRATESLOTS may only write
+     * the slots it is importing. */
+    if (c->m_flags & CLIENT_SLOT_IMPORT && !clusterSlotImportAllowsCommand(c)) {
+        flagTransaction(c);
+        c->addReplyError("The command accesses keys outside the imported slots");
+        return C_OK;
     }
 
     /* Handle the maxmemory directive.
@@ -2807,28 +2920,89 @@ void bytesToHuman(char *s, unsigned long long n) {
     }
 }
 
-/* Create the string returned by the INFO command. This is decoupled
- * by the INFO command itself as we need to report the same information
- * on memory corruption problems. */
-sds genRedisInfoString(const char *section) {
-    sds info = sdsempty();
-    time_t uptime = server.unixtime-server.stat_starttime;
+/* INFO section names and flags. */
+static struct {
+    const char *name;
+    int flag;
+} infoSections[] = {
+    {"server",INFO_SECTION_SERVER},
+    {"clients",INFO_SECTION_CLIENTS},
+    {"memory",INFO_SECTION_MEMORY},
+    {"persistence",INFO_SECTION_PERSISTENCE},
+    {"stats",INFO_SECTION_STATS},
+    {"replication",INFO_SECTION_REPLICATION},
+    {"cpu",INFO_SECTION_CPU},
+    {"commandstats",INFO_SECTION_COMMANDSTATS},
+    {"latencystats",INFO_SECTION_LATENCYSTATS},
+    {"hotkeys",INFO_SECTION_HOTKEYS},
+    {"eventloop",INFO_SECTION_EVENTLOOP},
+    {"scriptstats",INFO_SECTION_SCRIPTSTATS},
+    {"cluster",INFO_SECTION_CLUSTER},
+    {"keyspace",INFO_SECTION_KEYSPACE},
+    {"default",INFO_SECTION_DEFAULT},
+    {"all",INFO_SECTION_ALL},
+    {NULL,0}
+};
+
+/* Return the INFO_SECTION_* flags selected by a section name, or 0 if the
+ * name is unknown. */
+int getInfoSectionsByName(const char *name) {
     int j;
-    struct rusage self_ru, c_ru;
-    unsigned long lol, bib;
-    int allsections = 0, defsections = 0;
-    int sections = 0;
 
+    for (j = 0; infoSections[j].name; j++) {
+        if (!strcasecmp(name,infoSections[j].name))
+            return infoSections[j].flag;
+    }
+    return 0;
+}
+
+/* The following inputs of INFO are expensive to compute, since they walk
+ * all the clients, so they are computed at most once per cron tick. Values
+ * a tick old are fine for monitoring, and agents polling INFO frequently
+ * on many instances don't add load proportional to the number of clients.
+ * The cron doesn't run while loading, so then they are always computed. */
+static void getInfoClientsMaxBuffers(unsigned long *lol, unsigned long *bib) {
+    static int cronloops = -1;
+    static unsigned long cached_lol, cached_bib;
+
+    if (server.loading || cronloops != server.cronloops) {
+        getClientsMaxBuffers(&cached_lol,&cached_bib);
+        cronloops = server.cronloops;
+    }
+    *lol = cached_lol;
+    *bib = cached_bib;
+}
+
+static struct redisMemOverhead *getInfoMemoryOverheadData(void) {
+    static int cronloops = -1;
+    static struct redisMemOverhead *mh = NULL;
+
+    if (mh == NULL || server.loading || cronloops != server.cronloops) {
+        if (mh) freeMemoryOverheadData(mh);
+        mh = getMemoryOverheadData();
+        cronloops = server.cronloops;
+    }
+    return mh;
+}
+
+/* Like genRedisInfoStringBySections(), selecting a section by name. */
+sds genRedisInfoString(const char *section) {
     if (section == NULL) section = "default";
-    allsections = strcasecmp(section,"all") == 0;
-    defsections = strcasecmp(section,"default") == 0;
+    return genRedisInfoStringBySections(getInfoSectionsByName(section));
+}
 
-    getrusage(RUSAGE_SELF, &self_ru);
-    getrusage(RUSAGE_CHILDREN, &c_ru);
-    getClientsMaxBuffers(&lol,&bib);
+/* Create the string returned by the INFO command, with the sections
+ * selected by the 'sections' bitmask of INFO_SECTION_* flags. This is
+ * decoupled by the INFO command itself as we need to report the same
+ * information on memory corruption problems. */
+sds genRedisInfoStringBySections(int sections) {
+    sds info = sdsempty();
+    time_t uptime = server.unixtime-server.stat_starttime;
+    int j;
+    int emitted = 0;
 
     /* Server */
-    if (allsections || defsections || !strcasecmp(section,"server")) {
+    if (sections & INFO_SECTION_SERVER) {
         static int call_uname = 1;
         static struct utsname name;
         char *mode;
@@ -2837,7 +3011,7 @@ sds genRedisInfoString(const char *section) {
         else if (server.sentinel_mode) mode = "sentinel";
         else mode = "standalone";
 
-        if (sections++) info = sdscat(info,"\r\n");
+        if (emitted++) info = sdscat(info,"\r\n");
 
         if (call_uname) {
             /* Uname can be slow and is always the same output. Cache it. */
@@ -2894,21 +3068,25 @@ sds genRedisInfoString(const char *section) {
     }
 
     /* Clients */
-    if (allsections || defsections || !strcasecmp(section,"clients")) {
-        if (sections++) info = sdscat(info,"\r\n");
-        info = sdscatprintf(info,
+    if (sections & INFO_SECTION_CLIENTS) {
+        unsigned long lol, bib;
+
+        getInfoClientsMaxBuffers(&lol,&bib);
+        if (emitted++) info = sdscat(info,"\r\n");
+        info = sdscatfmt(info,
             "# Clients\r\n"
-            "connected_clients:%lu\r\n"
-            "client_longest_output_list:%lu\r\n"
-            "client_biggest_input_buf:%lu\r\n"
-            "blocked_clients:%d\r\n",
-            server.clients->listLength() - server.slaves->listLength(),
-            lol, bib,
+            "connected_clients:%U\r\n"
+            "client_longest_output_list:%U\r\n"
+            "client_biggest_input_buf:%U\r\n"
+            "blocked_clients:%i\r\n",
+            (unsigned long long)(server.clients->listLength() -
+                                 server.slaves->listLength()),
+            (unsigned long long)lol, (unsigned long long)bib,
             server.bpop_blocked_clients);
     }
 
     /* Memory */
-    if (allsections || defsections || !strcasecmp(section,"memory")) {
+    if (sections & INFO_SECTION_MEMORY) {
         char hmem[64];
         char peak_hmem[64];
         char total_system_hmem[64];
@@ -2919,7 +3097,7 @@ sds genRedisInfoString(const char *section) {
         size_t total_system_mem = server.system_memory_size;
         const char *evict_policy = evictPolicyToString();
         long long memory_lua = (long long)lua_gc(server.lua,LUA_GCCOUNT,0)*1024;
-        struct redisMemOverhead *mh = getMemoryOverheadData();
+        struct redisMemOverhead *mh = getInfoMemoryOverheadData();
 
         /* Peak memory is updated from time to time by serverCron() so it
          * may happen that the instantaneous value is slightly bigger than
@@ -2935,7 +3113,7 @@ sds genRedisInfoString(const char *section) {
         bytesToHuman(used_memory_rss_hmem,server.resident_set_size);
         bytesToHuman(maxmemory_hmem,server.maxmemory);
 
-        if (sections++) info = sdscat(info,"\r\n");
+        if (emitted++) info = sdscat(info,"\r\n");
         info = sdscatprintf(info,
             "# Memory\r\n"
             "used_memory:%zu\r\n"
@@ -2983,48 +3161,48 @@ sds genRedisInfoString(const char *section) {
             server.active_defrag_running,
             lazyfreeGetPendingObjectsCount()
         );
-        freeMemoryOverheadData(mh);
+        info = genMemAcctInfoString(info);
     }
 
     /* Persistence */
-    if (allsections || defsections || !strcasecmp(section,"persistence")) {
-        if (sections++) info = sdscat(info,"\r\n");
-        info = sdscatprintf(info,
+    if (sections & INFO_SECTION_PERSISTENCE) {
+        if (emitted++) info = sdscat(info,"\r\n");
+        info = sdscatfmt(info,
             "# Persistence\r\n"
-            "loading:%d\r\n"
-            "rdb_changes_since_last_save:%lld\r\n"
-            "rdb_bgsave_in_progress:%d\r\n"
-            "rdb_last_save_time:%jd\r\n"
+            "loading:%i\r\n"
+            "rdb_changes_since_last_save:%I\r\n"
+            "rdb_bgsave_in_progress:%i\r\n"
+            "rdb_last_save_time:%I\r\n"
             "rdb_last_bgsave_status:%s\r\n"
-            "rdb_last_bgsave_time_sec:%jd\r\n"
-            "rdb_current_bgsave_time_sec:%jd\r\n"
-            "rdb_last_cow_size:%zu\r\n"
-            "aof_enabled:%d\r\n"
-            "aof_rewrite_in_progress:%d\r\n"
-            "aof_rewrite_scheduled:%d\r\n"
-            "aof_last_rewrite_time_sec:%jd\r\n"
-            "aof_current_rewrite_time_sec:%jd\r\n"
+            "rdb_last_bgsave_time_sec:%I\r\n"
+            "rdb_current_bgsave_time_sec:%I\r\n"
+            "rdb_last_cow_size:%U\r\n"
+            "aof_enabled:%i\r\n"
+            "aof_rewrite_in_progress:%i\r\n"
+            "aof_rewrite_scheduled:%i\r\n"
+            "aof_last_rewrite_time_sec:%I\r\n"
+            "aof_current_rewrite_time_sec:%I\r\n"
             "aof_last_bgrewrite_status:%s\r\n"
             "aof_last_write_status:%s\r\n"
-            "aof_last_cow_size:%zu\r\n",
+            "aof_last_cow_size:%U\r\n",
             server.loading,
             server.dirty,
             server.rdb_child_pid != -1,
-            (intmax_t)server.lastsave,
+            (long long)server.lastsave,
             (server.lastbgsave_status == C_OK) ? "ok" : "err",
-            (intmax_t)server.rdb_save_time_last,
-            (intmax_t)((server.rdb_child_pid == -1) ?
+            (long long)server.rdb_save_time_last,
+            (long long)((server.rdb_child_pid == -1) ?
                 -1 : time(NULL)-server.rdb_save_time_start),
-            server.stat_rdb_cow_bytes,
+            (unsigned long long)server.stat_rdb_cow_bytes,
             server.aof_state != AOF_OFF,
             server.aof_child_pid != -1,
             server.aof_rewrite_scheduled,
-            (intmax_t)server.aof_rewrite_time_last,
-            (intmax_t)((server.aof_child_pid == -1) ?
+            (long long)server.aof_rewrite_time_last,
+            (long long)((server.aof_child_pid == -1) ?
                 -1 : time(NULL)-server.aof_rewrite_time_start),
             (server.aof_lastbgrewrite_status == C_OK) ? "ok" : "err",
             (server.aof_last_write_status == C_OK) ? "ok" : "err",
-            server.stat_aof_cow_bytes);
+            (unsigned long long)server.stat_aof_cow_bytes);
 
         if (server.aof_state != AOF_OFF) {
             info = sdscatprintf(info,
@@ -3077,41 +3255,43 @@ sds genRedisInfoString(const char *section) {
     }
 
     /* Stats */
-    if (allsections || defsections || !strcasecmp(section,"stats")) {
-        if (sections++) info = sdscat(info,"\r\n");
-        info = sdscatprintf(info,
+    if (sections & INFO_SECTION_STATS) {
+        if (emitted++) info = sdscat(info,"\r\n");
+        info = sdscatfmt(info,
             "# Stats\r\n"
-            "total_connections_received:%lld\r\n"
-            "total_commands_processed:%lld\r\n"
-            "instantaneous_ops_per_sec:%lld\r\n"
-            "total_net_input_bytes:%lld\r\n"
-            "total_net_output_bytes:%lld\r\n"
-            "instantaneous_input_kbps:%.2f\r\n"
-            "instantaneous_output_kbps:%.2f\r\n"
-            "rejected_connections:%lld\r\n"
-            "sync_full:%lld\r\n"
-            "sync_partial_ok:%lld\r\n"
-            "sync_partial_err:%lld\r\n"
-            "expired_keys:%lld\r\n"
-            "evicted_keys:%lld\r\n"
-            "keyspace_hits:%lld\r\n"
-            "keyspace_misses:%lld\r\n"
-            "pubsub_channels:%ld\r\n"
-            "pubsub_patterns:%lu\r\n"
-            "latest_fork_usec:%lld\r\n"
-            "migrate_cached_sockets:%ld\r\n"
-            "slave_expires_tracked_keys:%zu\r\n"
-            "active_defrag_hits:%lld\r\n"
-            "active_defrag_misses:%lld\r\n"
-            "active_defrag_key_hits:%lld\r\n"
-            "active_defrag_key_misses:%lld\r\n",
+            "total_connections_received:%I\r\n"
+            "total_commands_processed:%I\r\n"
+            "instantaneous_ops_per_sec:%I\r\n"
+            "total_net_input_bytes:%I\r\n"
+            "total_net_output_bytes:%I\r\n",
             server.stat_numconnections,
             server.stat_numcommands,
             getInstantaneousMetric(STATS_METRIC_COMMAND),
             server.stat_net_input_bytes,
-            server.stat_net_output_bytes,
+            server.stat_net_output_bytes);
+        info = sdscatprintf(info,
+            "instantaneous_input_kbps:%.2f\r\n"
+            "instantaneous_output_kbps:%.2f\r\n",
             (float)getInstantaneousMetric(STATS_METRIC_NET_INPUT)/1024,
-            (float)getInstantaneousMetric(STATS_METRIC_NET_OUTPUT)/1024,
+            (float)getInstantaneousMetric(STATS_METRIC_NET_OUTPUT)/1024);
+        info = sdscatfmt(info,
+            "rejected_connections:%I\r\n"
+            "sync_full:%I\r\n"
+            "sync_partial_ok:%I\r\n"
+            "sync_partial_err:%I\r\n"
+            "expired_keys:%I\r\n"
+            "evicted_keys:%I\r\n"
+            "keyspace_hits:%I\r\n"
+            "keyspace_misses:%I\r\n"
+            "pubsub_channels:%U\r\n"
+            "pubsub_patterns:%U\r\n"
+            "latest_fork_usec:%I\r\n"
+            "migrate_cached_sockets:%U\r\n"
+            "slave_expires_tracked_keys:%U\r\n"
+            "active_defrag_hits:%I\r\n"
+            "active_defrag_misses:%I\r\n"
+            "active_defrag_key_hits:%I\r\n"
+            "active_defrag_key_misses:%I\r\n",
             server.stat_rejected_conn,
             server.stat_sync_full,
             server.stat_sync_partial_ok,
@@ -3120,11 +3300,11 @@ sds genRedisInfoString(const char *section) {
             server.stat_evictedkeys,
             server.stat_keyspace_hits,
             server.stat_keyspace_misses,
-            server.pubsub_channels->dictSize(),
-            server.pubsub_patterns->listLength(),
+            (unsigned long long)server.pubsub_channels->dictSize(),
+            (unsigned long long)server.pubsub_patterns->listLength(),
             server.stat_fork_time,
-            server.migrate_cached_sockets->dictSize(),
-            getSlaveKeyWithExpireCount(),
+            (unsigned long long)server.migrate_cached_sockets->dictSize(),
+            (unsigned long long)getSlaveKeyWithExpireCount(),
             server.stat_active_defrag_hits,
             server.stat_active_defrag_misses,
             server.stat_active_defrag_key_hits,
@@ -3132,8 +3312,8 @@ sds genRedisInfoString(const char *section) {
     }
 
     /* Replication */
-    if (allsections || defsections || !strcasecmp(section,"replication")) {
-        if (sections++) info = sdscat(info,"\r\n");
+    if (sections & INFO_SECTION_REPLICATION) {
+        if (emitted++) info = sdscat(info,"\r\n");
         info = sdscatprintf(info,
             "# Replication\r\n"
             "role:%s\r\n",
@@ -3260,8 +3440,12 @@ sds genRedisInfoString(const char *section) {
     }
 
     /* CPU */
-    if (allsections || defsections || !strcasecmp(section,"cpu")) {
-        if (sections++) info = sdscat(info,"\r\n");
+    if (sections & INFO_SECTION_CPU) {
+        struct rusage self_ru, c_ru;
+
+        getrusage(RUSAGE_SELF, &self_ru);
+        getrusage(RUSAGE_CHILDREN, &c_ru);
+        if (emitted++) info = sdscat(info,"\r\n");
         info = sdscatprintf(info,
         "# CPU\r\n"
         "used_cpu_sys:%.2f\r\n"
@@ -3275,8 +3459,8 @@ sds genRedisInfoString(const char *section) {
     }
 
     /* Command statistics */
-    if (allsections || !strcasecmp(section,"commandstats")) {
-        if (sections++) info = sdscat(info,"\r\n");
+    if (sections & INFO_SECTION_COMMANDSTATS) {
+        if (emitted++) info = sdscat(info,"\r\n");
         info = sdscatprintf(info, "# Commandstats\r\n");
 
         struct redisCommand *c;
@@ -3292,9 +3476,50 @@ sds genRedisInfoString(const char *section) {
         }
     }
 
+    /* Commands latency percentiles */
+    if (sections & INFO_SECTION_LATENCYSTATS) {
+        if (emitted++) info = sdscat(info,"\r\n");
+        info = sdscatprintf(info, "# Latencystats\r\n");
+
+        struct redisCommand *c;
+        dictEntry *de;
+        dictIterator di(server.commands, 1);
+        while((de = di.dictNext()) != NULL) {
+            c = (struct redisCommand *) de->dictGetVal();
+            if (!c->calls || !c->latency_histogram) continue;
+            info = sdscatprintf(info,
+                "latency_percentiles_usec_%s:p50=%lld,p99=%lld,p99.9=%lld\r\n",
+                c->name,
+                latencyHistogramPercentile(c->latency_histogram,50),
+                latencyHistogramPercentile(c->latency_histogram,99),
+                latencyHistogramPercentile(c->latency_histogram,99.9));
+        }
+    }
+
+    /* Hot keys */
+    if (sections & INFO_SECTION_HOTKEYS) {
+        if (emitted++) info = sdscat(info,"\r\n");
+        info = sdscatprintf(info, "# Hotkeys\r\n");
+        info = genHotkeysInfoString(info);
+    }
+
+    /* Event loop phases */
+    if (sections & INFO_SECTION_EVENTLOOP) {
+        if (emitted++) info = sdscat(info,"\r\n");
+        info = sdscatprintf(info, "# Eventloop\r\n");
+        info = genLatencyPhasesInfoString(info);
+    }
+
+    /* Scripts statistics */
+    if (sections & INFO_SECTION_SCRIPTSTATS) {
+        if (emitted++) info = sdscat(info,"\r\n");
+        info = sdscatprintf(info, "# Scriptstats\r\n");
+        info = genLuaScriptsInfoString(info);
+    }
+
     /* Cluster */
-    if (allsections || defsections || !strcasecmp(section,"cluster")) {
-        if (sections++) info = sdscat(info,"\r\n");
+    if (sections & INFO_SECTION_CLUSTER) {
+        if (emitted++) info = sdscat(info,"\r\n");
         info = sdscatprintf(info,
         "# Cluster\r\n"
         "cluster_enabled:%d\r\n",
@@ -3302,8 +3527,8 @@ sds genRedisInfoString(const char *section) {
     }
 
     /* Key space */
-    if (allsections || defsections || !strcasecmp(section,"keyspace")) {
-        if (sections++) info = sdscat(info,"\r\n");
+    if (sections & INFO_SECTION_KEYSPACE) {
+        if (emitted++) info = sdscat(info,"\r\n");
         info = sdscatprintf(info, "# Keyspace\r\n");
         for (j = 0; j < server.dbnum; j++) {
             long long keys, vkeys;
@@ -3311,8 +3536,8 @@ sds genRedisInfoString(const char *section) {
             keys = server.db[j].m_dict->dictSize();
             vkeys = server.db[j].m_expires->dictSize();
             if (keys || vkeys) {
-                info = sdscatprintf(info,
-                    "db%d:keys=%lld,expires=%lld,avg_ttl=%lld\r\n",
+                info = sdscatfmt(info,
+                    "db%i:keys=%I,expires=%I,avg_ttl=%I\r\n",
                     j, keys, vkeys, server.db[j].m_avg_ttl);
             }
         }
@@ -3320,14 +3545,68 @@ sds genRedisInfoString(const char *section) {
     return info;
 }
 
+/* Reply with the fields of the INFO string 'info' as a flat array of names
+ * and values. Section headers and the "_human" duplicates of other fields
+ * are omitted. */
+static void addReplyInfoMap(client *c, sds info) {
+    void *replylen = c->addDeferredMultiBulkLength();
+    char *p = info, *end = info+sdslen(info);
+    long fields = 0;
+
+    while (p < end) {
+        char *eol = (char*)memchr(p,'\n',end-p);
+        char *next = eol ? eol+1 : end;
+        size_t linelen = (eol ? eol : end)-p;
+        char *colon;
+
+        if (linelen && p[linelen-1] == '\r') linelen--;
+        if (linelen && p[0] != '#' &&
+            (colon = (char*)memchr(p,':',linelen)) != NULL)
+        {
+            size_t namelen = colon-p;
+
+            if (namelen < 6 || memcmp(colon-6,"_human",6)) {
+                c->addReplyBulkCBuffer(p,namelen);
+                c->addReplyBulkCBuffer(colon+1,linelen-namelen-1);
+                fields++;
+            }
+        }
+        p = next;
+    }
+    c->setDeferredMultiBulkLength(replylen,fields*2);
+}
+
+/* INFO [section ...]
+ * INFO MAP [section ...]
+ *
+ * Every section argument is either a section name or a bitmask of the
+ * INFO_SECTION_* flags, and the selected sections are merged. The MAP form
+ * replies with a flat array of field names and values, that monitoring
+ * agents can consume without parsing the text. */
 void infoCommand(client *c) {
-    const char *section = c->m_argc == 2 ? (char *)c->m_argv[1]->ptr : "default";
+    int sections = 0, map = 0, j = 1;
 
-    if (c->m_argc > 2) {
-        c->addReply(shared.syntaxerr);
-        return;
+    if (c->m_argc > 1 && !strcasecmp((const char*)c->m_argv[1]->ptr,"map")) {
+        map = 1;
+        j++;
+    }
+    if (j == c->m_argc) sections = INFO_SECTION_DEFAULT;
+    for (; j < c->m_argc; j++) {
+        long long mask;
+
+        if (getLongLongFromObject(c->m_argv[j],&mask) == C_OK)
+            sections |= (int)(mask & INFO_SECTION_ALL);
+        else
+            sections |= getInfoSectionsByName((const char*)c->m_argv[j]->ptr);
+    }
+
+    if (map) {
+        sds info = genRedisInfoStringBySections(sections);
+        addReplyInfoMap(c,info);
+        sdsfree(info);
+    } else {
+        c->addReplyBulkSds(genRedisInfoStringBySections(sections));
     }
-    c->addReplyBulkSds( genRedisInfoString(section));
 }
 
 void monitorCommand(client *c) {
@@ -3688,6 +3967,8 @@ redisDb::redisDb(int in_id)
     m_watched_keys = dictCreate(&keylistDictType,NULL);
     m_id = in_id;
     m_avg_ttl = 0;
+    m_hotkeys = NULL;
+    m_memacct = server.memory_accounting ? memAcctCreateCounters() : NULL;
 }
 
 int main(int argc, char **argv) {
@@ -3881,6 +4162,7 @@ int main(int argc, char **argv) {
 
     server.el->aeSetBeforeSleepProc(beforeSleep);
     server.el->aeSetAfterSleepProc(afterSleep);
+    server.el->aeSetPhaseProc(latencyEventLoopPhaseProc);
     server.el->aeMain();
     aeDeleteEventLoop(server.el);
     return 0;
@@ -136,6 +136,10 @@ typedef long long mstime_t; /* millisecond time type. */
 #define CONFIG_DEFAULT_MAXMEMORY_SAMPLES 5
 #define CONFIG_DEFAULT_LFU_LOG_FACTOR 10
 #define CONFIG_DEFAULT_LFU_DECAY_TIME 1
+#define CONFIG_DEFAULT_HOTKEYS_SAMPLE_RATIO 0   /* Hot keys tracking disabled. */
+#define CONFIG_DEFAULT_MEMORY_PREFIX_DELIMITERS ":"
+#define CONFIG_DEFAULT_MEMORY_PREFIX_BUDGET 1000 /* Microseconds per cron cycle. */
+#define CONFIG_DEFAULT_MEMORY_ACCOUNTING 0
 #define CONFIG_DEFAULT_AOF_FILENAME "appendonly.aof"
 #define CONFIG_DEFAULT_AOF_NO_FSYNC_ON_REWRITE 0
 #define CONFIG_DEFAULT_AOF_LOAD_TRUNCATED 1
@@ -174,6 +178,29 @@ typedef long long mstime_t; /* millisecond time type. */
 #define STATS_METRIC_NET_OUTPUT 2   /* Bytes written to network. */
 #define STATS_METRIC_COUNT 3
 
+/* INFO sections, selectable as a bitmask. The bits must not change: they
+ * are part of the INFO MAP interface. */
+#define INFO_SECTION_SERVER (1<<0)
+#define INFO_SECTION_CLIENTS (1<<1)
+#define INFO_SECTION_MEMORY (1<<2)
+#define INFO_SECTION_PERSISTENCE (1<<3)
+#define INFO_SECTION_STATS (1<<4)
+#define INFO_SECTION_REPLICATION (1<<5)
+#define INFO_SECTION_CPU (1<<6)
+#define INFO_SECTION_COMMANDSTATS (1<<7)
+#define INFO_SECTION_LATENCYSTATS (1<<8)
+#define INFO_SECTION_HOTKEYS (1<<9)
+#define INFO_SECTION_EVENTLOOP (1<<10)
+#define INFO_SECTION_SCRIPTSTATS (1<<11)
+#define INFO_SECTION_CLUSTER (1<<12)
+#define INFO_SECTION_KEYSPACE (1<<13)
+#define INFO_SECTION_ALL ((1<<14)-1)
+#define INFO_SECTION_DEFAULT (INFO_SECTION_SERVER|INFO_SECTION_CLIENTS| \
+                              INFO_SECTION_MEMORY|INFO_SECTION_PERSISTENCE| \
+                              INFO_SECTION_STATS|INFO_SECTION_REPLICATION| \
+                              INFO_SECTION_CPU|INFO_SECTION_CLUSTER| \
+                              INFO_SECTION_KEYSPACE)
+
 /* Protocol and I/O related defines */
 #define PROTO_MAX_QUERYBUF_LEN  (1024*1024*1024) /* 1GB max query buffer. */
 #define PROTO_IOBUF_LEN         (1024*16)  /* Generic I/O buffer size */
@@ -248,6 +275,9 @@ typedef long long mstime_t; /* millisecond time type. */
 #define CLIENT_LUA_DEBUG (1<<25)  /* Run EVAL in debug mode. */
 #define CLIENT_LUA_DEBUG_SYNC (1<<26)  /* EVAL debugging without fork() */
 #define CLIENT_MODULE (1<<27) /* Non connected client used by some module. */
+#define CLIENT_SLOT_IMPORT (1<<28) /* Link of a CLUSTER MIGRATESLOTS source. */
+#define CLIENT_LUA_REPLY_SINK (1<<29) /* Lua client replies go to the Lua
+                                         stack instead of the buffers. */
 
 /* Client block type (btype field in client structure)
  * if CLIENT_BLOCKED flag is set. */
@@ -622,6 +652,8 @@ public:
     dict *m_watched_keys;         /* WATCHED keys for MULTI/EXEC CAS */
     int m_id;                     /* Database ID */
     long long m_avg_ttl;          /* Average TTL, just for stats */
+    struct hotkeysTracker *m_hotkeys; /* Hot keys sketch, see hotkeys.c */
+    struct memAcctCounters *m_memacct; /* Memory by type, see memacct.c */
 };
 
 /* Client MULTI/EXEC state */
@@ -693,6 +725,7 @@ public:
     // implemented in networking.cpp
     void addReply(robj *obj);
     void addReplySds(sds s);
+    void addReplySharedSds(sds s);
     void addReplyString(const char *s, size_t len);
     void addReplyError(const char *err);
     void addReplyErrorFormat(const char *fmt, ...);
@@ -763,6 +796,8 @@ public:
     robj **m_argv;            /* Arguments of current command. */
     redisCommand *m_cmd;
     redisCommand *m_last_cmd;  /* Last command executed. */
+    int m_slot;               /* Hash slot of the command keys as computed
+                                 by the cluster redirection, or -1. */
     int m_req_protocol_type;   /* Request protocol type: PROTO_REQ_* */
     int m_multi_bulk_len;       /* Number of multi bulk arguments left to read. */
     long m_bulk_len;           /* Length of bulk argument in multi bulk request. */
@@ -772,6 +807,10 @@ public:
                                buffer or object being sent. */
     time_t m_ctime;           /* Client creation time. */
     time_t m_last_interaction_time; /* Time of the last interaction, used for timeout */
+    unsigned long long m_stat_cmds;     /* Commands executed. */
+    unsigned long long m_stat_cmd_usec; /* Time spent executing commands. */
+    unsigned long long m_stat_net_input_bytes;  /* Bytes read from the client. */
+    unsigned long long m_stat_net_output_bytes; /* Bytes written to the client. */
     time_t m_obuf_soft_limit_reached_time;
     int m_flags;              /* Client flags: CLIENT_* macros. */
     int m_authenticated;      /* When requirepass is non-NULL. */
@@ -1059,7 +1098,7 @@ struct redisServer {
     /* Fast pointers to often looked up command */
     struct redisCommand *delCommand, *multiCommand, *lpushCommand, *lpopCommand,
                         *rpopCommand, *sremCommand, *execCommand, *expireCommand,
-                        *pexpireCommand;
+                        *pexpireCommand, *pexpireatCommand;
     /* Fields used only for stats */
     time_t stat_starttime;          /* Server start time */
     long long stat_numcommands;     /* Number of processed commands */
@@ -1083,6 +1122,8 @@ struct redisServer {
     long long slowlog_entry_id;     /* SLOWLOG current entry ID */
     long long slowlog_log_slower_than; /* SLOWLOG time limit (to get logged) */
     unsigned long slowlog_max_len;     /* SLOWLOG max number of items logged */
+    long long propagate_usec;       /* Time spent in propagate(). */
+    long long notify_usec;          /* Time spent notifying keyspace events. */
     size_t resident_set_size;       /* RSS sampled in serverCron(). */
     long long stat_net_input_bytes; /* Bytes read from network. */
     long long stat_net_output_bytes; /* Bytes written to network. */
@@ -1248,6 +1289,10 @@ struct redisServer {
     int maxmemory_samples;          /* Pricision of random sampling */
     int lfu_log_factor;             /* LFU logarithmic counter factor. */
     int lfu_decay_time;             /* LFU counter decay factor. */
+    int hotkeys_sample_ratio;       /* Count 1 key lookup every N, 0 = off. */
+    char *memory_prefix_delimiters; /* Key prefix delimiters of MEMORY PREFIXES. */
+    long long memory_prefix_budget; /* Max usec of MEMORY PREFIXES scan per cron. */
+    int memory_accounting;          /* Exact memory usage by type and DB. */
     /* Blocked clients */
     unsigned int bpop_blocked_clients; /* Number of clients blocked by lists */
     list *unblocked_clients; /* list of clients to unblock before next loop */
@@ -1274,6 +1319,11 @@ struct redisServer {
     /* Pubsub */
     dict *pubsub_channels;  /* Map channels to list of subscribed clients */
     list *pubsub_patterns;  /* A list of pubsub_patterns */
+    rax *pubsub_patterns_index; /* Literal prefix -> list of pubsub_patterns */
+    dict *shared_replies;   /* Reply sds referenced by many clients -> refcount */
+    int keyspace_listeners[2];  /* Channels and patterns that may receive
+                                   __keyspace@ ([0]) and __keyevent@ ([1])
+                                   notifications. */
     int notify_keyspace_events; /* Events to propagate via Pub/Sub. This is an
                                    xor of NOTIFY_... flags. */
     /* Cluster */
@@ -1288,11 +1338,15 @@ struct redisServer {
     char *cluster_announce_ip;  /* IP address to announce on cluster bus. */
     int cluster_announce_port;     /* base port to announce on cluster bus. */
     int cluster_announce_bus_port; /* bus port to announce on cluster bus. */
+    int executing_slot;         /* Hash slot of all the keys the command in
+                                   execution may write, or -1 if unknown. */
     /* Scripting */
     lua_State *lua; /* The Lua interpreter. We use just one for all clients */
     client *lua_client;   /* The "fake client" to query Redis from Lua */
     client *lua_caller;   /* The client running EVAL right now, or NULL */
     dict *lua_scripts;         /* A dictionary of SHA1 -> Lua scripts */
+    dict *lua_registry;        /* Binary SHA1 -> luaScript (compiled fn). */
+    dict *lua_bodies;          /* Script body -> luaScript, for EVAL. */
     mstime_t lua_time_limit;  /* Script timeout in milliseconds */
     mstime_t lua_time_start;  /* Start time of script, milliseconds time */
     int lua_write_dirty;  /* True if a write command was called during the
@@ -1329,9 +1383,19 @@ struct redisServer {
     pthread_mutex_t unixtime_mutex;
 };
 
+/* Kind of matcher a pattern is compiled to by pubsubCompilePattern(). The
+ * literal prefix of the pattern is always checked by the patterns index. */
+#define PUBSUB_PATTERN_EXACT 0          /* No glob chars at all. */
+#define PUBSUB_PATTERN_PREFIX 1         /* "prefix*" */
+#define PUBSUB_PATTERN_PREFIX_SUFFIX 2  /* "prefix*suffix" */
+#define PUBSUB_PATTERN_GENERIC 3        /* Anything else: stringmatchlen(). */
+
 struct pubsubPattern {
     client *client;
     robj *pattern;
+    int type;           /* PUBSUB_PATTERN_* matcher. */
+    size_t prefixlen;   /* Length of the literal prefix of the pattern. */
+    size_t suffixlen;   /* Length of the literal suffix (PREFIX_SUFFIX). */
 };
 
 typedef void redisCommandProc(client *c);
@@ -1350,6 +1414,7 @@ struct redisCommand {
     int lastkey;  /* The last argument that's a key */
     int keystep;  /* The step between first and last key */
     long long microseconds, calls;
+    uint64_t *latency_histogram; /* Calls duration histogram, see latency.h */
 };
 
 struct redisFunctionSym {
@@ -1469,6 +1534,7 @@ extern dictType hashDictType;
 extern dictType replScriptCacheDictType;
 extern dictType keyptrDictType;
 extern dictType modulesDictType;
+extern dictType sharedRepliesDictType;
 
 /*-----------------------------------------------------------------------------
  * Functions prototypes
@@ -1488,6 +1554,8 @@ void moduleBlockedClientPipeReadable(aeEventLoop *el, int fd, void *privdata, in
 size_t moduleCount();
 void moduleAcquireGIL();
 void moduleReleaseGIL();
+void moduleNotifyKeyspaceEvent(int type, const char *event, robj *key, int dbid);
+int moduleHasKeyspaceSubscribers(void);
 
 /* Utils */
 long long ustime();
@@ -1512,6 +1580,9 @@ void copyClientOutputBuffer(client *dst, client *src);
 size_t sdsZmallocSize(sds s);
 size_t getStringObjectSdsUsedMemory(robj *o);
 void *dupClientReplyValue(void *o);
+sds createSharedReply(sds s);
+int releaseSharedReply(sds s);
+int isSharedReply(sds s);
 void getClientsMaxBuffers(unsigned long *longest_output_list,
                           unsigned long *biggest_input_buffer);
 sds getAllClientsInfoString();
@@ -1600,6 +1671,8 @@ int getLongLongFromObject(robj *o, long long *target);
 int getLongDoubleFromObject(robj *o, long double *target);
 int getLongDoubleFromObjectOrReply(client *c, robj *o, long double *target, const char *msg);
 char *strEncoding(int encoding);
+#define OBJ_COMPUTE_SIZE_DEF_SAMPLES 5 /* Default sample size. */
+size_t objectComputeSize(robj *o, size_t sample_size);
 int compareStringObjects(robj *a, robj *b);
 int collateStringObjects(robj *a, robj *b);
 int equalStringObjects(robj *a, robj *b);
@@ -1651,6 +1724,7 @@ int rdbSaveRio(rio *rdb, int *error, int flags, rdbSaveInfo *rsi);
 /* AOF persistence */
 void flushAppendOnlyFile(int force);
 void feedAppendOnlyFile(struct redisCommand *cmd, int dictid, robj **argv, int argc);
+sds catAppendOnlyGenericCommand(sds dst, int argc, robj **argv);
 void aofRemoveTempFile(pid_t childpid);
 int rewriteAppendOnlyFileBackground();
 int loadAppendOnlyFile(char *filename);
@@ -1763,6 +1837,7 @@ unsigned int LRU_CLOCK();
 const char *evictPolicyToString();
 struct redisMemOverhead *getMemoryOverheadData();
 void freeMemoryOverheadData(struct redisMemOverhead *mh);
+void memoryPrefixCron(void);
 
 #define RESTART_SERVER_NONE 0
 #define RESTART_SERVER_GRACEFULLY (1<<0)     /* Do proper shutdown. */
@@ -1795,6 +1870,7 @@ unsigned long hashTypeLength(const robj *o);
 hashTypeIterator *hashTypeInitIterator(robj *subject);
 void hashTypeReleaseIterator(hashTypeIterator *hi);
 robj *hashTypeLookupWriteOrCreate(client *c, robj *key);
+int hashTypeGetValue(robj *o, sds field, unsigned char **vstr, unsigned int *vlen, long long *vll);
 robj *hashTypeGetValueObject(robj *o, sds field);
 int hashTypeSet(robj *o, sds field, sds value, int flags);
 
@@ -1805,6 +1881,8 @@ int pubsubPublishMessage(robj *channel, robj *message);
 
 /* Keyspace events notification */
 void notifyKeyspaceEvent(int type, const char *event, robj *key, int dbid);
+void notifyKeyspaceEventsInit();
+int keyspaceChannelPrefixMatch(const char *s, size_t len, int kind, int pattern);
 int keyspaceEventsStringToFlags(const char *classes);
 sds keyspaceEventsFlagsToString(int flags);
 
@@ -1861,6 +1939,47 @@ void emptyDbAsync(redisDb *db);
 void slotToKeyFlushAsync();
 size_t lazyfreeGetPendingObjectsCount();
 
+/* Hot keys tracking */
+#define HOTKEYS_DECAY_PERIOD 10 /* Seconds between counters halving. */
+void hotkeysSample(redisDb *db, robj *key);
+void hotkeysRelease(redisDb *db);
+void hotkeysDecay(void);
+sds genHotkeysInfoString(sds info);
+
+/* Exact memory accounting */
+#define MEMACCT_TYPES (OBJ_MODULE+1)
+#define MEMACCT_NONE -1     /* Segment not charged to any type. */
+#define MEMACCT_PENDING -2  /* Type of the key being created not known yet. */
+struct memAcctFrame {
+    int open;               /* False if accounting was not needed. */
+    int pinned;             /* Target set by memAcctPin(). */
+    client *c;              /* Client running a command in the frame. */
+    memAcctFrame *prev;     /* Enclosing frame. */
+    redisDb *db;            /* Target DB of the current segment, or NULL. */
+    int type;               /* Target type, MEMACCT_NONE or MEMACCT_PENDING. */
+    long long used;         /* Thread used memory at segment start. */
+    long long charged;      /* Memory charged by all the segments at start. */
+    long long tables;       /* Main hash tables size of 'db' at start. */
+};
+struct memAcctCounters *memAcctCreateCounters(void);
+void memAcctReleaseCounters(struct memAcctCounters *mc);
+struct memAcctCounters *memAcctRetainCounters(redisDb *db);
+void memAcctLazyfreed(struct memAcctCounters *mc, int type, long long bytes);
+void memAcctResetCounters(redisDb *db);
+void memAcctGetBytes(redisDb *db, long long *bytes);
+const char *memAcctTypeName(int type);
+void memAcctBegin(memAcctFrame *f, client *c);
+void memAcctBeginNested(memAcctFrame *f);
+void memAcctEnd(memAcctFrame *f);
+void memAcctTouch(redisDb *db, int type);
+void memAcctLookup(redisDb *db, int type);
+void memAcctPin(redisDb *db, int type);
+void memAcctDetach(void);
+void memAcctCharge(redisDb *db, int type, long long bytes);
+void memAcctForget(long long bytes);
+void memAcctStoreValue(redisDb *db, robj *val);
+sds genMemAcctInfoString(sds info);
+
 /* API to get key arguments from commands */
 int *getKeysFromCommand(struct redisCommand *cmd, robj **argv, int argc, int *numkeys);
 void getKeysFreeResult(int *result);
@@ -1878,6 +1997,11 @@ void clusterCron();
 void clusterPropagatePublish(robj *channel, robj *message);
 void migrateCloseTimedoutSockets();
 void clusterBeforeSleep();
+void clusterFeedSlotMigration(struct redisCommand *cmd, int dbid, robj **argv, int argc);
+void clusterSlotImportClientFreed(client *c);
+void clusterSlotImportCheckReplies(client *c);
+int clusterSlotImportAllowsCommand(client *c);
+int clusterSlotImportHasKey(sds key);
 
 /* Sentinel */
 void initSentinelConfig();
@@ -1897,6 +2021,14 @@ int ldbRemoveChild(pid_t pid);
 void ldbKillForkedSessions();
 int ldbPendingChildren();
 sds luaCreateFunction(client *c, lua_State *lua, robj *body);
+void luaResetScriptsStats(void);
+sds genLuaScriptsInfoString(sds info);
+void luaReplySinkProtocol(const char *p, size_t len);
+void luaReplySinkBulk(const char *p, size_t len);
+void luaReplySinkLongLong(long long ll);
+void luaReplySinkMultiBulkLen(long length);
+void *luaReplySinkDeferredLen(void);
+void luaReplySinkSetDeferredLen(void *node, long length);
 
 /* Blocked clients */
 void processUnblockedClients();
@@ -1952,6 +2084,8 @@ void decrCommand(client *c);
 void incrbyCommand(client *c);
 void decrbyCommand(client *c);
 void incrbyfloatCommand(client *c);
+void throttleCommand(client *c);
+void hotkeysCommand(client *c);
 void selectCommand(client *c);
 void swapdbCommand(client *c);
 void randomkeyCommand(client *c);
@@ -2122,6 +2256,8 @@ void bugReportStart();
 void serverLogObjectDebugInfo(const robj *o);
 void sigsegvHandler(int sig, siginfo_t *info, void *secret);
 sds genRedisInfoString(const char *section);
+sds genRedisInfoStringBySections(int sections);
+int getInfoSectionsByName(const char *name);
 void enableWatchdog(int period);
 void disableWatchdog();
 void watchdogScheduleSignal(int period);
@@ -45,7 +45,7 @@
 /* Create a new slowlog entry.
  * Incrementing the ref count of all the objects retained is up to
  * this function. */
-slowlogEntry *slowlogCreateEntry(client *c, robj **argv, int argc, long long duration) {
+slowlogEntry *slowlogCreateEntry(client *c, robj **argv, int argc, long long duration, slowlogPhases *phases) {
     slowlogEntry* se = (slowlogEntry*)zmalloc(sizeof(*se));
     int j, slargc = argc;
 
@@ -87,6 +87,7 @@ slowlogEntry *slowlogCreateEntry(client *c, robj **argv, int argc, long long dur
     }
     se->time = time(NULL);
     se->duration = duration;
+    se->phases = *phases;
     se->id = server.slowlog_entry_id++;
     se->peerid = sdsnew(c->getClientPeerId());
     se->cname = c->m_client_name ? sdsnew((const char *)c->m_client_name->ptr) : sdsempty();
@@ -114,17 +115,19 @@ void slowlogFreeEntry(void *septr) {
 void slowlogInit() {
     server.slowlog = listCreate();
     server.slowlog_entry_id = 0;
+    server.propagate_usec = 0;
+    server.notify_usec = 0;
     server.slowlog->listSetFreeMethod(slowlogFreeEntry);
 }
 
 /* Push a new entry into the slow log.
  * This function will make sure to trim the slow log accordingly to the
  * configured max length. */
-void slowlogPushEntryIfNeeded(client *c, robj **argv, int argc, long long duration) {
+void slowlogPushEntryIfNeeded(client *c, robj **argv, int argc, long long duration, slowlogPhases *phases) {
     if (server.slowlog_log_slower_than < 0) return; /* Slowlog disabled */
     if (duration >= server.slowlog_log_slower_than)
         server.slowlog->listAddNodeHead(
-                        slowlogCreateEntry(c,argv,argc,duration));
+                        slowlogCreateEntry(c,argv,argc,duration,phases));
 
     /* Remove old entries if needed. */
     while (server.slowlog->listLength() > server.slowlog_max_len)
@@ -163,7 +166,7 @@ void slowlogCommand(client *c) {
             int j;
 
             se = (slowlogEntry *)ln->listNodeValue();
-            c->addReplyMultiBulkLen(6);
+            c->addReplyMultiBulkLen(7);
             c->addReplyLongLong(se->id);
             c->addReplyLongLong(se->time);
             c->addReplyLongLong(se->duration);
@@ -172,6 +175,17 @@ void slowlogCommand(client *c) {
                 c->addReplyBulk(se->argv[j]);
             c->addReplyBulkCBuffer(se->peerid,sdslen(se->peerid));
             c->addReplyBulkCBuffer(se->cname,sdslen(se->cname));
+            c->addReplyMultiBulkLen(10);
+            c->addReplyBulkCString("execution-usec");
+            c->addReplyLongLong(se->phases.execution);
+            c->addReplyBulkCString("propagation-usec");
+            c->addReplyLongLong(se->phases.propagation);
+            c->addReplyBulkCString("notification-usec");
+            c->addReplyLongLong(se->phases.notification);
+            c->addReplyBulkCString("reply-bytes");
+            c->addReplyLongLong(se->phases.reply_bytes);
+            c->addReplyBulkCString("allocated-bytes");
+            c->addReplyLongLong(se->phases.allocated);
             sent++;
         }
         c->setDeferredMultiBulkLength(totentries,sent);
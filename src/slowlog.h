@@ -30,6 +30,15 @@
 #define SLOWLOG_ENTRY_MAX_ARGC 32
 #define SLOWLOG_ENTRY_MAX_STRING 128
 
+/* Where the time of a logged command went, see call(). */
+struct slowlogPhases {
+    long long execution;    /* Command execution, minus the time below. */
+    long long propagation;  /* Propagation to AOF and replicas. */
+    long long notification; /* Keyspace events dispatch. */
+    long long reply_bytes;  /* Bytes of reply produced. */
+    long long allocated;    /* Net memory allocated, may be negative. */
+};
+
 /* This structure defines an entry inside the slow log list */
 struct slowlogEntry {
 
@@ -40,11 +49,12 @@ struct slowlogEntry {
     time_t time;        /* Unix time at which the query was executed. */
     sds cname;          /* Client name. */
     sds peerid;         /* Client network address. */
+    slowlogPhases phases; /* Breakdown of the duration. */
 };
 
 /* Exported API */
 void slowlogInit();
-void slowlogPushEntryIfNeeded(client *c, robj **argv, int argc, long long duration);
+void slowlogPushEntryIfNeeded(client *c, robj **argv, int argc, long long duration, slowlogPhases *phases);
 
 /* Exported commands */
 void slowlogCommand(client *c);
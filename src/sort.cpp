@@ -197,6 +197,10 @@ void sortCommand(client *c) {
     robj *sortval, *sortby = NULL, *storekey = NULL;
     redisSortObject *vector; /* Resulting vector to sort */
 
+    /* The only value we may keep is the stored list: don't charge the sorted
+     * key and the BY / GET keys for what we allocate. */
+    memAcctPin(c->m_cur_selected_db,OBJ_LIST);
+
     /* Lookup the key to sort. It must be of the right types */
     sortval = lookupKeyRead(c->m_cur_selected_db,c->m_argv[1]);
     if (sortval && sortval->type != OBJ_SET &&
@@ -825,6 +825,7 @@ void handleClientsBlockedOnLists() {
         while(l->listLength() != 0) {
             listNode *ln = l->listFirst();
             readyList *rl = (readyList *)ln->listNodeValue();
+            memAcctFrame maf;
 
             /* First of all remove this key from db->m_ready_keys so that
              * we can safely call signalListAsReady() against this key. */
@@ -832,6 +833,7 @@ void handleClientsBlockedOnLists() {
 
             /* If the key exists and it's a list, serve blocked clients
              * with data. */
+            memAcctBegin(&maf,NULL);
             robj *o = lookupKeyWrite(rl->db,rl->key);
             if (o != NULL && o->type == OBJ_LIST) {
                 dictEntry *de;
@@ -857,7 +859,10 @@ void handleClientsBlockedOnLists() {
                              * freed by the next unblockClient()
                              * call. */
                             if (dstkey) incrRefCount(dstkey);
+                            memAcctFrame maf_unblock;
+                            memAcctBeginNested(&maf_unblock);
                             receiver->unblockClient();
+                            memAcctEnd(&maf_unblock);
 
                             if (serveClientBlockedOnList(receiver,
                                 rl->key,dstkey,rl->db,value,
@@ -882,6 +887,7 @@ void handleClientsBlockedOnLists() {
                 /* We don't call signalModifiedKey() as it was already called
                  * when an element was pushed on the list. */
             }
+            memAcctEnd(&maf);
 
             /* Free this item. */
             decrRefCount(rl->key);
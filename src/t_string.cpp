@@ -471,3 +471,119 @@ void strlenCommand(client *c) {
         checkType(c,o,OBJ_STRING)) return;
     c->addReplyLongLong(stringObjectLen(o));
 }
+
+/* THROTTLE key max_burst count period [quantity]
+ *
+ * Rate limiting using the GCRA (generic cell rate algorithm): at most
+ * 'count' actions every 'period' seconds are allowed, with bursts of up to
+ * 'max_burst' actions more. Every call performs 'quantity' actions (1 by
+ * default) if the limit permits it.
+ *
+ * The key holds the "theoretical arrival time" (TAT) in microseconds, and
+ * expires when the limiter gets back to its initial state.
+ *
+ * The reply is an array of five integers:
+ *
+ *   1) 1 if the actions are allowed, 0 if they are limited.
+ *   2) The limit, that is, max_burst + 1.
+ *   3) The number of actions remaining.
+ *   4) Milliseconds after which the caller should retry, -1 if allowed.
+ *   5) Milliseconds after which the limiter will be reset to the initial
+ *      state, that is, 'remaining' will be equal to the limit.
+ *
+ * The command is always propagated as a SET of the new TAT followed by
+ * a PEXPIREAT, since the outcome depends on the current time. */
+void throttleCommand(client *c) {
+    long long burst, count, period, quantity = 1;
+    long long now, tat, newtat, interval, tolerance, increment, diff;
+    long long ttl, remaining, retry = -1;
+    robj *o;
+
+    if (c->m_argc > 6) {
+        c->addReply(shared.syntaxerr);
+        return;
+    }
+    if (getLongLongFromObjectOrReply(c,c->m_argv[2],&burst,NULL) != C_OK ||
+        getLongLongFromObjectOrReply(c,c->m_argv[3],&count,NULL) != C_OK ||
+        getLongLongFromObjectOrReply(c,c->m_argv[4],&period,NULL) != C_OK ||
+        (c->m_argc == 6 &&
+         getLongLongFromObjectOrReply(c,c->m_argv[5],&quantity,NULL) != C_OK))
+        return;
+    if (burst < 0 || count <= 0 || period <= 0 || quantity < 0 ||
+        period > LLONG_MAX/1000000 || burst >= LLONG_MAX/(period*1000000))
+    {
+        c->addReplyError("invalid rate limit parameters");
+        return;
+    }
+
+    o = lookupKeyWrite(c->m_cur_selected_db,c->m_argv[1]);
+    if (o != NULL && checkType(c,o,OBJ_STRING)) return;
+    now = ustime();
+    if (o == NULL) {
+        tat = now;
+    } else if (getLongLongFromObjectOrReply(c,o,&tat,NULL) != C_OK) {
+        return;
+    }
+    if (tat < now) tat = now;
+
+    /* The emission interval is the time every action costs, the tolerance
+     * how far in the future the TAT can be pushed. */
+    interval = (period*1000000)/count;
+    if (interval == 0) interval = 1;
+    tolerance = interval*(burst+1);
+
+    /* The key may have been set to any value by the user: refuse a TAT
+     * that would overflow the computations below. */
+    if (tolerance > LLONG_MAX-1000 || tat > LLONG_MAX-1000-tolerance) {
+        c->addReplyError("rate limit state out of range");
+        return;
+    }
+    increment = (quantity > tolerance/interval) ? tolerance+1 :
+                                                  interval*quantity;
+
+    newtat = tat + increment;
+    diff = now - (newtat - tolerance);
+    if (diff < 0) {
+        /* Limited. The caller can retry when enough time passed, unless
+         * the quantity requested exceeds the limit itself. */
+        if (increment <= tolerance) retry = -diff;
+        ttl = tat - now;
+    } else {
+        robj *val, *when;
+
+        ttl = newtat - now;
+        val = createStringObjectFromLongLong(newtat);
+        when = createStringObjectFromLongLong((newtat+999)/1000);
+        setKey(c->m_cur_selected_db,c->m_argv[1],val);
+        setExpire(c,c->m_cur_selected_db,c->m_argv[1],(newtat+999)/1000);
+        notifyKeyspaceEvent(NOTIFY_STRING,"set",c->m_argv[1],
+                            c->m_cur_selected_db->m_id);
+        notifyKeyspaceEvent(NOTIFY_GENERIC,"expire",c->m_argv[1],
+                            c->m_cur_selected_db->m_id);
+        server.dirty++;
+
+        /* Propagate as SET <tat> + PEXPIREAT <tat in ms>. */
+        robj *aux = createStringObject("SET",3);
+        c->rewriteClientCommandVector(3,aux,c->m_argv[1],val);
+        decrRefCount(aux);
+        robj *propargv[3];
+        propargv[0] = createStringObject("PEXPIREAT",9);
+        propargv[1] = c->m_argv[1];
+        propargv[2] = when;
+        alsoPropagate(server.pexpireatCommand,c->m_cur_selected_db->m_id,
+                      propargv,3,PROPAGATE_AOF|PROPAGATE_REPL);
+        decrRefCount(propargv[0]);
+        decrRefCount(when);
+        decrRefCount(val);
+    }
+
+    remaining = (tolerance - ttl) / interval;
+    if (remaining < 0) remaining = 0;
+
+    c->addReplyMultiBulkLen(5);
+    c->addReply(diff < 0 ? shared.czero : shared.cone);
+    c->addReplyLongLong(burst+1);
+    c->addReplyLongLong(remaining);
+    c->addReplyLongLong(retry == -1 ? -1 : (retry+999)/1000);
+    c->addReplyLongLong((ttl+999)/1000);
+}
@@ -2198,6 +2198,9 @@ void zunionInterGenericCommand(client *c, robj *dstkey, int op) {
         return;
     }
 
+    /* The sources may be sets: charge what we allocate to the result. */
+    memAcctPin(c->m_cur_selected_db,OBJ_ZSET);
+
     /* read keys to be used for input */
     src = (zsetopsrc *)zcalloc(sizeof(zsetopsrc) * setnum);
     for (i = 0, j = 3; i < setnum; i++, j++) {
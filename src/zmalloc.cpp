@@ -43,7 +43,6 @@ void zlibc_free(void *ptr) {
 #include <pthread.h>
 #include "config.h"
 #include "zmalloc.h"
-#include "atomicvar.h"
 
 #ifdef HAVE_MALLOC_SIZE
 #define PREFIX_SIZE (0)
@@ -70,21 +69,107 @@ void zlibc_free(void *ptr) {
 #define dallocx(ptr,flags) je_dallocx(ptr,flags)
 #endif
 
+/* The usable size of an allocation of 'size' bytes at 'ptr'. With jemalloc
+ * we compute it from the size class, that is much cheaper than a lookup of
+ * the allocation metadata, and returns the same value. nallocx() is
+ * undefined for a zero size, while malloc(0) allocates the smallest size
+ * class, that is the one of a single byte. */
+#if defined(USE_JEMALLOC)
+#define zmalloc_size_class(size) ((size) ? (size) : 1)
+#define zmalloc_usable_size(ptr,size) je_nallocx(zmalloc_size_class(size),0)
+#else
+#define zmalloc_usable_size(ptr,size) zmalloc_size(ptr)
+#endif
+
+/* Used memory is tracked with a counter per thread: every thread updates
+ * only its own counter, so allocations don't need atomic read-modify-write
+ * operations on a cache line shared by all the threads. The counters are
+ * summed by zmalloc_used_memory(). A thread registers its counter the first
+ * time it allocates or frees memory, and the counter is folded into
+ * 'exited_threads_used' when the thread exits.
+ *
+ * The counter of a thread is negative when it released more memory than it
+ * allocated, like the lazy free thread does. */
+typedef struct zmallocThreadStat {
+    long long used;  /* Memory allocated minus memory freed by the thread. */
+    int registered;  /* 0 = not yet, 1 = registered, -1 = thread exited. */
+    struct zmallocThreadStat *prev, *next;
+} zmallocThreadStat;
+
+static __thread zmallocThreadStat thread_stat;
+static zmallocThreadStat *thread_stats = NULL; /* Registered threads. */
+static long long exited_threads_used = 0;
+static pthread_key_t thread_stat_key;
+static pthread_once_t thread_stat_key_once = PTHREAD_ONCE_INIT;
+pthread_mutex_t used_memory_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Only the owner thread writes its counter, but other threads read it. */
+#if defined(__ATOMIC_RELAXED)
+#define thread_stat_get(var) __atomic_load_n(&(var),__ATOMIC_RELAXED)
+#define thread_stat_set(var,value) __atomic_store_n(&(var),(value),__ATOMIC_RELAXED)
+#else
+#define thread_stat_get(var) (*(volatile long long*)&(var))
+#define thread_stat_set(var,value) ((var) = (value))
+#endif
+
+static void zmalloc_unregister_thread(void *privdata) {
+    zmallocThreadStat *ts = (zmallocThreadStat*)privdata;
+
+    pthread_mutex_lock(&used_memory_mutex);
+    exited_threads_used += ts->used;
+    if (ts->prev) ts->prev->next = ts->next;
+    else thread_stats = ts->next;
+    if (ts->next) ts->next->prev = ts->prev;
+    pthread_mutex_unlock(&used_memory_mutex);
+    /* Memory released by the thread from now on is not accounted: we
+     * can't register again, the thread local storage is going away. */
+    ts->used = 0;
+    ts->registered = -1;
+}
+
+static void zmalloc_lock_thread_stats(void) {
+    pthread_mutex_lock(&used_memory_mutex);
+}
+
+static void zmalloc_unlock_thread_stats(void) {
+    pthread_mutex_unlock(&used_memory_mutex);
+}
+
+static void zmalloc_create_thread_stat_key(void) {
+    pthread_key_create(&thread_stat_key,zmalloc_unregister_thread);
+    /* The child of a fork (that calls zmalloc_used_memory() while saving)
+     * must not inherit the mutex locked by another thread. */
+    pthread_atfork(zmalloc_lock_thread_stats,zmalloc_unlock_thread_stats,
+                   zmalloc_unlock_thread_stats);
+}
+
+static void zmalloc_register_thread(void) {
+    pthread_once(&thread_stat_key_once,zmalloc_create_thread_stat_key);
+    pthread_mutex_lock(&used_memory_mutex);
+    thread_stat.prev = NULL;
+    thread_stat.next = thread_stats;
+    if (thread_stats) thread_stats->prev = &thread_stat;
+    thread_stats = &thread_stat;
+    thread_stat.registered = 1;
+    pthread_mutex_unlock(&used_memory_mutex);
+    /* Just to get zmalloc_unregister_thread() called at thread exit. */
+    pthread_setspecific(thread_stat_key,&thread_stat);
+}
+
 #define update_zmalloc_stat_alloc(__n) do { \
     size_t _n = (__n); \
     if (_n&(sizeof(long)-1)) _n += sizeof(long)-(_n&(sizeof(long)-1)); \
-    atomicIncr(used_memory,__n); \
+    if (thread_stat.registered == 0) zmalloc_register_thread(); \
+    thread_stat_set(thread_stat.used,thread_stat.used+(long long)_n); \
 } while(0)
 
 #define update_zmalloc_stat_free(__n) do { \
     size_t _n = (__n); \
     if (_n&(sizeof(long)-1)) _n += sizeof(long)-(_n&(sizeof(long)-1)); \
-    atomicDecr(used_memory,__n); \
+    if (thread_stat.registered == 0) zmalloc_register_thread(); \
+    thread_stat_set(thread_stat.used,thread_stat.used-(long long)_n); \
 } while(0)
 
-static size_t used_memory = 0;
-pthread_mutex_t used_memory_mutex = PTHREAD_MUTEX_INITIALIZER;
-
 static void zmalloc_default_oom(size_t size) {
     fprintf(stderr, "zmalloc: Out of memory trying to allocate %zu bytes\n",
         size);
@@ -99,7 +184,7 @@ void *zmalloc(size_t size) {
 
     if (!ptr) zmalloc_oom_handler(size);
 #ifdef HAVE_MALLOC_SIZE
-    update_zmalloc_stat_alloc(zmalloc_size(ptr));
+    update_zmalloc_stat_alloc(zmalloc_usable_size(ptr,size));
     return ptr;
 #else
     *((size_t*)ptr) = size;
@@ -115,7 +200,7 @@ void *zmalloc(size_t size) {
 void *zmalloc_no_tcache(size_t size) {
     void *ptr = mallocx(size+PREFIX_SIZE, MALLOCX_TCACHE_NONE);
     if (!ptr) zmalloc_oom_handler(size);
-    update_zmalloc_stat_alloc(zmalloc_size(ptr));
+    update_zmalloc_stat_alloc(zmalloc_usable_size(ptr,size));
     return ptr;
 }
 
@@ -131,7 +216,7 @@ void *zcalloc(size_t size) {
 
     if (!ptr) zmalloc_oom_handler(size);
 #ifdef HAVE_MALLOC_SIZE
-    update_zmalloc_stat_alloc(zmalloc_size(ptr));
+    update_zmalloc_stat_alloc(zmalloc_usable_size(ptr,size));
     return ptr;
 #else
     *((size_t*)ptr) = size;
@@ -154,7 +239,7 @@ void *zrealloc(void *ptr, size_t size) {
     if (!newptr) zmalloc_oom_handler(size);
 
     update_zmalloc_stat_free(oldsize);
-    update_zmalloc_stat_alloc(zmalloc_size(newptr));
+    update_zmalloc_stat_alloc(zmalloc_usable_size(newptr,size));
     return newptr;
 #else
     realptr = (char*)ptr-PREFIX_SIZE;
@@ -201,6 +286,22 @@ void zfree(void *ptr) {
 #endif
 }
 
+/* Like zfree() but for callers that know the size of the allocation: it
+ * must be the size originally requested, or a size between it and the one
+ * returned by zmalloc_size(). With jemalloc this saves the lookup of the
+ * allocation size both for the stats and for the free itself. */
+void zfree_with_size(void *ptr, size_t size) {
+#if defined(USE_JEMALLOC)
+    if (ptr == NULL) return;
+    size = zmalloc_size_class(size);
+    update_zmalloc_stat_free(je_nallocx(size,0));
+    je_sdallocx(ptr,size,0);
+#else
+    ((void) size);
+    zfree(ptr);
+#endif
+}
+
 char *zstrdup(const char *s) {
     size_t l = strlen(s)+1;
     char *p = (char *)zmalloc(l);
@@ -210,9 +311,19 @@ char *zstrdup(const char *s) {
 }
 
 size_t zmalloc_used_memory() {
-    size_t um;
-    atomicGet(used_memory,um);
-    return um;
+    zmallocThreadStat *ts;
+    long long um;
+
+    pthread_mutex_lock(&used_memory_mutex);
+    um = exited_threads_used;
+    for (ts = thread_stats; ts; ts = ts->next) um += thread_stat_get(ts->used);
+    pthread_mutex_unlock(&used_memory_mutex);
+    return um > 0 ? (size_t)um : 0;
+}
+
+/* Memory allocated minus memory freed by the calling thread. */
+long long zmalloc_thread_used_memory() {
+    return thread_stat.used;
 }
 
 void zmalloc_set_oom_handler(void (*oom_handler)(size_t)) {
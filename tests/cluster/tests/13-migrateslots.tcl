@@ -0,0 +1,163 @@
+# Test atomic slots migration with CLUSTER MIGRATESLOTS.
+
+source "../tests/includes/init-tests.tcl"
+
+test "Create a 5 nodes cluster" {
+    create_cluster 5 5
+}
+
+test "Cluster is up" {
+    assert_cluster_state ok
+}
+
+# Return the ID of the master serving the slot of the specified key.
+proc key_owner {key} {
+    for {set j 0} {$j < 5} {incr j} {
+        if {![catch {R $j exists $key}]} {return $j}
+    }
+    fail "No master is serving $key"
+}
+
+set slot [R 0 cluster keyslot {mig}]
+set src [key_owner {mig}]
+set dst [expr {($src+1)%5}]
+set dst_id [dict get [get_myself $dst] id]
+
+test "Populate the slot to migrate" {
+    for {set j 0} {$j < 1000} {incr j} {
+        R $src set "{mig}:$j" $j
+    }
+    R $src rpush {mig}:list a b c
+    R $src pexpire {mig}:list 100000
+    assert {[R $src cluster countkeysinslot $slot] == 1001}
+}
+
+test "MIGRATESLOTS rejects slots not served by this node" {
+    set other [expr {($src+2)%5}]
+    catch {R $other cluster migrateslots $dst_id $slot $slot} e
+    assert_match {*not the owner*} $e
+}
+
+test "Slot is migrated while receiving writes" {
+    R $src cluster migrateslots $dst_id $slot $slot
+    # Writes against the slot keep being served by the source while the
+    # migration is in progress.
+    set written 0
+    while {![catch {R $src lpush {mig}:list $written}]} {
+        incr written
+    }
+    wait_for_condition 1000 50 {
+        [key_owner {mig}] == $dst
+    } else {
+        fail "Slot was not migrated"
+    }
+    assert {[R $src cluster countkeysinslot $slot] == 0}
+    assert {[R $dst get {mig}:999] == 999}
+    assert {[R $dst llen {mig}:list] == [expr {$written+3}]}
+    assert {[R $dst pttl {mig}:list] > 0}
+}
+
+test "Cluster agrees about the new slot owner" {
+    assert_cluster_state ok
+    for {set j 0} {$j < 5} {incr j} {
+        wait_for_condition 1000 50 {
+            [catch {R $j get {mig}:1} e] == 0 || [string match "*MOVED $slot *:[get_instance_attrib redis $dst port]" $e]
+        } else {
+            fail "Node #$j has a stale view of slot $slot"
+        }
+    }
+}
+
+set src_id [dict get [get_myself $src] id]
+
+test "IMPORTSLOTS rejects keys outside the imported slots" {
+    set r [redis 127.0.0.1 [get_instance_attrib redis $src port] 1]
+    $r cluster importslots $dst_id $slot $slot
+    assert_equal OK [$r read]
+    # Replies are not sent during the import, but the failure is reported
+    # by FINISH.
+    assert {[R $src cluster keyslot foo] != $slot}
+    $r set foo x
+    $r set {mig}:inside x
+    $r cluster importslots finish 1
+    catch {$r read} e
+    assert_match {*1 failed commands*} $e
+    $r close
+    assert {[R $src cluster countkeysinslot $slot] == 0}
+    assert {[key_owner {mig}] == $dst}
+}
+
+test "Migration is aborted if the target fails to apply the writes" {
+    # With maxmemory reached every RESTORE is refused with -OOM.
+    R $src config set maxmemory 1
+    R $dst cluster migrateslots $src_id $slot $slot
+    wait_for_condition 1000 50 {
+        [R $dst cluster migrateslots status] eq {}
+    } else {
+        fail "Migration still in progress"
+    }
+    R $src config set maxmemory 0
+    assert {[key_owner {mig}] == $dst}
+    assert {[R $src cluster countkeysinslot $slot] == 0}
+    assert {[R $dst get {mig}:999] == 999}
+}
+
+test "Slot stays blocked until the target answers the final step" {
+    R $dst cluster migrateslots $src_id $slot $slot 500
+    # The target doesn't process FINISH in time, so the source can't know
+    # if it took the slot: writes are refused instead of being lost.
+    set r [redis 127.0.0.1 [get_instance_attrib redis $src port] 1]
+    $r debug sleep 2
+    wait_for_condition 1000 50 {
+        [dict get [R $dst cluster migrateslots status] state] eq "handoff-unknown"
+    } else {
+        fail "Final step not blocked"
+    }
+    catch {R $dst set {mig}:0 lost} e
+    assert_match {*TRYAGAIN*} $e
+    assert_error {*can't be aborted*} {R $dst cluster migrateslots abort}
+    $r read
+    $r close
+    wait_for_condition 1000 50 {
+        [R $dst cluster migrateslots status] eq {}
+    } else {
+        fail "Migration still in progress"
+    }
+    assert {[key_owner {mig}] == $src}
+    assert {[R $src get {mig}:0] == 0}
+    assert {[R $dst cluster countkeysinslot $slot] == 0}
+}
+
+test "Import in progress is discarded when the target restarts" {
+    set r [redis 127.0.0.1 [get_instance_attrib redis $dst port] 1]
+    $r cluster importslots $src_id $slot $slot
+    assert_equal OK [$r read]
+    $r set {mig}:partial x
+    wait_for_condition 1000 50 {
+        [R $dst cluster countkeysinslot $slot] == 1
+    } else {
+        fail "Partial import not applied"
+    }
+    # Closing the link would abort the import, the target must crash
+    # with it still in progress. Its slave must not take over meanwhile.
+    set_cluster_node_timeout 60000
+    kill_instance redis $dst
+    $r close
+    restart_instance redis $dst
+    set_cluster_node_timeout 3000
+    assert {[R $dst cluster countkeysinslot $slot] == 0}
+    assert {![string match "*\\\[$slot-<-*" [R $dst cluster nodes]]}
+    assert_cluster_state ok
+    assert {[key_owner {mig}] == $src}
+}
+
+test "Slot can be migrated again after the restart" {
+    R $src cluster migrateslots $dst_id $slot $slot
+    wait_for_condition 1000 50 {
+        [key_owner {mig}] == $dst
+    } else {
+        fail "Slot was not migrated"
+    }
+    assert {[R $dst get {mig}:999] == 999}
+    assert {[R $src cluster countkeysinslot $slot] == 0}
+}
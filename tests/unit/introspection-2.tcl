@@ -20,4 +20,32 @@ start_server {tags {"introspection"}} {
         r set key2 2
         r touch key0 key1 key2 key3
     } 2
+
+    test {HOTKEYS reports the most accessed keys} {
+        r flushdb
+        r hotkeys reset
+        r config set hotkeys-sample-ratio 1
+        for {set j 0} {$j < 20} {incr j} {
+            r set key$j $j
+        }
+        r set hotkey1 a
+        r set hotkey2 b
+        for {set j 0} {$j < 500} {incr j} {
+            r get hotkey1
+            r get hotkey2
+            r get hotkey2
+        }
+        set reply [r hotkeys count 2]
+        assert_equal [lindex $reply 0] hotkey2
+        assert_equal [lindex $reply 2] hotkey1
+        assert {[lindex $reply 1] > [lindex $reply 3]}
+        assert_match {*db9:tracked=*,hottest="hotkey2"*} [r info hotkeys]
+    }
+
+    test {HOTKEYS RESET clears the tracked keys} {
+        r hotkeys reset
+        r config set hotkeys-sample-ratio 0
+        r get hotkey2
+        r hotkeys
+    } {}
 }
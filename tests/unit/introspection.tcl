@@ -3,6 +3,46 @@ start_server {tags {"introspection"}} {
         r client list
     } {*addr=*:* fd=* age=* idle=* flags=N db=9 sub=0 psub=0 multi=-1 qbuf=0 qbuf-free=* obl=0 oll=0 omem=0 events=r cmd=client*}
 
+    test {CLIENT LIST reports the per client totals} {
+        r client list
+    } {*cmd=client tot-cmds=* tot-usec=* tot-net-in=* tot-net-out=*}
+
+    test {INFO can select multiple sections} {
+        set info [r info clients keyspace]
+        assert_match "*# Clients*# Keyspace*" $info
+        assert {![string match "*# Server*" $info]}
+        # Sections can be selected as a bitmask too: 2 is clients.
+        set info [r info 2]
+        assert_match "# Clients*" $info
+        assert {![string match "*# Memory*" $info]}
+    }
+
+    test {INFO MAP replies with field names and values} {
+        set fields [r info map memory stats]
+        assert {[dict get $fields used_memory] > 0}
+        assert {[dict exists $fields total_commands_processed]}
+        assert {![dict exists $fields used_memory_human]}
+        assert {![dict exists $fields redis_version]}
+    }
+
+    test {CLIENT TOP sorts the clients by the specified metric} {
+        set rd [redis_deferring_client]
+        $rd client setname busy
+        $rd read
+        for {set j 0} {$j < 100} {incr j} {
+            $rd set foo bar
+        }
+        for {set j 0} {$j < 100} {incr j} {
+            $rd read
+        }
+        set top [r client top cmds count 1]
+        assert_equal 1 [llength [split [string trim $top] "\n"]]
+        assert_match {*name=busy*tot-cmds=101 *} $top
+        assert_match {*name=busy*} [r client top net-in count 1]
+        assert_error {*syntax*} {r client top foo}
+        $rd close
+    }
+
     test {MONITOR can log executed commands} {
         set rd [redis_deferring_client]
         $rd monitor
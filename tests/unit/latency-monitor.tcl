@@ -48,6 +48,54 @@ start_server {tags {"latency-monitor"}} {
         assert {[r latency latest] eq {}}
     }
 
+    test {LATENCY HISTOGRAM reports per command buckets} {
+        r config resetstat
+        for {set j 0} {$j < 100} {incr j} {
+            r set foo $j
+        }
+        set reply [r latency histogram set]
+        assert_equal [lindex $reply 0] set
+        set hist [lindex $reply 1]
+        assert_equal [lindex $hist 1] 100
+        set total 0
+        foreach {maxusec count} [lindex $hist 3] {
+            incr total $count
+        }
+        assert_equal $total 100
+    }
+
+    test {LATENCY HISTOGRAM ignores unknown and never called commands} {
+        assert_equal [llength [r latency histogram blabla]] 0
+        set reply [r latency histogram lpush]
+        assert_equal [lindex $reply 1] {calls 0 histogram_usec {}}
+    }
+
+    test {INFO latencystats reports percentiles} {
+        set info [r info latencystats]
+        assert_match {*latency_percentiles_usec_set:p50=*,p99=*,p99.9=*} $info
+        r config resetstat
+        assert {![string match {*latency_percentiles_usec_set*} [r info latencystats]]}
+        assert_equal [llength [r latency histogram set]] 2
+    }
+
+    test {LATENCY PHASES reports the event loop phases} {
+        r ping
+        set phases [r latency phases]
+        assert_equal [llength $phases] 16
+        foreach {name stats} $phases {
+            assert_equal [lindex $stats 0] calls
+            assert_equal [lindex $stats 8] histogram_usec
+        }
+        set stats [dict get $phases file_events]
+        assert {[dict get $stats calls] > 0}
+    }
+
+    test {INFO eventloop reports phases statistics} {
+        set info [r info eventloop]
+        assert_match {*eventloop_phase_poll:calls=*} $info
+        assert_match {*eventloop_phase_pending_writes:calls=*,p99.9=*} $info
+    }
+
     test {LATENCY of expire events are correctly collected} {
         r config set latency-monitor-threshold 20
         r eval {
@@ -36,6 +36,117 @@ start_server {tags {"memefficiency"}} {
     }
 }
 
+start_server {tags {"memefficiency"}} {
+    test "MEMORY PREFIXES aggregates memory by key prefix and type" {
+        r flushall
+        for {set j 0} {$j < 200} {incr j} {
+            r set user:$j [string repeat A 100]
+        }
+        for {set j 0} {$j < 10} {incr j} {
+            r hset session:$j field value
+        }
+        r set nodelimiter foo
+        r memory prefixes start
+        wait_for_condition 50 100 {
+            [dict get [r memory prefixes] status] eq {done}
+        } else {
+            fail "MEMORY PREFIXES scan did not complete"
+        }
+        set reply [r memory prefixes]
+        assert_equal 211 [dict get $reply keys]
+        assert_equal 3 [dict get $reply prefixes-count]
+        set prefixes [dict get $reply prefixes]
+        assert_equal {user: 200} [lrange [lindex $prefixes 0] 0 1]
+        assert_equal {session: 10} [lrange [lindex $prefixes 1] 0 1]
+        assert_equal {{} 1} [lrange [lindex $prefixes 2] 0 1]
+        assert {[lindex $prefixes 0 2] > 200*100}
+        set types [dict get $reply types]
+        assert_equal {hash ziplist 10} [lrange [lindex $types end] 0 2]
+    }
+
+    test "MEMORY PREFIXES COUNT and delimiters" {
+        r config set memory-prefix-delimiters ":."
+        r set a.b foo
+        r memory prefixes start
+        wait_for_condition 50 100 {
+            [dict get [r memory prefixes] status] eq {done}
+        } else {
+            fail "MEMORY PREFIXES scan did not complete"
+        }
+        set reply [r memory prefixes count 1]
+        assert_equal ":." [dict get $reply delimiters]
+        assert_equal 4 [dict get $reply prefixes-count]
+        assert_equal 1 [llength [dict get $reply prefixes]]
+        r config set memory-prefix-delimiters ":"
+    }
+}
+
+start_server {tags {"memefficiency"} overrides {memory-accounting yes}} {
+    test "Memory accounting charges the dataset by type and database" {
+        r flushall
+        assert_equal 1 [s memory_accounting]
+        for {set j 0} {$j < 100} {incr j} {
+            r set string:$j [string repeat A 200]
+            r hset hash:$j field [string repeat B 200]
+            r rpush list:$j a b c
+        }
+        r select 10
+        r sadd set x y z
+        assert {[s used_memory_dataset_string] > 100*200}
+        assert {[s used_memory_dataset_hash] > 100*200}
+        assert {[s used_memory_dataset_list] > 0}
+        assert {[s used_memory_dataset_set] > 0}
+        assert_match {*string=0,*set=*} [s used_memory_dataset_db10]
+        set stats [r memory stats]
+        assert {[dict get $stats db.9 dataset.string] > 100*200}
+        r select 9
+    }
+
+    test "Memory accounting returns to zero when keys are deleted" {
+        r flushall
+        for {set j 0} {$j < 100} {incr j} {
+            r set string:$j [string repeat A 200]
+            r append string:$j foo
+            r hset hash:$j field [string repeat B 200]
+            r incr counter:$j
+        }
+        for {set j 0} {$j < 100} {incr j} {
+            r del string:$j hash:$j counter:$j
+        }
+        assert {abs([s used_memory_dataset_string]) < 1024}
+        assert {abs([s used_memory_dataset_hash]) < 1024}
+    }
+
+    test "Memory accounting charges cross-type STORE results to their type" {
+        r flushall
+        for {set j 0} {$j < 200} {incr j} {
+            r sadd myset [string repeat x 50]:$j
+            r set weight_[string repeat x 50]:$j $j
+            r hset obj_[string repeat x 50]:$j name $j
+        }
+        set set_mem [s used_memory_dataset_set]
+        set string_mem [s used_memory_dataset_string]
+        set hash_mem [s used_memory_dataset_hash]
+
+        r zunionstore dstzset 1 myset
+        r zinterstore dstzset2 2 myset dstzset
+        r sort myset by weight_* get # get obj_*->name store dstlist
+        r set dststring foo
+        r sort myset alpha store dststring
+        assert {[s used_memory_dataset_zset] > 2*200*50}
+        assert {[s used_memory_dataset_list] > 2*200*50}
+        assert {abs([s used_memory_dataset_set]-$set_mem) < 1024}
+        assert {abs([s used_memory_dataset_string]-$string_mem) < 1024}
+        assert {abs([s used_memory_dataset_hash]-$hash_mem) < 1024}
+
+        r del dstzset dstzset2 dstlist dststring
+        assert {abs([s used_memory_dataset_zset]) < 1024}
+        assert {abs([s used_memory_dataset_list]) < 1024}
+        assert {abs([s used_memory_dataset_set]-$set_mem) < 1024}
+        assert {abs([s used_memory_dataset_string]-$string_mem) < 1024}
+    }
+}
+
 if 0 {
     start_server {tags {"defrag"}} {
         if {[string match {*jemalloc*} [s mem_allocator]]} {
@@ -176,6 +176,79 @@ start_server {tags {"pubsub"}} {
         $rd2 close
     }
 
+    test "PUBLISH/PSUBSCRIBE with different pattern forms" {
+        set rd1 [redis_deferring_client]
+        assert_equal {1 2 3 4} [psubscribe $rd1 {exact a.*.z a?c *}]
+        assert_equal 2 [r publish exact hello]
+        assert_equal {pmessage * exact hello} [$rd1 read]
+        assert_equal {pmessage exact exact hello} [$rd1 read]
+        assert_equal 1 [r publish exactly hello]
+        assert_equal {pmessage * exactly hello} [$rd1 read]
+        assert_equal 2 [r publish a.foo.z hello]
+        assert_equal {pmessage * a.foo.z hello} [$rd1 read]
+        assert_equal {pmessage a.*.z a.foo.z hello} [$rd1 read]
+        assert_equal 1 [r publish a.z hello]
+        assert_equal {pmessage * a.z hello} [$rd1 read]
+        assert_equal 2 [r publish abc hello]
+        assert_equal {pmessage * abc hello} [$rd1 read]
+        assert_equal {pmessage a?c abc hello} [$rd1 read]
+
+        # unsubscribe from the catch-all pattern
+        assert_equal {3} [punsubscribe $rd1 {*}]
+        assert_equal 0 [r publish a.z hello]
+        assert_equal 1 [r publish a..z hello]
+        assert_equal {pmessage a.*.z a..z hello} [$rd1 read]
+
+        # clean up clients
+        $rd1 close
+    }
+
+    test "PUBLISH/PSUBSCRIBE with patterns sharing a prefix" {
+        set rd1 [redis_deferring_client]
+        assert_equal {1 2 3 4} [psubscribe $rd1 {ab* a* abcd? abc*}]
+        assert_equal 4 [r publish abcde hello]
+        assert_equal {pmessage a* abcde hello} [$rd1 read]
+        assert_equal {pmessage ab* abcde hello} [$rd1 read]
+        assert_equal {pmessage abc* abcde hello} [$rd1 read]
+        assert_equal {pmessage abcd? abcde hello} [$rd1 read]
+        assert_equal 2 [r publish abx hello]
+        assert_equal {pmessage a* abx hello} [$rd1 read]
+        assert_equal {pmessage ab* abx hello} [$rd1 read]
+
+        # removing the longest prefixes doesn't affect the shorter ones
+        assert_equal {3 2} [punsubscribe $rd1 {abcd? abc*}]
+        assert_equal 2 [r publish abcde hello]
+        assert_equal {pmessage a* abcde hello} [$rd1 read]
+        assert_equal {pmessage ab* abcde hello} [$rd1 read]
+
+        # clean up clients
+        $rd1 close
+    }
+
+    test "PUBLISH of big messages to many subscribers" {
+        set rd1 [redis_deferring_client]
+        set rd2 [redis_deferring_client]
+        set rd3 [redis_deferring_client]
+        set big [string repeat x 20000]
+
+        assert_equal {1} [subscribe $rd1 {chan1}]
+        assert_equal {1} [subscribe $rd2 {chan1}]
+        assert_equal {1} [psubscribe $rd3 {chan*}]
+        assert_equal 3 [r publish chan1 $big]
+        assert_equal 3 [r publish chan1 hello]
+        assert_equal "message chan1 $big" [$rd1 read]
+        assert_equal {message chan1 hello} [$rd1 read]
+        assert_equal "message chan1 $big" [$rd2 read]
+        assert_equal {message chan1 hello} [$rd2 read]
+        assert_equal "pmessage chan* chan1 $big" [$rd3 read]
+        assert_equal {pmessage chan* chan1 hello} [$rd3 read]
+
+        # clean up clients
+        $rd1 close
+        $rd2 close
+        $rd3 close
+    }
+
     test "PUBLISH/PSUBSCRIBE after PUNSUBSCRIBE without arguments" {
         set rd1 [redis_deferring_client]
         assert_equal {1 2 3} [psubscribe $rd1 {chan1.* chan2.* chan3.*}]
@@ -243,6 +316,24 @@ start_server {tags {"pubsub"}} {
         $rd1 close
     }
 
+    test "Keyspace notifications: channel and pattern subscriptions" {
+        r config set notify-keyspace-events KEA
+        set rd1 [redis_deferring_client]
+        set rd2 [redis_deferring_client]
+        assert_equal {1} [subscribe $rd1 {__keyevent@9__:set}]
+        assert_equal {1} [psubscribe $rd2 {__keyspace@9__:foo*}]
+        r set foo bar
+        r set other bar
+        r set foobar bar
+        assert_equal {message __keyevent@9__:set foo} [$rd1 read]
+        assert_equal {message __keyevent@9__:set other} [$rd1 read]
+        assert_equal {message __keyevent@9__:set foobar} [$rd1 read]
+        assert_equal {pmessage __keyspace@9__:foo* __keyspace@9__:foo set} [$rd2 read]
+        assert_equal {pmessage __keyspace@9__:foo* __keyspace@9__:foobar set} [$rd2 read]
+        $rd1 close
+        $rd2 close
+    }
+
     test "Keyspace notifications: we can receive both kind of events" {
         r config set notify-keyspace-events KEA
         set rd1 [redis_deferring_client]
@@ -61,6 +61,23 @@ start_server {tags {"scripting"}} {
         set _ $e
     } {NOSCRIPT*}
 
+    test {EVALSHA - KEYS and ARGV don't retain elements of previous calls} {
+        r eval {return {#KEYS,#ARGV}} 3 a b c d e f
+        set sha [r script load {return {#KEYS,#ARGV,KEYS[2],ARGV[1]}}]
+        r evalsha $sha 1 a
+    } {1 0}
+
+    test {EVAL - KEYS and ARGV don't retain fields set by previous scripts} {
+        r eval {
+            KEYS.x = 1
+            ARGV[10] = 'x'
+            setmetatable(ARGV,{__index = function() return 'y' end})
+        } 1 a b c
+        r eval {
+            return {KEYS.x == nil, ARGV[10] == nil, ARGV[5] == nil, #ARGV}
+        } 1 a b
+    } {1 1 1 1}
+
     test {EVAL - Redis integer -> Lua type conversion} {
         r set x 0
         r eval {
@@ -111,6 +128,18 @@ start_server {tags {"scripting"}} {
         } 1 mykey
     } {boolean 1}
 
+    test {EVAL - Redis nested and deferred multi bulk -> Lua type conversion} {
+        r del myzset myhash
+        r zadd myzset 1 a 2 b 3 c
+        r hset myhash field [string repeat x 20000]
+        r eval {
+            local z = redis.call('zrangebyscore',KEYS[1],2,'+inf','withscores')
+            local s = redis.call('scan',0,'match','myzset','count',1000)
+            local h = redis.call('hgetall',KEYS[2])
+            return {#z,z[1],z[4],#s,type(s[2]),s[2][1],h[1],string.len(h[2])}
+        } 2 myzset myhash
+    } {4 b 3 2 table myzset field 20000}
+
     test {EVAL - Is the Lua client using the currently selected DB?} {
         r set mykey "this is DB 9"
         r select 10
@@ -298,6 +327,27 @@ start_server {tags {"scripting"}} {
             [r evalsha b534286061d4b9e4026607613b95c06c06015ae8 0]
     } {b534286061d4b9e4026607613b95c06c06015ae8 loaded}
 
+    test {SCRIPT STATS - reports per script calls and redis.call() count} {
+        r script flush
+        set sha [r script load "redis.call('ping'); return redis.call('ping')"]
+        r evalsha $sha 0
+        r evalsha $sha 0
+        set stats [lindex [r script stats $sha] 0]
+        set calls [dict get $stats calls]
+        set redis_calls [dict get $stats redis_calls]
+        set hist [dict get $stats latency_histogram]
+        set hist_calls 0
+        foreach {max count} $hist {incr hist_calls $count}
+        list $calls $redis_calls $hist_calls \
+             [llength [r script stats]] \
+             [string match "*scriptstat_$sha:calls=2,*" [r info scriptstats]]
+    } {2 4 2 1 1}
+
+    test {SCRIPT STATS - CONFIG RESETSTAT clears the statistics} {
+        r config resetstat
+        r script stats
+    } {}
+
     test "In the context of Lua the output of random commands gets ordered" {
         r del myset
         r sadd myset a b c d e f g h i l m n o p q r s t u v z aa aaa azz
@@ -34,13 +34,28 @@ start_server {tags {"slowlog"} overrides {slowlog-log-slower-than 1000000}} {
         r client setname foobar
         r debug sleep 0.2
         set e [lindex [r slowlog get] 0]
-        assert_equal [llength $e] 6
+        assert_equal [llength $e] 7
         assert_equal [lindex $e 0] 105
         assert_equal [expr {[lindex $e 2] > 100000}] 1
         assert_equal [lindex $e 3] {debug sleep 0.2}
         assert_equal {foobar} [lindex $e 5]
     }
 
+    test {SLOWLOG - logged entry reports the duration breakdown} {
+        r config set slowlog-log-slower-than 0
+        r config set notify-keyspace-events KEA
+        r slowlog reset
+        r set foo bar
+        set phases [lindex [r slowlog get] 0 6]
+        r config set notify-keyspace-events ""
+        r config set slowlog-log-slower-than 100000
+        assert_equal 5 [dict get $phases reply-bytes]
+        assert {[dict get $phases execution-usec] >= 0}
+        assert {[dict get $phases propagation-usec] >= 0}
+        assert {[dict get $phases notification-usec] >= 0}
+        assert {[dict get $phases allocated-bytes] > 0}
+    }
+
     test {SLOWLOG - commands with too many arguments are trimmed} {
         r config set slowlog-log-slower-than 0
         r slowlog reset
@@ -186,6 +186,16 @@ start_server {
         assert_equal [lsort -real $floats] [r sort mylist]
     }
 
+    if {[string match {*jemalloc*} [s mem_allocator]]} {
+        test "SORT against a missing key (zero size allocations)" {
+            r flushdb
+            assert_equal {} [r sort nokey]
+            assert_equal {} [r sort nokey alpha limit 0 10]
+            assert_equal 0 [r sort nokey store dst]
+            r ping
+        } {PONG}
+    }
+
     test "SORT with STORE returns zero if result is empty (github issue 224)" {
         r flushdb
         r sort foo store bar
@@ -9,6 +9,18 @@ start_server {tags {"string"}} {
         r get x
     } {}
 
+    if {[string match {*jemalloc*} [s mem_allocator]]} {
+        test {SET and DEL of non shared integers} {
+            for {set j 0} {$j < 1000} {incr j} {
+                r set foo [expr {100000+$j}]
+                assert_encoding int foo
+                r set bar -$j
+                r del foo bar
+            }
+            r ping
+        } {PONG}
+    }
+
     test {Very big payload in GET/SET} {
         set buf [string repeat "abcd" 1000000]
         r set foo $buf
@@ -419,4 +431,41 @@ start_server {tags {"string"}} {
         r set foo bar
         r getrange foo 0 4294967297
     } {bar}
+
+    test {THROTTLE allows max_burst+1 actions then limits} {
+        r del limiter
+        set res {}
+        for {set j 0} {$j < 4} {incr j} {
+            lappend res [lindex [r throttle limiter 2 1 60] 0]
+        }
+        set limited [r throttle limiter 2 1 60]
+        list $res [lindex $limited 1] [lindex $limited 2] \
+             [expr {[lindex $limited 3] > 0 && [lindex $limited 3] <= 60000}] \
+             [expr {[r pttl limiter] > 0}]
+    } {{1 1 1 0} 3 0 1 1}
+
+    test {THROTTLE quantity larger than the limit is never allowed} {
+        r del limiter
+        lrange [r throttle limiter 2 1 60 4] 0 3
+    } {0 3 3 -1}
+
+    test {THROTTLE against wrong type or invalid parameters} {
+        r del limiter
+        r lpush limiter a
+        catch {r throttle limiter 1 1 1} e
+        assert_match {WRONGTYPE*} $e
+        catch {r throttle limiter 1 0 1} e
+        set e
+    } {ERR invalid rate limit parameters}
+
+    test {THROTTLE refuses an out of range state} {
+        r set limiter 9223372036854775807
+        catch {r throttle limiter 2 1 60} e
+        set e
+    } {ERR rate limit state out of range}
+
+    test {THROTTLE treats a state in the past as now} {
+        r set limiter -9223372036854775808
+        lrange [r throttle limiter 2 1 60] 0 2
+    } {1 3 2}
 }